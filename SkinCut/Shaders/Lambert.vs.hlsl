@@ -1,11 +1,13 @@
 #pragma pack_matrix(row_major)
 
-struct VSIN
+#include "Packing.h.hlsl"
+
+struct VSIN // PackedVertex
 {
 	float4 position  : POSITION0;
 	float2 texcoord  : TEXCOORD0;
-	float3 normal    : NORMAL0;
-	float4 tangent   : TANGENT0;
+	float2 normal    : NORMAL0;  // octahedral
+	float4 tangent   : TANGENT0; // tangent frame quaternion
 };
 
 struct VSOUT
@@ -27,6 +29,6 @@ VSOUT main(VSIN input)
 	VSOUT output;
 	output.position = mul(input.position, WorldViewProjection);
 	output.texcoord = input.texcoord;
-	output.normal = mul(float4(input.normal, 0), WorldIT).xyz;
+	output.normal = mul(float4(DecodeOctahedral(input.normal), 0), WorldIT).xyz;
 	return output;
 }
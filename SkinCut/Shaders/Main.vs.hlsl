@@ -4,12 +4,14 @@
 
 #pragma pack_matrix(row_major)
 
-struct VSIN
+#include "Packing.h.hlsl"
+
+struct VSIN // PackedVertex
 {
 	float4 position  : POSITION0;
 	float2 texcoord  : TEXCOORD0;
-	float3 normal    : NORMAL0;
-	float4 tangent   : TANGENT0;
+	float2 normal    : NORMAL0;  // octahedral
+	float4 tangent   : TANGENT0; // tangent frame quaternion
 };
 
 struct VSOUT
@@ -39,9 +41,11 @@ VSOUT main(VSIN input)
 	output.texcoord = input.texcoord;	
 	output.position = mul(input.position, World).xyz; // position in world coordinates
 	output.viewdir = normalize(Eye - output.position); // direction from surface to camera
-	output.normal = mul(input.normal, (float3x3)WorldIT);
-	output.tangent.xyz = mul(input.tangent.xyz, (float3x3)WorldIT);
-	output.tangent.w = input.tangent.w;
+	float3 normal = DecodeOctahedral(input.normal);
+	float4 tangent = DecodeTangent(input.tangent);
+	output.normal = mul(normal, (float3x3)WorldIT);
+	output.tangent.xyz = mul(tangent.xyz, (float3x3)WorldIT);
+	output.tangent.w = tangent.w;
 	return output;
 }
 
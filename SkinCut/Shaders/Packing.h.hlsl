@@ -0,0 +1,31 @@
+// Packing.h.hlsl
+// Decode compressed vertex attributes (see PackedVertex in Structures.hpp).
+
+
+// unit vector from octahedral encoding
+float3 DecodeOctahedral(float2 e)
+{
+	float3 v = float3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+
+	// lower hemisphere is folded over the diagonals
+	if (v.z < 0.0)
+	{
+		v.xy = (1.0 - abs(v.yx)) * ((v.xy >= 0.0) ? 1.0 : -1.0);
+	}
+
+	return normalize(v);
+}
+
+
+// tangent from tangent frame quaternion (w holds the bitangent handedness in its sign)
+float4 DecodeTangent(float4 q)
+{
+	q = normalize(q);
+
+	// rotate (1,0,0) by q
+	float3 tangent = float3(1.0 - 2.0 * (q.y * q.y + q.z * q.z), 
+	                        2.0 * (q.x * q.y + q.w * q.z), 
+	                        2.0 * (q.x * q.z - q.w * q.y));
+
+	return float4(tangent, (q.w < 0.0) ? -1.0 : 1.0);
+}
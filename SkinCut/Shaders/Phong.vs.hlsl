@@ -4,12 +4,14 @@
 
 #pragma pack_matrix(row_major)
 
-struct VSIN
+#include "Packing.h.hlsl"
+
+struct VSIN // PackedVertex
 {
 	float4 position  : POSITION0;
 	float2 texcoord  : TEXCOORD0;
-	float3 normal    : NORMAL0;
-	float4 tangent   : TANGENT0;
+	float2 normal    : NORMAL0;  // octahedral
+	float4 tangent   : TANGENT0; // tangent frame quaternion
 };
 
 struct VSOUT
@@ -37,7 +39,7 @@ VSOUT main(VSIN input)
 	
 	output.position = mul(input.position, WorldViewProjection);
 	output.texcoord = input.texcoord;
-	output.normal = mul(input.normal, (float3x3)WorldIT);
+	output.normal = mul(DecodeOctahedral(input.normal), (float3x3)WorldIT);
 	output.halfway = -LightDirection.xyz + normalize(ViewPosition.xyz - input.position.xyz);
 	
 	return output;  
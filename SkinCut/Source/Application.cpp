@@ -4,6 +4,7 @@
 #include <math.h>
 #include <fcntl.h>
 #include <fstream>
+#include <algorithm>
 #include <iomanip>
 
 #include "ImGui/imgui.h"
@@ -11,14 +12,22 @@
 
 #include "Light.hpp"
 #include "Camera.hpp"
+#include "Mesh.hpp"
 #include "Entity.hpp"
 #include "Shader.hpp"
 #include "Target.hpp"
 #include "Utility.hpp"
+#include "AssetCache.hpp"
 #include "Renderer.hpp"
+#include "Benchmark.hpp"
 #include "Dashboard.hpp"
 #include "Generator.hpp"
 #include "Stopwatch.hpp"
+#include "MeshChunks.hpp"
+#include "Parallel.hpp"
+#include "PickCache.hpp"
+#include "SceneBvh.hpp"
+#include "SceneLoader.hpp"
 
 
 #pragma comment(lib, "dxgi.lib")
@@ -40,14 +49,29 @@ namespace SkinCut {
 // number of runs for performance test
 constexpr auto cNumTestRuns = 100;
 
+// seconds without mouse input before faces changed by edits are reordered
+constexpr float cIdleTime = 1.0f;
+
+// rays per task of batched intersection queries
+constexpr size_t cRayGrain = 64;
+
 
 Application::Application()
 {
 	mHwnd = nullptr;
+	mIdleTime = 0.0f;
+	mSceneBvh = std::unique_ptr<SceneBvh>(new SceneBvh());
+	mPickCache = std::unique_ptr<PickCache>(new PickCache());
+	mHover = Intersection();
+	mHoverStale = true;
 	std::ignore = _setmode(_fileno(stdout), _O_U16TEXT);
 }
 
-Application::~Application() { }
+Application::~Application()
+{
+	mLoader.reset(); // (stop loading)
+	AssetCache::Flush(); // finish writing cache entries
+}
 
 bool Application::Initialize(HWND hWnd, const std::string& respath)
 {
@@ -100,6 +124,7 @@ bool Application::LoadConfig()
 	gConfig.EnableOcclusion = root.at(L"bOcclusion")->AsBool();
 	gConfig.EnableIrradiance = root.at(L"bIrradiance")->AsBool();
 	gConfig.EnableScattering = root.at(L"bScattering")->AsBool();
+	gConfig.EnableReordering = root.at(L"bReordering")->AsBool();
 
 	gConfig.Ambient = (float)root.at(L"fAmbient")->AsNumber();
 	gConfig.Fresnel = (float)root.at(L"fFresnel")->AsNumber();
@@ -178,6 +203,7 @@ bool Application::LoadScene()
 	mCamera = std::make_unique<Camera>(width, height, cy, cp, cd);
 
 	// lights
+	mLights.clear();
 	for (auto jlight : jlights) {
 		std::string name = Utility::wstr2str(jlight->AsObject().at(L"name")->AsString());
 
@@ -192,7 +218,8 @@ bool Application::LoadScene()
 		mLights.push_back(std::make_shared<Light>(mDevice, mContext, y, p, d, Color(r,g,b), name));
 	}
 
-	// models
+	// models (loaded in the background, see Update)
+	std::vector<EntityLoadInfo> models;
 	for (auto jmodel : jmodels) {
 		float x = (float)jmodel->AsObject().at(L"position")->AsArray().at(0)->AsNumber();
 		float y = (float)jmodel->AsObject().at(L"position")->AsArray().at(1)->AsNumber();
@@ -204,17 +231,21 @@ bool Application::LoadScene()
 		std::string name = Utility::wstr2str(jmodel->AsObject().at(L"name")->AsString());
 
 		std::wstring resourcePath = Utility::str2wstr(gConfig.ResourcePath);
-		std::wstring meshPath = resourcePath + jmodel->AsObject().at(L"mesh")->AsString();
-		std::wstring colorPath = resourcePath + jmodel->AsObject().at(L"color")->AsString();
-		std::wstring normalPath = resourcePath + jmodel->AsObject().at(L"normal")->AsString();
-		std::wstring specularPath = resourcePath + jmodel->AsObject().at(L"specular")->AsString();
-		std::wstring discolorPath = resourcePath + jmodel->AsObject().at(L"discolor")->AsString();
-		std::wstring occlusionPath = resourcePath + jmodel->AsObject().at(L"occlusion")->AsString();
 
-		mModels.push_back(std::make_shared<Entity>(mDevice, Vector3(x,y,z), Vector2(rx, ry), 
-			meshPath, colorPath, normalPath, specularPath, discolorPath, occlusionPath));
+		EntityLoadInfo info;
+		info.position = Vector3(x,y,z);
+		info.rotation = Vector2(rx, ry);
+		info.meshPath = resourcePath + jmodel->AsObject().at(L"mesh")->AsString();
+		info.colorPath = resourcePath + jmodel->AsObject().at(L"color")->AsString();
+		info.normalPath = resourcePath + jmodel->AsObject().at(L"normal")->AsString();
+		info.specularPath = resourcePath + jmodel->AsObject().at(L"specular")->AsString();
+		info.discolorPath = resourcePath + jmodel->AsObject().at(L"discolor")->AsString();
+		info.occlusionPath = resourcePath + jmodel->AsObject().at(L"occlusion")->AsString();
+		models.push_back(info);
 	}
 
+	mLoader = std::make_unique<SceneLoader>(mDevice, models);
+
 	return true;
 }
 
@@ -263,17 +294,63 @@ bool Application::Update()
 	ImGuiIO& io = ImGui::GetIO();
 
 	if (!io.KeyCtrl && !io.KeyShift && !mPointA && !mPointB && !io.WantCaptureMouse && !io.WantCaptureKeyboard) {
+		Matrix view = mCamera->mView;
 		mCamera->Update();
+		if (mCamera->mView != view) {
+			mHoverStale = true; // (the scene moved under the cursor)
+		}
 	}
 
 	for (auto& light : mLights) {
 		light->Update();
 	}
 
+	// The current models stay in use until the scene being loaded is complete.
+	if (mLoader) {
+		if (mLoader->Update()) {
+			mModels = std::move(mLoader->Models());
+			mLoader.reset();
+			mPointA.reset(); // (picked on the replaced models)
+			mPointB.reset();
+			mPickCache->Reset();
+			mHoverStale = true;
+		}
+		mDashboard->SetProgress(mLoader ? mLoader->Progress() : -1.0f);
+	}
+
 	for (auto& model : mModels) {
 		model->Update(mCamera->mView, mCamera->mProjection);
 	}
 
+	// find the face under the cursor (highlighted by Render); while a cut is being placed,
+	// preview it from its first point to that face
+	Vector2 cursor(io.MousePos.x, io.MousePos.y);
+	if (!io.WantCaptureMouse) {
+		if (mHoverStale || cursor != mHoverCursor) {
+			Hover();
+		}
+	}
+	else {
+		mHover = Intersection(); // (the cursor is over the dashboard)
+		mHoverStale = true;
+	}
+
+	float cutLength = -1.0f;
+	if (mPointA && mHover.hit && mHover.model == mPointA->model) {
+		cutLength = Vector3::Distance(mPointA->pos_os, mHover.pos_os) * 20.0f; // (1cm = 0.05 units, as in Mesh::OpenCutLine)
+	}
+	mDashboard->SetCutPreview(cutLength);
+	mDashboard->SetPicking(mPickCache->Stats());
+
+	// reorder the chunks that edits changed for the vertex cache once the user is idle
+	bool input = io.MouseDown[0] || io.MouseDown[1] || io.MouseDown[2] || mPointA;
+	mIdleTime = input ? 0.0f : mIdleTime + io.DeltaTime;
+	if (gConfig.EnableReordering && mIdleTime >= cIdleTime) {
+		for (auto& model : mModels) {
+			model->OptimizeVertexCache();
+		}
+	}
+
 	mDashboard->Update();
 
 	return true;
@@ -288,6 +365,7 @@ bool Application::Render()
 
 	// render scene
 	mRenderer->Render(mModels, mLights, mCamera);
+	mRenderer->RenderHighlight(mHover, mCamera);
 
 	// render user interface
 	if (gConfig.EnableDashboard)
@@ -332,17 +410,10 @@ bool Application::Render()
 
 bool Application::Reload()
 {
-	mCamera->Reset();
-
-	for (auto& light : mLights) {
-		light->Reset();
-	}
-
-	for (auto& model : mModels) {
-		model->Reload();
-	}
+	if (mLoader) return false; // (already loading)
 
-	return true;
+	// Camera and lights are reset right away; the models are replaced once they are loaded.
+	return LoadScene();
 }
 
 
@@ -367,6 +438,7 @@ void Application::Pick()
 	// Keep track of number of points selected
 	if (!mPointA) {
 		mPointA = std::make_unique<Intersection>(ix);
+		mHoverStale = true; // (start the cut preview)
 	}
 	else if (!mPointB) {
 		mPointB = std::make_unique<Intersection>(ix);
@@ -377,10 +449,27 @@ void Application::Pick()
 		CreateCut(*mPointA.get(), *mPointB.get());
 		mPointA.reset();
 		mPointB.reset();
+		mHoverStale = true;
 	}
 }
 
 
+void Application::Hover()
+{
+	RECT rect;
+	GetClientRect(mHwnd, &rect);
+	ImGuiIO& io = ImGui::GetIO();
+
+	Vector2 cursor(io.MousePos.x, io.MousePos.y);
+	Vector2 resolution((float)mRenderer->mWidth, (float)mRenderer->mHeight);
+	Vector2 window((float)rect.right - (float)rect.left - 1, (float)rect.bottom - (float)rect.top - 1);
+
+	mHover = FindIntersection(cursor, resolution, window, mCamera->mProjection, mCamera->mView);
+	mHoverCursor = cursor;
+	mHoverStale = false;
+}
+
+
 void Application::CreateCut(Intersection& a, Intersection& b)
 {
 	if (!a.model || !b.model || a.model.get() != b.model.get()) {
@@ -394,6 +483,10 @@ void Application::CreateCut(Intersection& a, Intersection& b)
 	std::list<Link> cutLine;
 	std::vector<Edge*> cutEdges;
 	std::shared_ptr<Target> patch;
+#ifdef _DEBUG
+	UploadStats vertexUploads = model->mChunks->VertexStats();
+	UploadStats indexUploads = model->mChunks->IndexStats();
+#endif
 
 	// Find all triangles intersected by the cutting quad, and order them into a chain of segments
 	sw.Start("1] Form cutting line");
@@ -405,36 +498,87 @@ void Application::CreateCut(Intersection& a, Intersection& b)
 	CreateWound(cutLine, model, patch);
 	sw.Stop("2] Generate wound patch");
 
-	// Paint wound patch onto mesh color texture
-	sw.Start("3] Paint wound patch");
-	PaintWound(cutLine, model, patch);
-	sw.Stop("3] Paint wound patch");
+	{ // Paint, fuse and open as one undoable edit (also a topology transaction: cut edges must stay valid in between)
+		Entity::Edit edit(*model);
 
-	// Only draw wound texture
-	if (gConfig.PickMode == PickType::PAINT) {
-		return;
-	}
+		// Paint wound patch onto mesh color texture
+		sw.Start("3] Paint wound patch");
+		PaintWound(cutLine, model, patch);
+		sw.Stop("3] Paint wound patch");
 
-	// Fuse cutting line into mesh
-	if (gConfig.PickMode >= PickType::MERGE) {
-		sw.Start("4] Fuse cutting line");
-		model->FuseCutline(cutLine, cutEdges);
-		sw.Stop("4] Fuse cutting line");
-	}
+		// Only draw wound texture
+		if (gConfig.PickMode == PickType::PAINT) {
+			return;
+		}
+
+		// Fuse cutting line into mesh
+		if (gConfig.PickMode >= PickType::MERGE) {
+			sw.Start("4] Fuse cutting line");
+			model->FuseCutline(cutLine, cutEdges);
+			sw.Stop("4] Fuse cutting line");
+		}
 
-	// Open carve cutting line into mesh
-	if (gConfig.PickMode == PickType::CARVE) {
-		sw.Start("5] Carve incision");
-		model->OpenCutLine(cutEdges, cutQuad);
-		sw.Stop("5] Carve incision");
+		// Open carve cutting line into mesh
+		if (gConfig.PickMode == PickType::CARVE) {
+			sw.Start("5] Carve incision");
+			model->OpenCutLine(cutEdges, cutQuad);
+			sw.Stop("5] Carve incision");
+		}
 	}
 
 #ifdef _DEBUG
 	sw.Report();
+
+	auto& stats = model->mMesh->mTransactionStats;
+	std::stringstream ss;
+	ss << "Topology elements (node/edge/face):" << std::endl;
+	ss << "  allocated " << stats.allocated[0] << "/" << stats.allocated[1] << "/" << stats.allocated[2] << std::endl;
+	ss << "  recycled  " << stats.recycled[0] << "/" << stats.recycled[1] << "/" << stats.recycled[2] << std::endl;
+	ss << "  killed    " << stats.killed[0] << "/" << stats.killed[1] << "/" << stats.killed[2] << std::endl;
+	ss << "Buffer uploads (KB): vertex " << (model->mChunks->VertexStats().bytes - vertexUploads.bytes) / 1024.0;
+	ss << "  index " << (model->mChunks->IndexStats().bytes - indexUploads.bytes) / 1024.0;
+	Utility::ConsoleMessage(ss.str());
 #endif
 }
 
 
+void Application::Undo()
+{
+	// Revert the most recent edit of any model
+	std::shared_ptr<Entity> last;
+	for (auto& model : mModels) {
+		if (model->LastEdit() > (last ? last->LastEdit() : 0)) {
+			last = model;
+		}
+	}
+
+	if (last && last->Undo()) {
+		mPointA.reset(); // selected faces may no longer exist
+		mPointB.reset();
+		mHoverStale = true;
+	}
+}
+
+
+void Application::Redo()
+{
+	// Reapply the earliest reverted edit of any model
+	std::shared_ptr<Entity> next;
+	for (auto& model : mModels) {
+		uint64_t serial = model->NextEdit();
+		if (serial > 0 && (!next || serial < next->NextEdit())) {
+			next = model;
+		}
+	}
+
+	if (next && next->Redo()) {
+		mPointA.reset();
+		mPointB.reset();
+		mHoverStale = true;
+	}
+}
+
+
 void Application::Split()
 {
 	RECT rect;
@@ -450,6 +594,7 @@ void Application::Split()
 		throw std::exception("No intersection");
 	}
 	ix.model->Subdivide(ix.face, gConfig.SplitMode, ix.pos_os);
+	mHoverStale = true;
 }
 
 
@@ -473,37 +618,83 @@ void Application::DrawDecal()
 
 Intersection Application::FindIntersection(Vector2 cursor, Vector2 resolution, Vector2 window, Matrix proj, Matrix view)
 {
-	// convert screen-space position into viewport space
-	Vector2 screenPos = Vector2((cursor.x * resolution.x) / window.x, (cursor.y * resolution.y) / window.y);
+	Intersection ix = Selection(cursor, resolution, window, proj, view);
 
-	// Create an object-space ray from the given screen-space position.
-	Ray ray = CreateRay(screenPos, resolution, proj, view);
+	// Find the closest model that intersects with the ray: models are visited nearest first, with
+	// the ray in their object space, and those entered beyond the closest hit so far are skipped.
+	mSceneBvh->Update(mModels);
 
+	bool hit = mSceneBvh->Closest(ix.ray, ix, [&](const std::shared_ptr<Entity>& model, Ray& ray, Intersection& mix) {
+		return mPickCache->RayIntersection(model, ray, mix);
+	});
 
-	Intersection ix;
-	ix.hit = false;
-	ix.ray = ray;
-	ix.model = nullptr;
-	ix.pos_ss = screenPos;
-	ix.nearz = Camera::cNearPlane;
-	ix.farz = Camera::cFarPlane;
+	if (hit) {
+		mPickCache->Remember(ix);
+	}
 
-	// find closest model that intersects with ray
-	constexpr float tmin = std::numeric_limits<float>::max();
+	return ix;
+}
 
-	for (auto& model : mModels) {
-		if (model->RayIntersection(ray, ix)) {
-			ix.hit = true;
-			if (ix.dist < tmin) {
-				ix.model = model;
-			}
-		}
+
+std::vector<Intersection> Application::FindIntersections(const std::vector<Vector2>& cursors, Vector2 resolution, Vector2 window, Matrix proj, Matrix view)
+{
+	std::vector<Intersection> ixs(cursors.size());
+	for (size_t i = 0; i < cursors.size(); ++i) {
+		ixs[i] = Selection(cursors[i], resolution, window, proj, view);
 	}
 
-	if (ix.hit) {
-		ix.pos_ws = Vector3::Transform(ix.pos_os, ix.model->mMatrixWorld);
+	FindIntersections(ixs);
+	return ixs;
+}
+
+
+std::vector<Intersection> Application::FindIntersections(const std::vector<Ray>& rays)
+{
+	std::vector<Intersection> ixs(rays.size());
+	for (size_t i = 0; i < rays.size(); ++i) {
+		ixs[i].hit = false;
+		ixs[i].ray = rays[i];
+		ixs[i].model = nullptr;
+		ixs[i].nearz = Camera::cNearPlane;
+		ixs[i].farz = Camera::cFarPlane;
 	}
 
+	FindIntersections(ixs);
+	return ixs;
+}
+
+
+void Application::FindIntersections(std::vector<Intersection>& ixs)
+{
+	// Once updated, the hierarchies of the scene and of the meshes are only read, so the rays can
+	// be traced on all threads of the worker pool of Parallel (without the pick cache, which is
+	// meant for one ray at a time).
+	mSceneBvh->Update(mModels);
+
+	const size_t count = ixs.size();
+	Parallel::For(Parallel::Tasks(count, cRayGrain), [&](uint32_t t) {
+		size_t end = std::min(count, size_t(t + 1) * cRayGrain);
+		for (size_t i = size_t(t) * cRayGrain; i < end; ++i) {
+			mSceneBvh->Closest(ixs[i].ray, ixs[i], [](const std::shared_ptr<Entity>& model, Ray& local, Intersection& ix) {
+				return model->mMesh->ClosestIntersection(local, ix);
+			});
+		}
+	});
+}
+
+
+Intersection Application::Selection(Vector2 cursor, Vector2 resolution, Vector2 window, Matrix proj, Matrix view)
+{
+	// convert screen-space position into viewport space
+	Vector2 screenPos = Vector2((cursor.x * resolution.x) / window.x, (cursor.y * resolution.y) / window.y);
+
+	Intersection ix;
+	ix.hit = false;
+	ix.ray = CreateRay(screenPos, resolution, proj, view); // (world space)
+	ix.model = nullptr;
+	ix.pos_ss = screenPos;
+	ix.nearz = Camera::cNearPlane;
+	ix.farz = Camera::cFarPlane;
 	return ix;
 }
 
@@ -659,6 +850,16 @@ LRESULT CALLBACK Application::WndProc(HWND hWnd, uint32_t msg, WPARAM wParam, LP
 						break;
 					}
 
+					case 'Z': { // undo last cut or subdivision
+						Undo();
+						break;
+					}
+
+					case 'Y': { // redo last undone cut or subdivision
+						Redo();
+						break;
+					}
+
 					case 'W': { // toggle wireframe mode
 						gConfig.EnableWireframe = !gConfig.EnableWireframe;
 						break;
@@ -668,6 +869,11 @@ LRESULT CALLBACK Application::WndProc(HWND hWnd, uint32_t msg, WPARAM wParam, LP
 						PerformanceTest();
 						break;
 					}
+
+					case 'B': { // benchmark mesh data structures
+						RunBenchmarks();
+						break;
+					}
 				}
 
 				break;
@@ -773,14 +979,29 @@ std::vector<std::tuple<std::wstring, Vector2, Vector2>> Application::CreateSampl
 
 void Application::RunTest(std::vector<std::tuple<std::wstring, Vector2, Vector2>>& samples, Vector2& resolution, Vector2& window, Matrix& projection, Matrix& view)
 {
+	// Every run starts from the pristine models (runs reload them when done), so the end points of
+	// all cuts are picked once, in one batch. Reloading restores faces in place, so the picked
+	// faces stay valid.
+	for (auto& model : mModels) {
+		model->Reload();
+	}
+
+	std::vector<Vector2> cursors;
 	for (auto& sample : samples) {
+		cursors.push_back(std::get<1>(sample));
+		cursors.push_back(std::get<2>(sample));
+	}
+	std::vector<Intersection> ixs = FindIntersections(cursors, resolution, window, projection, view);
+
+	for (size_t si = 0; si < samples.size(); ++si) {
+		auto& sample = samples[si];
 		std::array<long long, 5> stageTime = {}; // init values to zero
 
 		for (uint32_t run = 0; run < (uint32_t)cNumTestRuns; ++run) {
 			Stopwatch sw;
 
-			Intersection ix0 = FindIntersection(std::get<1>(sample), resolution, window, projection, view);
-			Intersection ix1 = FindIntersection(std::get<2>(sample), resolution, window, projection, view);
+			Intersection ix0 = ixs[2 * si];
+			Intersection ix1 = ixs[2 * si + 1];
 
 			Quadrilateral cutQuad;
 			std::list<Link> cutLine;
@@ -796,15 +1017,19 @@ void Application::RunTest(std::vector<std::tuple<std::wstring, Vector2, Vector2>
 			sw.Stop("2");
 
 			sw.Start("3");
-			PaintWound(cutLine, ix0.model, patch);
-			sw.Stop("3");
+			{ // one edit, as in CreateCut; it ends (connecting and recycling the topology) within stage 5
+				Entity::Edit edit(*ix0.model);
 
-			sw.Start("4");
-			ix0.model->FuseCutline(cutLine, cutEdges);
-			sw.Stop("4");
+				PaintWound(cutLine, ix0.model, patch);
+				sw.Stop("3");
 
-			sw.Start("5");
-			ix0.model->OpenCutLine(cutEdges, cutQuad);
+				sw.Start("4");
+				ix0.model->FuseCutline(cutLine, cutEdges);
+				sw.Stop("4");
+
+				sw.Start("5");
+				ix0.model->OpenCutLine(cutEdges, cutQuad);
+			}
 			sw.Stop("5");
 
 			stageTime[0] += sw.ElapsedTime("1");
@@ -872,3 +1097,21 @@ void Application::PerformanceTest()
 	RunTest(cutSamplesMed, resolution, window, proj, view);
 	RunTest(cutSamplesSml, resolution, window, proj, view);
 }
+
+
+void Application::RunBenchmarks()
+{
+	for (auto& model : mModels) {
+		Benchmark::TopologyLayout(*model->mMesh);
+		Benchmark::TopologyTables(*model->mMesh);
+		Benchmark::VertexDedup(*model->mMesh);
+		Benchmark::VertexPacking(*model->mMesh);
+		Benchmark::CacheLoading(*model->mMesh);
+		Benchmark::ObjParsing(*model->mMesh);
+		Benchmark::VertexOrdering(*model->mMesh);
+		Benchmark::RayPicking(*model->mMesh);
+		Benchmark::TriangleKernel(*model->mMesh);
+		Benchmark::BatchPicking(*model->mMesh);
+		Benchmark::UploadPlanning(*model->mMesh);
+	}
+}
@@ -33,6 +33,9 @@ namespace SkinCut
 	class Dashboard;
 	class FrameBuffer;
 	class Target;
+	class SceneLoader;
+	class PickCache;
+	class SceneBvh;
 
 
 	class Application
@@ -54,10 +57,19 @@ namespace SkinCut
 		std::unique_ptr<Renderer>			mRenderer;
 		std::unique_ptr<Dashboard>			mDashboard;
 		std::unique_ptr<Generator>			mGenerator;
+		std::unique_ptr<SceneLoader>		mLoader; // scene being loaded (if any)
 
 		std::unique_ptr<Intersection>		mPointA;
 		std::unique_ptr<Intersection>		mPointB;
 
+		std::unique_ptr<SceneBvh>			mSceneBvh; // hierarchy of model bounds for picking
+		std::unique_ptr<PickCache>			mPickCache; // picking starts near the face picked last
+		Intersection						mHover; // under the cursor (highlighted, and the end of the cut preview)
+		Math::Vector2						mHoverCursor; // cursor position of mHover
+		bool								mHoverStale; // models changed since mHover was found
+
+		float								mIdleTime; // seconds since the last mouse input
+
 
 	public:
 		Application();
@@ -77,12 +89,19 @@ namespace SkinCut
 		bool SetupDashboard();
 
 		void Pick();
+		void Hover(); // find the intersection under the cursor (mHover)
 		void CreateCut(Intersection& ia, Intersection& ib);
+		void Undo();
+		void Redo();
 
 		void Split();
 		void DrawDecal();
 
 		Intersection FindIntersection(Math::Vector2 cursor, Math::Vector2 resolution, Math::Vector2 window, Math::Matrix proj, Math::Matrix view);
+		std::vector<Intersection> FindIntersections(const std::vector<Math::Vector2>& cursors, Math::Vector2 resolution, Math::Vector2 window, Math::Matrix proj, Math::Matrix view); // one per cursor, traced on all threads
+		std::vector<Intersection> FindIntersections(const std::vector<Math::Ray>& rays); // one per world-space ray, traced on all threads
+		void FindIntersections(std::vector<Intersection>& ixs); // trace the rays of unpicked intersections on all threads
+		Intersection Selection(Math::Vector2 cursor, Math::Vector2 resolution, Math::Vector2 window, Math::Matrix proj, Math::Matrix view); // unpicked intersection with the ray through a cursor position
 
 		void CreateWound(std::list<Link>& cutline, std::shared_ptr<Entity>& model, std::shared_ptr<Target>& patch);
 		void PaintWound(std::list<Link>& cutline, std::shared_ptr<Entity>& model, std::shared_ptr<Target>& patch);
@@ -91,6 +110,7 @@ namespace SkinCut
 		std::vector<std::tuple<std::wstring, Math::Vector2, Math::Vector2>> CreateSamples(std::vector<std::pair<Math::Vector2, Math::Vector2>>& locations, std::vector<float>& lengths, std::wstring setName);
 		void RunTest(std::vector<std::tuple<std::wstring, Math::Vector2, Math::Vector2>>& samples, Math::Vector2& resolution, Math::Vector2& window, Math::Matrix& projection, Math::Matrix& view);
 		void PerformanceTest();
+		void RunBenchmarks();
 	};
 }
 
@@ -0,0 +1,124 @@
+#include "AssetCache.hpp"
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include <windows.h>
+
+#include "Hash.hpp"
+
+
+using namespace SkinCut;
+
+
+
+namespace
+{
+	std::mutex gPendingLock;
+	std::vector<std::future<void>> gPending; // (futures of std::async wait for their task when destroyed)
+	std::atomic<uint32_t> gTemporaries(0);
+
+
+	// Split an entry path into its directory and the part of its name that is common to all
+	// entries of the same source ("<source>.").
+	void Split(const std::wstring& entry, std::wstring& directory, std::wstring& prefix)
+	{
+		size_t slash = entry.find_last_of(L"\\/");
+		directory = (slash == std::wstring::npos) ? std::wstring() : entry.substr(0, slash + 1);
+
+		std::wstring name = entry.substr(directory.size());
+		size_t key = name.find_last_of(L'.', name.find_last_of(L'.') - 1);
+		prefix = name.substr(0, key + 1);
+	}
+
+
+	void Write(const std::wstring& entry, const std::vector<uint8_t>& contents)
+	{
+		std::wstring directory, prefix;
+		Split(entry, directory, prefix);
+		if (!directory.empty()) CreateDirectory(directory.c_str(), nullptr); // (fails if it already exists)
+
+		std::wstring temporary = entry + L"." + std::to_wstring(gTemporaries++) + L".tmp";
+		std::ofstream out(temporary, std::ios::out | std::ios::binary);
+		out.write(reinterpret_cast<const char*>(contents.data()), contents.size());
+		out.close();
+
+		// A failed write leaves no entry; the asset is imported again next time.
+		if (!out || !MoveFileEx(temporary.c_str(), entry.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+			DeleteFile(temporary.c_str());
+			return;
+		}
+
+		// remove entries of earlier contents
+		WIN32_FIND_DATA data;
+		std::wstring pattern = directory + prefix + L"*.bin";
+		HANDLE find = FindFirstFile(pattern.c_str(), &data);
+		if (find == INVALID_HANDLE_VALUE) return;
+
+		do {
+			std::wstring other = directory + data.cFileName;
+			if (other != entry) DeleteFile(other.c_str());
+		} while (FindNextFile(find, &data));
+		FindClose(find);
+	}
+}
+
+
+
+std::wstring AssetCache::Entry(const std::wstring& source, const void* data, size_t size, uint32_t formatVersion)
+{
+	struct Key
+	{
+		uint64_t contents;
+		uint32_t importerVersion;
+		uint32_t formatVersion;
+	};
+	Key key = { hash_bytes(data, size), cImporterVersion, formatVersion };
+
+	std::wstringstream ss;
+	ss << std::hex << std::setw(16) << std::setfill(L'0') << hash_bytes(&key, sizeof(Key));
+
+	size_t slash = source.find_last_of(L"\\/");
+	std::wstring directory = (slash == std::wstring::npos) ? std::wstring() : source.substr(0, slash + 1);
+	std::wstring name = source.substr(directory.size());
+
+	return directory + cDirectory + name + L"." + ss.str() + L".bin";
+}
+
+
+void AssetCache::Store(const std::wstring& entry, std::vector<uint8_t>&& contents)
+{
+	std::lock_guard<std::mutex> lock(gPendingLock);
+
+	// forget writes that have finished
+	gPending.erase(std::remove_if(gPending.begin(), gPending.end(), [](std::future<void>& f) {
+		return f.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+	}), gPending.end());
+
+	gPending.push_back(std::async(std::launch::async, [entry, contents = std::move(contents)]() {
+		try {
+			Write(entry, contents);
+		}
+		catch (...) {} // (the cache is optional)
+	}));
+}
+
+
+void AssetCache::Flush()
+{
+	std::vector<std::future<void>> pending;
+	{
+		std::lock_guard<std::mutex> lock(gPendingLock);
+		std::swap(pending, gPending);
+	}
+
+	for (auto& f : pending) {
+		f.wait();
+	}
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+
+
+namespace SkinCut
+{
+	// Cache of data derived from source assets (imported meshes), kept in a cache directory next
+	// to the sources. Entries are named after their source and keyed by a hash of its contents,
+	// the importer version and the format version of the entry, so an edited source or a changed
+	// importer never picks up an old entry; it has no entry until one is stored.
+	//
+	// Entries are written on a background thread, through a temporary file that is renamed when
+	// complete, so readers only ever see whole entries (or none). Storing an entry removes the
+	// entries of earlier contents of the same source.
+	namespace AssetCache
+	{
+		static const uint32_t cImporterVersion = 2; // increment whenever the data imported from unchanged sources changes
+		static const wchar_t* const cDirectory = L"Cache\\";
+
+		// Entry file of a source with the given contents (the source may be a file path or a resource name).
+		std::wstring Entry(const std::wstring& source, const void* data, size_t size, uint32_t formatVersion);
+
+		void Store(const std::wstring& entry, std::vector<uint8_t>&& contents); // returns immediately
+		void Flush(); // wait until all stored entries are written
+	}
+}
@@ -0,0 +1,906 @@
+#include "Benchmark.hpp"
+
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <random>
+#include <iomanip>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "Mesh.hpp"
+#include "Hash.hpp"
+#include "FaceBvh.hpp"
+#include "Utility.hpp"
+#include "FlatTable.hpp"
+#include "MeshCache.hpp"
+#include "Parallel.hpp"
+#include "ObjParser.hpp"
+#include "Stopwatch.hpp"
+#include "Structures.hpp"
+#include "UploadPlanner.hpp"
+#include "TrianglePacket.hpp"
+#include "Mathematics.hpp"
+#include "VertexCache.hpp"
+#include "VertexIndex.hpp"
+#include "VertexFormat.hpp"
+
+
+using namespace SkinCut;
+using namespace SkinCut::Math;
+
+
+
+namespace
+{
+	constexpr uint32_t cNumRuns = 20;			// traversal repetitions per measurement
+	constexpr size_t cHeapOverhead = 16;		// approximate allocator bookkeeping per heap allocation
+	constexpr uint32_t cNumParses = 3;			// parsing repetitions per measurement
+	constexpr uint32_t cNumRays = 2000;			// rays per picking measurement (a tenth for the face scan)
+	constexpr uint32_t cNumKernelRays = 50;		// rays per triangle kernel measurement (each against all faces)
+	constexpr uint32_t cNumBatchRays = 100000;	// rays per batched picking measurement
+	constexpr uint32_t cBatchGrain = 64;		// rays per task of batched picking
+
+
+	// Topology layout without a topology store: one heap allocation per element.
+	struct HeapFace;
+
+	struct HeapNode
+	{
+		Vector3 p;
+	};
+
+	struct HeapEdge
+	{
+		std::array<HeapNode*, 2> n;
+		std::array<HeapFace*, 2> f;
+		std::array<std::pair<HeapNode*, uint32_t>, 2> p;
+	};
+
+	struct HeapFace
+	{
+		std::array<uint32_t, 3> v;
+		std::array<HeapNode*, 3> n;
+		std::array<HeapEdge*, 3> e;
+	};
+
+
+	// Face sweep as done by ray intersection (positions of all face corners).
+	template <class F, class P>
+	float SweepFaces(const std::vector<F*>& faces, P position)
+	{
+		Vector3 sum(0.0f);
+		for (auto f : faces) {
+			sum += position(f->n[0]) + position(f->n[1]) + position(f->n[2]);
+		}
+		return sum.x + sum.y + sum.z;
+	}
+
+	// Neighbor walk as done by cutline formation and face chaining (faces across each edge).
+	template <class F, class P>
+	float WalkNeighbors(const std::vector<F*>& faces, P position)
+	{
+		Vector3 sum(0.0f);
+		for (auto f : faces) {
+			for (auto e : f->e) {
+				auto nb = (e->f[0] == f) ? e->f[1] : e->f[0];
+				if (nb) sum += position(nb->n[0]) + position(nb->n[1]) + position(nb->n[2]);
+			}
+		}
+		return sum.x + sum.y + sum.z;
+	}
+
+
+	// Insert and look up all elements in a flat table and a node-based hash set.
+	template <class T, class H>
+	void MeasureTable(std::stringstream& ss, const std::string& name, const std::vector<T*>& view, const H& hash)
+	{
+		std::vector<T*> elements;
+		for (T* element : view) {
+			if (element) elements.push_back(element);
+		}
+
+		FlatTable<T, H> flat(hash);
+		std::unordered_set<T*, H, H> buckets(0, hash, hash);
+
+		size_t found = 0;
+		Stopwatch sw(CLOCK_QPC_US);
+
+		sw.Start("flat insert");
+		for (T* element : elements) flat.Insert(element);
+		sw.Stop("flat insert");
+
+		sw.Start("flat lookup");
+		for (T* element : elements) found += (flat.Find(element) != nullptr);
+		sw.Stop("flat lookup");
+
+		sw.Start("set insert");
+		for (T* element : elements) buckets.insert(element);
+		sw.Stop("set insert");
+
+		sw.Start("set lookup");
+		for (T* element : elements) found += (buckets.find(element) != buckets.end());
+		sw.Stop("set lookup");
+
+		// million operations per second
+		auto rate = [&](const std::string& id) { return elements.size() / std::max(1.0, double(sw.ElapsedTime(id))); };
+
+		auto stats = flat.Probes();
+		ss << "  " << name << ": " << stats.size << " elements, " << stats.capacity << " slots, ";
+		ss << "probe length mean " << stats.meanProbe << " max " << stats.maxProbe << std::endl;
+		ss << "    insert (M/s)  flat " << rate("flat insert") << "  unordered_set " << rate("set insert") << std::endl;
+		ss << "    lookup (M/s)  flat " << rate("flat lookup") << "  unordered_set " << rate("set lookup") << std::endl;
+		ss << "    memory (KB)   flat " << flat.Bytes() / 1024.0 << "  unordered_set (est.) ";
+		ss << (buckets.bucket_count() * sizeof(void*) + buckets.size() * (sizeof(void*) * 2 + sizeof(size_t))) / 1024.0;
+		ss << "  (found " << found << ")" << std::endl;
+	}
+
+
+	// Mesh binary as written before the mesh cache: element counts and elements, one at a time.
+	void SaveLegacy(const std::wstring& filename, const std::vector<uint32_t>& indexes, const std::vector<Vertex>& vertexes)
+	{
+		std::ofstream out(filename, std::ios::out | std::ios::binary);
+
+		uint32_t indexCount = static_cast<uint32_t>(indexes.size());
+		uint32_t vertexCount = static_cast<uint32_t>(vertexes.size());
+
+		out.write((char*)&indexCount, sizeof(uint32_t));
+		for (uint32_t i = 0; i < indexCount; ++i) {
+			out.write((char*)&indexes[i], sizeof(uint32_t));
+		}
+
+		out.write((char*)&vertexCount, sizeof(uint32_t));
+		for (uint32_t i = 0; i < vertexCount; ++i) {
+			out.write((char*)&vertexes[i], sizeof(Vertex));
+		}
+	}
+
+	void LoadLegacy(const std::wstring& filename, std::vector<uint32_t>& indexes, std::vector<Vertex>& vertexes)
+	{
+		std::ifstream in(filename, std::ios::in | std::ios::binary);
+
+		uint32_t indexCount = 0;
+		uint32_t vertexCount = 0;
+
+		in.read((char*)&indexCount, sizeof(uint32_t));
+		indexes.resize(indexCount);
+		for (uint32_t i = 0; i < indexCount; ++i) {
+			in.read((char*)&indexes[i], sizeof(uint32_t));
+		}
+
+		in.read((char*)&vertexCount, sizeof(uint32_t));
+		vertexes.resize(vertexCount);
+		for (uint32_t i = 0; i < vertexCount; ++i) {
+			in.read((char*)&vertexes[i], sizeof(Vertex));
+		}
+	}
+
+	// Load through the mesh cache as done by Mesh::LoadMesh.
+	bool LoadCache(const std::wstring& filename, std::vector<uint32_t>& indexes, std::vector<Vertex>& vertexes)
+	{
+		MeshCache cache;
+		const uint32_t* i;
+		const Vertex* v;
+		size_t ni, nv;
+
+		if (!cache.Open(filename) || !cache.Get(MeshCache::SECTION_INDEXES, i, ni) || !cache.Get(MeshCache::SECTION_VERTEXES, v, nv)) {
+			return false;
+		}
+
+		indexes.assign(i, i + ni);
+		vertexes.assign(v, v + nv);
+		return true;
+	}
+
+	// Mesh as OBJ text (one position/texcoord/normal per vertex), in the file conventions read by the parser.
+	std::string WriteObj(const std::vector<uint32_t>& indexes, const std::vector<Vertex>& vertexes)
+	{
+		std::stringstream ss;
+		ss << std::setprecision(9);
+
+		for (const Vertex& v : vertexes) ss << "v " << v.position.x << " " << v.position.z << " " << v.position.y << "\n";
+		for (const Vertex& v : vertexes) ss << "vt " << v.texcoord.x << " " << 1.f - v.texcoord.y << "\n";
+		for (const Vertex& v : vertexes) ss << "vn " << v.normal.x << " " << v.normal.z << " " << v.normal.y << "\n";
+
+		for (size_t i = 0; i + 2 < indexes.size(); i += 3) {
+			ss << "f";
+			for (size_t k : { i, i + 2, i + 1 }) {
+				uint32_t j = indexes[k] + 1;
+				ss << " " << j << "/" << j << "/" << j;
+			}
+			ss << "\n";
+		}
+		return ss.str();
+	}
+
+	// OBJ parsing as done before the OBJ parser: stream extraction and a node-based hash map.
+	size_t ParseLegacy(const std::string& text, std::vector<uint32_t>& indexes)
+	{
+		std::stringstream contents(text);
+		std::string word;
+		char space;
+
+		std::vector<Vector3> positions, normals;
+		std::vector<Vector2> texcoords;
+		std::unordered_map<Indexer, uint32_t, IndexerHash, IndexerHash> indexerMap;
+		indexes.clear();
+
+		while (contents >> word) {
+			if (word == "v" || word == "vn") {
+				float x, y, z;
+				contents >> x >> y >> z;
+				(word == "v" ? positions : normals).push_back(Vector3(x, z, y));
+			}
+			else if (word == "vt") {
+				float u, v;
+				contents >> u >> v;
+				texcoords.push_back(Vector2(u, 1.f-v));
+			}
+			else if (word == "f") {
+				Indexer face[3];
+				for (auto& indexer : face) {
+					contents >> indexer.pi >> space >> indexer.xi >> space >> indexer.ni;
+					indexer.pi--; indexer.xi--; indexer.ni--;
+				}
+				std::swap(face[1], face[2]);
+				for (auto& indexer : face) {
+					indexes.push_back(indexerMap.emplace(indexer, uint32_t(indexerMap.size())).first->second);
+				}
+			}
+			else {
+				contents.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+			}
+		}
+		return indexerMap.size();
+	}
+
+	// Rays from random points on a sphere around the mesh towards random points within its bounds.
+	std::vector<Ray> PickingRays(const Mesh& mesh, uint32_t count)
+	{
+		Vector3 lower(std::numeric_limits<float>::max()), upper(-std::numeric_limits<float>::max());
+		for (auto& vertex : mesh.mVertexes) {
+			Vector3::Min(lower, vertex.position, lower);
+			Vector3::Max(upper, vertex.position, upper);
+		}
+		Vector3 center = (lower + upper) * 0.5f;
+		float radius = (upper - lower).Length();
+
+		std::mt19937 random(1);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		std::normal_distribution<float> normal;
+
+		std::vector<Ray> rays(count);
+		for (auto& ray : rays) {
+			Vector3 target = lower + (upper - lower) * Vector3(unit(random), unit(random), unit(random));
+			Vector3 offset = Vector3(normal(random), normal(random), normal(random));
+			offset.Normalize();
+			ray.origin = center + offset * radius;
+			ray.direction = target - ray.origin;
+			ray.direction.Normalize();
+		}
+		return rays;
+	}
+}
+
+
+
+void Benchmark::TopologyLayout(Mesh& mesh)
+{
+	mesh.Compact(); // traversals below expect views without killed elements
+
+	// Replicate the topology with individually allocated elements.
+	std::vector<HeapNode*> nodes(mesh.mNodePool.Capacity(), nullptr);
+	std::vector<HeapEdge*> edges(mesh.mEdgePool.Capacity(), nullptr);
+	std::vector<HeapFace*> faces(mesh.mFacePool.Capacity(), nullptr);
+
+	for (auto n : mesh.mNodeArray) {
+		nodes[n->id] = new HeapNode{ mesh.Position(n) };
+	}
+	for (auto e : mesh.mEdgeArray) {
+		edges[e->id] = new HeapEdge;
+	}
+	for (auto f : mesh.mFaceArray) {
+		faces[f->id] = new HeapFace;
+	}
+
+	auto node = [&](Node* n) { return n ? nodes[n->id] : nullptr; };
+	auto face = [&](Face* f) { return f ? faces[f->id] : nullptr; };
+
+	for (auto e : mesh.mEdgeArray) {
+		HeapEdge* edge = edges[e->id];
+		edge->n = { node(e->n[0]), node(e->n[1]) };
+		edge->f = { face(e->f[0]), face(e->f[1]) };
+		edge->p[0] = std::make_pair(node(e->p[0].first), e->p[0].second);
+		edge->p[1] = std::make_pair(node(e->p[1].first), e->p[1].second);
+	}
+
+	std::vector<HeapFace*> faceArray;
+	faceArray.reserve(mesh.mFaceArray.size());
+	for (auto f : mesh.mFaceArray) {
+		HeapFace* hf = faces[f->id];
+		hf->v = f->v;
+		hf->n = { node(f->n[0]), node(f->n[1]), node(f->n[2]) };
+		hf->e = { edges[f->e[0]->id], edges[f->e[1]->id], edges[f->e[2]->id] };
+		faceArray.push_back(hf);
+	}
+
+
+	// Memory footprint (excluding the pointer arrays, which both layouts share).
+	size_t storeBytes = mesh.mNodePool.Bytes() + mesh.mEdgePool.Bytes() + mesh.mFacePool.Bytes() + mesh.mPositions.capacity() * sizeof(Vector3);
+	size_t heapBytes = mesh.mNodeArray.size() * (sizeof(HeapNode) + cHeapOverhead) +
+	                   mesh.mEdgeArray.size() * (sizeof(HeapEdge) + cHeapOverhead) +
+	                   mesh.mFaceArray.size() * (sizeof(HeapFace) + cHeapOverhead);
+
+
+	// Traversal timings
+	auto storePosition = [&](Node* n) { return mesh.Position(n); };
+	auto heapPosition = [](HeapNode* n) { return n->p; };
+
+	float checksum = 0.0f;
+	Stopwatch sw(CLOCK_QPC_US);
+
+	sw.Start("store sweep");
+	for (uint32_t i = 0; i < cNumRuns; ++i) checksum += SweepFaces(mesh.mFaceArray, storePosition);
+	sw.Stop("store sweep");
+
+	sw.Start("heap sweep");
+	for (uint32_t i = 0; i < cNumRuns; ++i) checksum -= SweepFaces(faceArray, heapPosition);
+	sw.Stop("heap sweep");
+
+	sw.Start("store walk");
+	for (uint32_t i = 0; i < cNumRuns; ++i) checksum += WalkNeighbors(mesh.mFaceArray, storePosition);
+	sw.Stop("store walk");
+
+	sw.Start("heap walk");
+	for (uint32_t i = 0; i < cNumRuns; ++i) checksum -= WalkNeighbors(faceArray, heapPosition);
+	sw.Stop("heap walk");
+
+
+	std::stringstream ss;
+	ss << std::fixed << std::setprecision(1);
+	ss << "Topology layout: " << mesh.mNodeArray.size() << " nodes, " << mesh.mEdgeArray.size() << " edges, " << mesh.mFaceArray.size() << " faces" << std::endl;
+	ss << "  memory (KB)        store " << storeBytes / 1024.0 << "  heap " << heapBytes / 1024.0 << std::endl;
+	ss << "  face sweep (us)    store " << sw.ElapsedTime("store sweep") / double(cNumRuns) << "  heap " << sw.ElapsedTime("heap sweep") / double(cNumRuns) << std::endl;
+	ss << "  neighbor walk (us) store " << sw.ElapsedTime("store walk") / double(cNumRuns) << "  heap " << sw.ElapsedTime("heap walk") / double(cNumRuns) << std::endl;
+	ss << "  checksum " << checksum;
+	Utility::ConsoleMessage(ss.str());
+
+
+	for (auto n : nodes) delete n;
+	for (auto e : edges) delete e;
+	for (auto f : faces) delete f;
+}
+
+
+void Benchmark::TopologyTables(Mesh& mesh)
+{
+	std::stringstream ss;
+	ss << std::fixed << std::setprecision(2);
+	ss << "Topology tables:" << std::endl;
+
+	// probe lengths of the tables maintained by the mesh
+	auto node = mesh.mNodeTable.Probes();
+	auto edge = mesh.mEdgeTable.Probes();
+	auto face = mesh.mFaceTable.Probes();
+	ss << "  mesh probe length mean/max  node " << node.meanProbe << "/" << node.maxProbe;
+	ss << "  edge " << edge.meanProbe << "/" << edge.maxProbe;
+	ss << "  face " << face.meanProbe << "/" << face.maxProbe << std::endl;
+
+	MeasureTable(ss, "nodes", mesh.mNodeArray, NodeHash(&mesh.mPositions));
+	MeasureTable(ss, "edges", mesh.mEdgeArray, EdgeHash());
+	MeasureTable(ss, "faces", mesh.mFaceArray, FaceHash());
+
+	Utility::ConsoleMessage(ss.str());
+}
+
+
+void Benchmark::VertexDedup(Mesh& mesh)
+{
+	const std::vector<Vertex>& vertexes = mesh.mVertexes;
+	uint32_t count = static_cast<uint32_t>(vertexes.size());
+
+	VertexIndex index(&vertexes);
+	std::unordered_map<Vertex, uint32_t, VertexHash, VertexHash> table;
+
+	size_t found = 0;
+	Stopwatch sw(CLOCK_QPC_US);
+
+	// index every vertex of the mesh, then look each of them up again
+	sw.Start("index insert");
+	for (uint32_t i = 0; i < count; ++i) index.Insert(vertexes[i], i);
+	sw.Stop("index insert");
+
+	sw.Start("index lookup");
+	for (uint32_t i = 0; i < count; ++i) found += !index.Insert(vertexes[i], count).second;
+	sw.Stop("index lookup");
+
+	sw.Start("map insert");
+	for (uint32_t i = 0; i < count; ++i) table.emplace(vertexes[i], i);
+	sw.Stop("map insert");
+
+	sw.Start("map lookup");
+	for (uint32_t i = 0; i < count; ++i) found += !table.emplace(vertexes[i], count).second;
+	sw.Stop("map lookup");
+
+	size_t mapBytes = table.bucket_count() * sizeof(void*) * 2 + 
+	                  table.size() * (sizeof(std::pair<const Vertex, uint32_t>) + sizeof(void*) * 2 + cHeapOverhead);
+
+	auto latency = [&](const std::string& id) { return 1000.0 * sw.ElapsedTime(id) / std::max(1u, count); };
+
+	std::stringstream ss;
+	ss << std::fixed << std::setprecision(1);
+	ss << "Vertex deduplication: " << count << " vertexes (" << index.Size() << " unique)" << std::endl;
+	ss << "  memory (KB)   index " << index.Bytes() / 1024.0 << "  unordered_map (est.) " << mapBytes / 1024.0 << std::endl;
+	ss << "  insert (ns)   index " << latency("index insert") << "  unordered_map " << latency("map insert") << std::endl;
+	ss << "  lookup (ns)   index " << latency("index lookup") << "  unordered_map " << latency("map lookup") << std::endl;
+	ss << "  (found " << found << ")";
+	Utility::ConsoleMessage(ss.str());
+}
+
+
+void Benchmark::VertexPacking(Mesh& mesh)
+{
+	const std::vector<Vertex>& vertexes = mesh.mVertexes;
+	std::vector<PackedVertex> packed;
+
+	Stopwatch sw(CLOCK_QPC_US);
+
+	sw.Start("pack");
+	for (uint32_t i = 0; i < cNumRuns; ++i) VertexFormat::Pack(vertexes, packed);
+	sw.Stop("pack");
+
+	// largest deviations after a round trip
+	float maxNormal = 0.0f, maxTangent = 0.0f, maxTexcoord = 0.0f;
+	uint32_t flipped = 0;
+
+	for (size_t i = 0; i < vertexes.size(); ++i) {
+		const Vertex& v = vertexes[i];
+		Vertex u;
+		VertexFormat::Unpack(packed[i], u);
+
+		Vector3 n = Vector3::Normalize(v.normal);
+		Vector3 t = Vector3((const float*)v.tangent);
+		t = Vector3::Normalize(t - n * n.Dot(t)); // the packed frame is orthonormal
+
+		maxNormal = std::max(maxNormal, std::acos(Clamp(n.Dot(u.normal), -1.0f, 1.0f)));
+		maxTangent = std::max(maxTangent, std::acos(Clamp(t.Dot(Vector3((const float*)u.tangent)), -1.0f, 1.0f)));
+		maxTexcoord = std::max(maxTexcoord, std::max(std::abs(v.texcoord.x - u.texcoord.x), std::abs(v.texcoord.y - u.texcoord.y)));
+		flipped += ((v.tangent.w < 0.0f) != (u.tangent.w < 0.0f));
+	}
+
+	size_t fullBytes = vertexes.size() * sizeof(Vertex);
+	size_t packedBytes = packed.size() * sizeof(PackedVertex);
+
+	std::stringstream ss;
+	ss << std::fixed << std::setprecision(1);
+	ss << "Vertex packing: " << vertexes.size() << " vertexes, " << sizeof(Vertex) << " -> " << sizeof(PackedVertex) << " bytes each" << std::endl;
+	ss << "  memory (KB)   full " << fullBytes / 1024.0 << "  packed " << packedBytes / 1024.0 << "  saved " << (fullBytes - packedBytes) / 1024.0 << std::endl;
+	ss << "  pack (us)     " << sw.ElapsedTime("pack") / double(cNumRuns) << std::endl;
+	ss << std::setprecision(4);
+	ss << "  max error     normal " << maxNormal * float(180.0 / cPI) << " deg  tangent " << maxTangent * float(180.0 / cPI) << " deg  texcoord " << maxTexcoord;
+	ss << "  (handedness flips " << flipped << ")";
+	Utility::ConsoleMessage(ss.str());
+}
+
+
+void Benchmark::CacheLoading(Mesh& mesh)
+{
+	const std::wstring legacyName = L"Benchmark.legacy.bin";
+	const std::wstring cacheName = L"Benchmark.cache.bin";
+
+	SaveLegacy(legacyName, mesh.mIndexes, mesh.mVertexes);
+	mesh.SaveMesh(cacheName);
+
+	std::vector<uint32_t> legacyIndexes, cacheIndexes;
+	std::vector<Vertex> legacyVertexes, cacheVertexes;
+	bool loaded = true;
+
+	// both files were just written, so these are warm (file cache) loads
+	Stopwatch sw(CLOCK_QPC_US);
+
+	sw.Start("legacy");
+	for (uint32_t i = 0; i < cNumRuns; ++i) LoadLegacy(legacyName, legacyIndexes, legacyVertexes);
+	sw.Stop("legacy");
+
+	sw.Start("cache");
+	for (uint32_t i = 0; i < cNumRuns; ++i) loaded &= LoadCache(cacheName, cacheIndexes, cacheVertexes);
+	sw.Stop("cache");
+
+	bool equal = loaded && legacyIndexes == cacheIndexes && legacyVertexes.size() == cacheVertexes.size() &&
+	             std::equal(legacyVertexes.begin(), legacyVertexes.end(), cacheVertexes.begin(), VertexHash());
+
+	DeleteFile(legacyName.c_str());
+	DeleteFile(cacheName.c_str());
+
+	size_t bytes = mesh.mIndexes.size() * sizeof(uint32_t) + mesh.mVertexes.size() * sizeof(Vertex);
+
+	std::stringstream ss;
+	ss << std::fixed << std::setprecision(1);
+	ss << "Cache loading: " << mesh.mIndexes.size() << " indexes, " << mesh.mVertexes.size() << " vertexes (" << bytes / 1024.0 << " KB)" << std::endl;
+	ss << "  load (us)     per-element reads " << sw.ElapsedTime("legacy") / double(cNumRuns) << "  mapped cache " << sw.ElapsedTime("cache") / double(cNumRuns) << std::endl;
+	ss << "  contents " << (equal ? "identical" : "DIFFERENT");
+	Utility::ConsoleMessage(ss.str());
+}
+
+
+void Benchmark::ObjParsing(Mesh& mesh)
+{
+	std::string text = WriteObj(mesh.mIndexes, mesh.mVertexes);
+
+	std::vector<uint32_t> legacyIndexes;
+	size_t legacyVertexes = 0;
+	ObjData serial, parallel;
+
+	Stopwatch sw(CLOCK_QPC_US);
+
+	sw.Start("legacy");
+	for (uint32_t i = 0; i < cNumParses; ++i) legacyVertexes = ParseLegacy(text, legacyIndexes);
+	sw.Stop("legacy");
+
+	uint32_t threads = Parallel::Threads();
+	Parallel::SetThreads(1);
+	sw.Start("serial");
+	for (uint32_t i = 0; i < cNumParses; ++i) ObjParser::Parse(text.data(), text.size(), serial);
+	sw.Stop("serial");
+	Parallel::SetThreads(threads);
+
+	sw.Start("parallel");
+	for (uint32_t i = 0; i < cNumParses; ++i) ObjParser::Parse(text.data(), text.size(), parallel);
+	sw.Stop("parallel");
+
+	bool equal = legacyIndexes == serial.indexes && legacyVertexes == serial.vertexes.size() &&
+	             serial.indexes == parallel.indexes && serial.positions == parallel.positions;
+
+	// megabytes per second from the average time per parse (in microseconds)
+	auto Rate = [&](const std::string& name) { return text.size() / (sw.ElapsedTime(name) / double(cNumParses)); };
+
+	std::stringstream ss;
+	ss << std::fixed << std::setprecision(1);
+	ss << "OBJ parsing: " << text.size() / 1e6 << " MB, " << serial.vertexes.size() << " vertexes, " << serial.indexes.size() / 3 << " triangles" << std::endl;
+	ss << "  rate (MB/s)   stream " << Rate("legacy") << "  parser " << Rate("serial") << "  parser x" << threads << " " << Rate("parallel") << std::endl;
+	ss << "  result " << (equal ? "identical" : "DIFFERENT");
+	Utility::ConsoleMessage(ss.str());
+}
+
+
+void Benchmark::VertexOrdering(Mesh& mesh)
+{
+	// triangles of the index buffer without the degenerate ones of killed faces
+	std::vector<uint32_t> current;
+	for (size_t i = 0; i < mesh.mIndexes.size(); i += 3) {
+		const uint32_t* t = &mesh.mIndexes[i];
+		if (t[0] == t[1] && t[1] == t[2]) continue;
+		current.insert(current.end(), t, t + 3);
+	}
+
+	std::vector<uint32_t> optimized = current;
+	std::vector<Vertex> vertexes = mesh.mVertexes;
+
+	Stopwatch sw(CLOCK_QPC_US);
+
+	sw.Start("triangles");
+	VertexCache::OptimizeTriangles(optimized, vertexes.size());
+	sw.Stop("triangles");
+
+	sw.Start("fetch");
+	VertexCache::OptimizeFetch(optimized, vertexes);
+	sw.Stop("fetch");
+
+	VertexCache::Statistics before = VertexCache::Analyze(current, mesh.mVertexes.size());
+	VertexCache::Statistics after = VertexCache::Analyze(optimized, vertexes.size());
+
+	std::stringstream ss;
+	ss << std::fixed << std::setprecision(3);
+	ss << "Vertex cache: " << current.size() / 3 << " triangles, " << vertexes.size() << " vertexes (" << VertexCache::cFifoSize << "-entry FIFO)" << std::endl;
+	ss << "  ACMR          current " << before.acmr << "  reordered " << after.acmr << std::endl;
+	ss << "  ATVR          current " << before.atvr << "  reordered " << after.atvr << std::endl;
+	ss << std::setprecision(1);
+	ss << "  reorder (ms)  triangles " << sw.ElapsedTime("triangles") / 1000.0 << "  vertexes " << sw.ElapsedTime("fetch") / 1000.0;
+	Utility::ConsoleMessage(ss.str());
+}
+
+
+void Benchmark::RayPicking(Mesh& mesh)
+{
+	std::vector<Ray> rays = PickingRays(mesh, cNumRays);
+
+	// Closest intersection distance of a ray with a face (max if it misses the face or hits behind the origin).
+	auto Distance = [&](Ray& ray, const Face* face) {
+		const Vector3& v0 = mesh.mVertexes[face->v[0]].position;
+		const Vector3& v1 = mesh.mVertexes[face->v[1]].position;
+		const Vector3& v2 = mesh.mVertexes[face->v[2]].position;
+
+		float t, u, v;
+		if (!Math::RayTriangleIntersection(ray, Triangle(v0, v1, v2), t, u, v) || t < 0) {
+			return std::numeric_limits<float>::max();
+		}
+		return t;
+	};
+
+	std::stringstream ss;
+	ss << std::fixed << std::setprecision(1);
+	ss << "Ray picking: " << rays.size() << " closest-hit rays (" << rays.size() / 10 << " for the scan)" << std::endl;
+	ss << "  faces      build (ms)  hierarchy (rays/s)  scan (rays/s)  speedup  hits  mismatches" << std::endl;
+
+	// the faces of the first eighth, quarter, half and all of the face view
+	FaceBvh bvh(mesh);
+	const uint32_t slots = static_cast<uint32_t>(mesh.mFaceArray.size());
+
+	for (uint32_t fraction = 8; fraction >= 1; fraction /= 2) {
+		const uint32_t slotCount = slots / fraction;
+		Stopwatch sw(CLOCK_QPC_US);
+
+		sw.Start("build");
+		bvh.Build(slotCount);
+		sw.Stop("build");
+
+		std::vector<float> hierarchy(rays.size(), std::numeric_limits<float>::max());
+		sw.Start("hierarchy");
+		for (size_t i = 0; i < rays.size(); ++i) {
+			FaceBvh::Hit hit;
+			if (bvh.Closest(rays[i], hit)) hierarchy[i] = hit.t;
+		}
+		sw.Stop("hierarchy");
+
+		std::vector<float> scan(rays.size() / 10, std::numeric_limits<float>::max());
+		sw.Start("scan");
+		for (size_t i = 0; i < scan.size(); ++i) {
+			for (uint32_t slot = 0; slot < slotCount; ++slot) {
+				if (mesh.mFaceArray[slot]) scan[i] = std::min(scan[i], Distance(rays[i], mesh.mFaceArray[slot]));
+			}
+		}
+		sw.Stop("scan");
+
+		uint32_t faces = 0, hits = 0, mismatches = 0;
+		for (uint32_t slot = 0; slot < slotCount; ++slot) {
+			if (mesh.mFaceArray[slot]) faces++;
+		}
+		for (size_t i = 0; i < rays.size(); ++i) {
+			if (hierarchy[i] < std::numeric_limits<float>::max()) hits++;
+			if (i < scan.size() && scan[i] != hierarchy[i]) mismatches++;
+		}
+
+		// rays per second from the total time (in microseconds)
+		double hierarchyRate = hierarchy.size() / (sw.ElapsedTime("hierarchy") * 1e-6);
+		double scanRate = scan.size() / (sw.ElapsedTime("scan") * 1e-6);
+
+		ss << "  " << std::setw(9) << faces << "  " << std::setw(10) << sw.ElapsedTime("build") / 1000.0;
+		ss << "  " << std::setw(18) << hierarchyRate << "  " << std::setw(13) << scanRate << "  " << std::setw(7) << hierarchyRate / scanRate;
+		ss << "  " << std::setw(4) << hits << "  " << mismatches;
+		if (fraction > 1) ss << std::endl;
+	}
+
+	Utility::ConsoleMessage(ss.str());
+}
+
+
+void Benchmark::TriangleKernel(Mesh& mesh)
+{
+	std::vector<Triangle> triangles;
+	for (Face* face : mesh.mFaceArray) {
+		if (!face) continue;
+		triangles.push_back(Triangle(mesh.mVertexes[face->v[0]].position, mesh.mVertexes[face->v[1]].position, mesh.mVertexes[face->v[2]].position));
+	}
+
+	std::vector<TrianglePacket> packets;
+	TrianglePackets::Pack(triangles, packets);
+
+	// Rays from random points around the mesh through random vertexes: the corners shared by
+	// faces are where hit decisions are most sensitive to rounding.
+	std::mt19937 random(2);
+	std::uniform_int_distribution<size_t> pick(0, mesh.mVertexes.size() - 1);
+	std::normal_distribution<float> normal;
+
+	std::vector<Ray> rays(cNumKernelRays);
+	for (auto& ray : rays) {
+		Vector3 target = mesh.mVertexes[pick(random)].position;
+		ray.origin = target + Vector3(normal(random), normal(random), normal(random));
+		ray.direction = target - ray.origin;
+	}
+
+	Stopwatch sw(CLOCK_QPC_US);
+	uint64_t scalarHits = 0, packetHits = 0;
+
+	sw.Start("scalar");
+	for (auto& ray : rays) {
+		for (auto& triangle : triangles) {
+			float t, u, v;
+			if (Math::RayTriangleIntersection(ray, triangle, t, u, v)) scalarHits++;
+		}
+	}
+	sw.Stop("scalar");
+
+	sw.Start("packet");
+	for (auto& ray : rays) {
+		for (auto& packet : packets) {
+			float t[TrianglePackets::cLanes], u[TrianglePackets::cLanes], v[TrianglePackets::cLanes];
+			uint32_t hits = TrianglePackets::Intersect(ray, packet, t, u, v);
+			for (; hits; hits &= hits - 1) packetHits++;
+		}
+	}
+	sw.Stop("packet");
+
+	// decisions (and results of hits) that differ from the scalar test
+	uint64_t mismatches = 0;
+	for (auto& ray : rays) {
+		for (size_t k = 0; k < packets.size(); ++k) {
+			float t[TrianglePackets::cLanes], u[TrianglePackets::cLanes], v[TrianglePackets::cLanes];
+			uint32_t hits = TrianglePackets::Intersect(ray, packets[k], t, u, v);
+
+			for (uint32_t lane = 0; lane < TrianglePackets::cLanes && k * TrianglePackets::cLanes + lane < triangles.size(); ++lane) {
+				float ts, us, vs;
+				bool scalar = Math::RayTriangleIntersection(ray, triangles[k * TrianglePackets::cLanes + lane], ts, us, vs);
+				bool packet = (hits >> lane) & 1;
+				if (scalar != packet || (scalar && (ts != t[lane] || us != u[lane] || vs != v[lane]))) mismatches++;
+			}
+		}
+	}
+
+	// millions of ray-triangle tests per second from the total time (in microseconds)
+	double tests = double(rays.size()) * triangles.size();
+	auto Rate = [&](const std::string& name) { return tests / sw.ElapsedTime(name); };
+
+	std::stringstream ss;
+	ss << std::fixed << std::setprecision(1);
+	ss << "Triangle kernel: " << rays.size() << " rays x " << triangles.size() << " triangles (" << TrianglePackets::cLanes << " lanes per packet)" << std::endl;
+	ss << "  rate (M tests/s)  scalar " << Rate("scalar") << "  packet " << Rate("packet") << "  speedup " << Rate("packet") / Rate("scalar") << std::endl;
+	ss << "  hits " << scalarHits << " / " << packetHits << "  mismatches " << mismatches;
+	Utility::ConsoleMessage(ss.str());
+}
+
+
+void Benchmark::BatchPicking(Mesh& mesh)
+{
+	std::vector<Ray> rays = PickingRays(mesh, cNumBatchRays);
+	mesh.UpdateBvh(); // (queries only read the face hierarchy from here on)
+
+	// closest hits of all rays on the given number of threads (the faces and distances found)
+	auto Trace = [&](uint32_t threads, std::vector<Face*>& faces, std::vector<float>& distances) {
+		faces.assign(rays.size(), nullptr);
+		distances.assign(rays.size(), std::numeric_limits<float>::max());
+
+		uint32_t previous = Parallel::Threads();
+		Parallel::SetThreads(threads);
+		Parallel::For(Parallel::Tasks(rays.size(), cBatchGrain), [&](uint32_t t) {
+			size_t end = std::min(rays.size(), size_t(t + 1) * cBatchGrain);
+			for (size_t i = size_t(t) * cBatchGrain; i < end; ++i) {
+				Intersection ix;
+				if (!mesh.ClosestIntersection(rays[i], ix)) continue;
+				faces[i] = ix.face;
+				distances[i] = ix.dist;
+			}
+		});
+		Parallel::SetThreads(previous);
+	};
+
+	std::vector<Face*> serialFaces, faces;
+	std::vector<float> serialDistances, distances;
+
+	std::stringstream ss;
+	ss << std::fixed << std::setprecision(1);
+	ss << "Batched picking: " << rays.size() << " closest-hit rays, " << cBatchGrain << " per task" << std::endl;
+	ss << "  threads  rays/s  speedup  mismatches" << std::endl;
+
+	double serialTime = 0.0;
+	for (uint32_t threads = 1; ; threads = std::min(threads * 2, Parallel::Threads())) {
+		Stopwatch sw(CLOCK_QPC_US);
+		sw.Start("trace");
+		Trace(threads, faces, distances);
+		sw.Stop("trace");
+
+		double time = double(sw.ElapsedTime("trace"));
+		if (threads == 1) {
+			serialTime = time;
+			serialFaces = faces;
+			serialDistances = distances;
+		}
+
+		uint32_t mismatches = 0;
+		for (size_t i = 0; i < rays.size(); ++i) {
+			if (faces[i] != serialFaces[i] || distances[i] != serialDistances[i]) mismatches++;
+		}
+
+		ss << "  " << std::setw(7) << threads << "  " << std::setw(6) << std::setprecision(0) << rays.size() / (time / 1e6)
+		   << "  " << std::setw(7) << std::setprecision(1) << serialTime / time << "  " << std::setw(10) << mismatches;
+		if (threads == Parallel::Threads()) break;
+		ss << std::endl;
+	}
+	Utility::ConsoleMessage(ss.str());
+}
+
+
+void Benchmark::UploadPlanning(Mesh& mesh)
+{
+	typedef MockBuffer::Call Call;
+
+	// The vertexes of the mesh as the buffer data; changes flip bytes, so stale contents show up.
+	const uint32_t stride = sizeof(Vertex);
+	const uint32_t count = static_cast<uint32_t>(mesh.mVertexes.size());
+	const uint32_t apart = UploadPlanner::cMergeGap / stride + 2; // vertexes between changes that are written separately
+
+	std::stringstream ss;
+	ss << "Upload planning: " << count << " vertexes of " << stride << " bytes (merge gap " << UploadPlanner::cMergeGap << " bytes, headroom " << UploadPlanner::cHeadroom << "%)";
+	if (count < 8 * apart) {
+		ss << std::endl << "  skipped (too few vertexes)";
+		Utility::ConsoleMessage(ss.str());
+		return;
+	}
+
+	std::vector<uint8_t> data(count * stride);
+	std::memcpy(data.data(), mesh.mVertexes.data(), data.size());
+	auto Change = [&](uint32_t vertex, uint32_t vertexes) -> ByteRange {
+		for (uint32_t i = vertex * stride; i < (vertex + vertexes) * stride; ++i) data[i] ^= 0xFF;
+		return { vertex * stride, vertexes * stride };
+	};
+
+	MockBuffer* mock = new MockBuffer(); // (owned by the planner)
+	UploadPlanner planner((std::unique_ptr<UploadTarget>(mock)));
+	uint32_t failures = 0;
+
+	// compares the calls the last upload made (and the buffer contents) with the expected ones
+	auto Check = [&](const std::string& name, const std::vector<Call>& expected) {
+		bool calls = (mock->mCalls == expected);
+		bool contents = mock->mContents.size() >= data.size() && std::equal(data.begin(), data.end(), mock->mContents.begin());
+		uint64_t bytes = 0;
+		for (const Call& call : mock->mCalls) bytes += call.allocate ? 0 : call.size;
+
+		ss << std::endl << "  " << std::left << std::setw(22) << name << std::right << std::setw(2) << mock->mCalls.size() << " calls "
+		   << std::setw(10) << bytes << " bytes  " << (calls && contents ? "ok" : calls ? "wrong contents" : "unexpected calls");
+		failures += !(calls && contents);
+		mock->mCalls.clear();
+	};
+
+	// all data: allocation with headroom, then a single write that discards the old contents
+	uint32_t size = static_cast<uint32_t>(data.size());
+	planner.Upload(data.data(), size);
+	uint32_t capacity = planner.Capacity();
+	Check("initial upload", { { true, 0, capacity, false }, { false, 0, size, true } });
+
+	// vertexes far apart (given out of order, with a range past the end): one write each, in order
+	std::vector<ByteRange> changed;
+	std::vector<Call> expected;
+	for (uint32_t i = 0; i < 4; ++i) {
+		ByteRange range = Change(count / 4 * i + 1, 1);
+		changed.insert(changed.begin(), range);
+		expected.push_back({ false, range.offset, range.size, false });
+	}
+	changed.push_back({ size + stride, stride });
+	planner.Upload(data.data(), size, changed);
+	Check("scattered vertexes", expected);
+
+	// nearby and overlapping ranges: written at once, including the bytes between them
+	ByteRange first = Change(apart, 1), second = Change(apart + 2, 2);
+	ByteRange overlap = { second.offset + stride, 2 * stride };
+	Change(apart + 4, 1); // (inside overlap)
+	planner.Upload(data.data(), size, { overlap, second, first });
+	Check("nearby ranges", { { false, first.offset, overlap.offset + overlap.size - first.offset, false } });
+
+	// appended vertexes within the headroom: only the new data, keeping the rest
+	uint32_t appended = std::min(count / 8, (capacity - size) / stride);
+	data.resize(data.size() + appended * stride);
+	std::memcpy(data.data() + size, mesh.mVertexes.data(), appended * stride);
+	planner.Upload(data.data(), size + appended * stride, { { size, appended * stride } });
+	Check("appended vertexes", { { false, size, appended * stride, false } });
+	size += appended * stride;
+
+	// everything changed: a single write that may discard the old contents
+	Change(0, size / stride);
+	planner.Upload(data.data(), size, { { 0, size } });
+	Check("all vertexes", { { false, 0, size, true } });
+
+	// growth beyond the capacity: reallocation, which loses the contents, so everything is written
+	uint32_t grown = (capacity - size) / stride + 1;
+	data.resize(data.size() + grown * stride);
+	std::memcpy(data.data() + size, mesh.mVertexes.data(), grown * stride);
+	planner.Upload(data.data(), size + grown * stride, { { size, grown * stride } });
+	size += grown * stride;
+	Check("growth past capacity", { { true, 0, planner.Capacity(), false }, { false, 0, size, true } });
+
+	const UploadStats& stats = planner.Stats();
+	ss << std::endl << "  total " << stats.writes << " writes, " << stats.bytes << " bytes, " << stats.allocations << " allocations, " << failures << " failures";
+	Utility::ConsoleMessage(ss.str());
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+
+
+
+namespace SkinCut
+{
+	class Mesh;
+
+
+	// Micro-benchmarks for the mesh data structures; results are written to the console.
+	namespace Benchmark
+	{
+		void TopologyLayout(Mesh& mesh); // topology store vs. individually heap-allocated elements
+		void TopologyTables(Mesh& mesh); // flat topology hash tables vs. node-based hash sets
+		void VertexDedup(Mesh& mesh); // vertex deduplication index vs. vertex-keyed hash map
+		void VertexPacking(Mesh& mesh); // compressed render vertexes: memory saved, packing time and precision
+		void CacheLoading(Mesh& mesh); // mapped mesh cache vs. per-element stream reads
+		void ObjParsing(Mesh& mesh); // OBJ parser (one thread and all threads) vs. stream extraction, in MB/s
+		void VertexOrdering(Mesh& mesh); // vertex cache statistics (ACMR/ATVR) of the current face order vs. a reordered one
+		void RayPicking(Mesh& mesh); // closest-hit rays per second of the face hierarchy vs. a scan of all faces, by mesh size
+		void TriangleKernel(Mesh& mesh); // ray-triangle tests per second of triangle packets vs. the scalar test, and their agreement
+		void BatchPicking(Mesh& mesh); // closest-hit rays per second of concurrent queries on the face hierarchy, by thread count
+		void UploadPlanning(Mesh& mesh); // buffer writes planned for typical edits of the vertexes, checked against a mock buffer
+	}
+}
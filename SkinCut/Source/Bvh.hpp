@@ -0,0 +1,106 @@
+#pragma once
+
+#include <limits>
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <algorithm>
+
+#include "Mathematics.hpp"
+
+
+
+namespace SkinCut
+{
+	// Helpers shared by the bounding volume hierarchies (FaceBvh, SceneBvh) and the spatial
+	// partition of MeshChunks: axis-aligned bounds, slab tests and nearest-first traversal.
+	namespace Bvh
+	{
+		static const uint32_t cNone = 0xFFFFFFFF; // no node (children of leaves)
+		static const float cSlack = 1.0f + 4.0f * std::numeric_limits<float>::epsilon(); // relative enlargement of distances compared to node bounds (for rounding)
+
+		inline float Component(const Math::Vector3& v, uint32_t axis)
+		{
+			return (axis == 0) ? v.x : (axis == 1) ? v.y : v.z;
+		}
+
+		// Enlarge bounds to hold other bounds, or a point.
+		inline void Grow(Math::Vector3& lower, Math::Vector3& upper, const Math::Vector3& pointLower, const Math::Vector3& pointUpper)
+		{
+			lower.x = std::min(lower.x, pointLower.x);
+			lower.y = std::min(lower.y, pointLower.y);
+			lower.z = std::min(lower.z, pointLower.z);
+			upper.x = std::max(upper.x, pointUpper.x);
+			upper.y = std::max(upper.y, pointUpper.y);
+			upper.z = std::max(upper.z, pointUpper.z);
+		}
+
+		inline void Grow(Math::Vector3& lower, Math::Vector3& upper, const Math::Vector3& point)
+		{
+			Grow(lower, upper, point, point);
+		}
+
+		// Distance at which a ray (with inverse = 1 / direction) enters the bounds, or infinity if it
+		// misses them within tmax. Exit distances are enlarged by a few ulps, so rounding does not
+		// let rays through the bounds of (flat) faces they hit. NaNs (ray in a slab plane) are ignored.
+		inline float Entry(const Math::Vector3& lower, const Math::Vector3& upper, const Math::Vector3& origin, const Math::Vector3& inverse, float tmax)
+		{
+			float tnear = 0.0f, tfar = tmax * cSlack;
+
+			for (uint32_t axis = 0; axis < 3; ++axis) {
+				float t0 = (Component(lower, axis) - Component(origin, axis)) * Component(inverse, axis);
+				float t1 = (Component(upper, axis) - Component(origin, axis)) * Component(inverse, axis);
+				if (t0 > t1) std::swap(t0, t1);
+
+				if (t0 > tnear) tnear = t0;
+				if (t1 * cSlack < tfar) tfar = t1 * cSlack;
+			}
+
+			return (tnear <= tfar) ? tnear : std::numeric_limits<float>::infinity();
+		}
+
+		// Visits the leaves of a hierarchy whose bounds the ray enters within [0, tmax), nearest
+		// first. Nodes have lower and upper bounds and two children (cNone for leaves).
+		// visit(leaf, tmax) returns true to end the traversal, and may lower tmax (e.g. to the
+		// distance of a hit), after which nodes entered beyond it are skipped.
+		template <class Node, class Visit>
+		void Walk(const std::vector<Node>& nodes, uint32_t root, const Math::Ray& ray, Visit visit, float tmax = std::numeric_limits<float>::max())
+		{
+			if (root == cNone) return;
+
+			Math::Vector3 inverse(1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z);
+
+			const float miss = std::numeric_limits<float>::infinity();
+
+			std::vector<std::pair<uint32_t, float>> stack; // nodes to visit, with their entry distances
+			stack.reserve(64);
+			float entry = Entry(nodes[root].lower, nodes[root].upper, ray.origin, inverse, tmax);
+			if (entry < miss) stack.emplace_back(root, entry);
+
+			while (!stack.empty()) {
+				const Node& node = nodes[stack.back().first];
+				bool passed = stack.back().second > tmax * cSlack; // (tmax was lowered since it was pushed)
+				stack.pop_back();
+				if (passed) continue;
+
+				if (node.children[0] == cNone) {
+					if (visit(node, tmax)) return;
+					continue;
+				}
+
+				// push the farther child first, so the nearer one is visited next
+				uint32_t nearer = node.children[0], farther = node.children[1];
+				float entries[2] = {
+					Entry(nodes[nearer].lower, nodes[nearer].upper, ray.origin, inverse, tmax),
+					Entry(nodes[farther].lower, nodes[farther].upper, ray.origin, inverse, tmax) };
+				if (entries[1] < entries[0]) {
+					std::swap(entries[0], entries[1]);
+					std::swap(nearer, farther);
+				}
+
+				if (entries[1] < miss) stack.emplace_back(farther, entries[1]);
+				if (entries[0] < miss) stack.emplace_back(nearer, entries[0]);
+			}
+		}
+	}
+}
@@ -49,6 +49,8 @@ Dashboard::Dashboard(HWND hwnd, ComPtr<ID3D11Device>& device, ComPtr<ID3D11Devic
 	mHwnd = hwnd;
 	mDevice = device;
 	mContext = context;
+	mProgress = -1.0f;
+	mCutPreview = -1.0f;
 
 	QueryPerformanceCounter((LARGE_INTEGER*)&mTime);
 	QueryPerformanceFrequency((LARGE_INTEGER*)&mTicksPerSecond);
@@ -238,6 +240,24 @@ void Dashboard::Update()
 }
 
 
+void Dashboard::SetProgress(float progress)
+{
+	mProgress = progress;
+}
+
+
+void Dashboard::SetPicking(const PickStats& picking)
+{
+	mPicking = picking;
+}
+
+
+void Dashboard::SetCutPreview(float length)
+{
+	mCutPreview = length;
+}
+
+
 void Dashboard::Render(std::vector<Light*>& lights)
 {
 	if (!mVertexBuffer) {
@@ -263,6 +283,7 @@ void Dashboard::Render(std::vector<Light*>& lights)
 			ImGui::Checkbox("Occlusion mapping", &gConfig.EnableOcclusion);
 			ImGui::Checkbox("Irradiance mapping", &gConfig.EnableIrradiance);
 			ImGui::Checkbox("Subsurface scattering", &gConfig.EnableScattering);
+			ImGui::Checkbox("Vertex cache reordering", &gConfig.EnableReordering);
 		}
 
 		if (ImGui::CollapsingHeader("Shading", "idShading", true, true)) {
@@ -283,9 +304,26 @@ void Dashboard::Render(std::vector<Light*>& lights)
 
 		ImGui::Separator();
 		ImGui::Text("FPS: %.1f (%.3f ms/frame)", ImGui::GetIO().Framerate, 1000.0f / ImGui::GetIO().Framerate);
+
+		if (mPicking.queries > 0) {
+			uint64_t misses = mPicking.queries - mPicking.ringHits;
+			ImGui::Text("Picking: %.0f%% near last face (%.1f us), else %.1f us",
+				100.0 * mPicking.ringHits / mPicking.queries,
+				mPicking.ringHits ? mPicking.ringTime / mPicking.ringHits : 0.0,
+				misses ? (mPicking.time - mPicking.ringTime) / misses : 0.0);
+		}
+
+		if (mProgress >= 0.0f) {
+			ImGui::Text("Loading scene: %.0f%%", mProgress * 100.0f);
+		}
 	}
 	ImGui::End();
 
+	// follows the cursor
+	if (mCutPreview >= 0.0f) {
+		ImGui::SetTooltip("Cut: %.1f cm", mCutPreview);
+	}
+
 	ImGui::Render();
 }
 
@@ -5,6 +5,8 @@
 #include <d3d11.h>
 #include <wrl/client.h>
 
+#include "PickCache.hpp"
+
 
 using Microsoft::WRL::ComPtr;
 
@@ -39,6 +41,9 @@ namespace SkinCut
 		HWND  mHwnd;
 		INT64 mTime;
 		INT64 mTicksPerSecond;
+		float mProgress;
+		float mCutPreview;
+		PickStats mPicking;
 		static const int cVertexBufferSize;
 
 		static ComPtr<ID3D11Device> mDevice;
@@ -61,6 +66,9 @@ namespace SkinCut
 		~Dashboard();
 
 		void Update();
+		void SetProgress(float progress); // fraction of the scene loaded (negative if no scene is being loaded)
+		void SetPicking(const PickStats& picking);
+		void SetCutPreview(float length); // length in cm of the cut being placed, up to the cursor (negative if none)
 		void Render(std::vector<Light*>& lights);
 
 		static void RenderDrawLists(ImDrawList** const cmdList, int numCmdList);
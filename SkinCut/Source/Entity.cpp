@@ -2,6 +2,7 @@
 
 #include <map>
 #include <list>
+#include <algorithm>
 #include <unordered_map>
 
 #include "SimpleJSON/JSON.h"
@@ -9,6 +10,7 @@
 
 #include "Mesh.hpp"
 #include "Utility.hpp"
+#include "MeshChunks.hpp"
 
 
 using Microsoft::WRL::ComPtr;
@@ -21,40 +23,32 @@ namespace SkinCut {
 }
 
 
-Entity::Entity(ComPtr<ID3D11Device>& device, Vector3 position, Vector2 rotation, 
-	std::wstring meshPath, std::wstring colorPath, std::wstring normalPath, 
-	std::wstring specularPath, std::wstring discolorPath, std::wstring occlusionPath) 
-: mDevice(device)
+const size_t Entity::cMaxEdits = 64;
+
+static uint64_t gEditCount = 0; // edits recorded by all entities
+
+
+Entity::Entity(ComPtr<ID3D11Device>& device, const EntityLoadInfo& info, EntityResources&& resources)
+: mLoadInfo(info), mDevice(device)
 {
+	mEditDepth = 0;
+
 	mTopology = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 
-	mPosition = position;
-	mRotation = rotation;
+	mPosition = info.position;
+	mRotation = info.rotation;
 
 	mMatrixWVP = Matrix::Identity();
 	mMatrixWorld = Matrix::Identity();
 
-	mVertexBufferSize = 0;
 	mVertexBufferOffset = 0;
-	mVertexBufferStrides = sizeof(Vertex);
-
-	mIndexBufferSize = 0;
-	mIndexBufferOffset = 0;
-	mIndexBufferFormat = DXGI_FORMAT_R32_UINT;
+	mVertexBufferStrides = sizeof(PackedVertex);
 
 	mColorWire = Color(0, 0, 0, 1);
 	mColorSolid = Color(0, 0, 0, 1);
 
-	mLoadInfo.position = position;
-	mLoadInfo.rotation = rotation;
-	mLoadInfo.meshPath = meshPath;
-	mLoadInfo.colorPath = colorPath;
-	mLoadInfo.normalPath = normalPath;
-	mLoadInfo.specularPath = specularPath;
-	mLoadInfo.discolorPath = discolorPath;
-	mLoadInfo.occlusionPath = occlusionPath;
-
-	LoadResources(mLoadInfo);
+	SetResources(resources);
+	mOrderedRevision = mMesh->mRevision; // (imported meshes are ordered)
 }
 
 Entity::~Entity() {}
@@ -67,97 +61,186 @@ void Entity::Update(const Matrix view, const Matrix projection)
 
 void Entity::Reload()
 {
-	mMesh.reset();
-	mColorMap.Reset();
-	mNormalMap.Reset();
-	mSpecularMap.Reset();
-	mDiscolorMap.Reset();
-	mOcclusionMap.Reset();
-	LoadResources(mLoadInfo);
+	// Restore the pristine mesh from memory instead of reloading it from disk.
+	mMesh->Restore(*mPristine.mesh);
+
+	// Painting renders into copies of the texture maps, so the original maps are unchanged.
+	mColorMap = mPristine.colorMap;
+	mNormalMap = mPristine.normalMap;
+	mSpecularMap = mPristine.specularMap;
+	mDiscolorMap = mPristine.discolorMap;
+	mOcclusionMap = mPristine.occlusionMap;
+
+	RebuildBuffers(); // (restoring rebuilds all indexes, so all chunks are rebuilt)
+	mChunks->MarkOrdered(); // (in the order of the imported mesh)
+	ClearEdits();
+	mOrderedRevision = mMesh->mRevision;
 }
 
 
+void Entity::OptimizeVertexCache()
+{
+	// Faces created by edits are appended to the face view, away from their neighbors.
+	if (mEditDepth > 0 || mMesh->mRevision == mOrderedRevision) return;
+
+	mChunks->Optimize(*mMesh);
+	mOrderedRevision = mMesh->mRevision;
+}
 
-void Entity::LoadResources(EntityLoadInfo li)
+
+
+/*******************************************************************************
+Edit history
+*******************************************************************************/
+
+void Entity::BeginEdit()
 {
-	mMesh = std::unique_ptr<Mesh>(new Mesh(li.meshPath));
-	if (!mMesh) {
-		throw std::exception("Cannot create mesh!");
+	if (mEditDepth++ > 0) return; // nested
+
+	mEdit = std::unique_ptr<EntityEdit>(new EntityEdit());
+	mEdit->mesh = std::unique_ptr<MeshDelta>(new MeshDelta());
+	mMesh->BeginTransaction(mEdit->mesh.get());
+}
+
+
+void Entity::EndEdit()
+{
+	if (mEditDepth == 0 || --mEditDepth > 0) return; // nested
+
+	mMesh->EndTransaction();
+	if (mEdit->mesh->Empty() && mEdit->patches.empty()) {
+		mEdit.reset();
+		return;
 	}
 
-	// load texture maps
-	mColorMap = Utility::LoadTexture(mDevice, li.colorPath);
-	mNormalMap = Utility::LoadTexture(mDevice, li.normalPath);
-	mSpecularMap = Utility::LoadTexture(mDevice, li.specularPath);
-	mDiscolorMap = Utility::LoadTexture(mDevice, li.discolorPath);
-	mOcclusionMap = Utility::LoadTexture(mDevice, li.occlusionPath);
+	mEdit->serial = ++gEditCount;
+	mUndoEdits.push_back(std::move(mEdit));
+	if (mUndoEdits.size() > cMaxEdits) {
+		mUndoEdits.erase(mUndoEdits.begin());
+	}
+	mRedoEdits.clear();
+}
 
-	RebuildBuffers(mMesh->mVertexes, mMesh->mIndexes);
+
+void Entity::RecordPaint(ComPtr<ID3D11ShaderResourceView>& map, const D3D11_BOX& region, 
+	ComPtr<ID3D11Texture2D> before, ComPtr<ID3D11Texture2D> after)
+{
+	if (!mEdit) return;
+	mEdit->patches.push_back({ &map, region, before, after });
 }
 
 
-void Entity::RebuildBuffers(std::vector<Vertex>& vertexes, std::vector<uint32_t>& indexes)
+bool Entity::Undo()
 {
-	mMesh->RebuildIndexes();
+	if (mEditDepth > 0 || mUndoEdits.empty()) return false;
+
+	std::unique_ptr<EntityEdit> edit = std::move(mUndoEdits.back());
+	mUndoEdits.pop_back();
+
+	if (mMesh->mRevision != edit->mesh->revisionAfter) { // mesh was changed outside of edits
+		ClearEdits();
+		return false;
+	}
 
-	mVertexBuffer.Reset();
-	RebuildVertexBuffer(vertexes);
+	// revert changes in reverse order; cost depends on the size of the edit only
+	mMesh->Undo(*edit->mesh);
+	for (auto patch = edit->patches.rbegin(); patch != edit->patches.rend(); ++patch) {
+		ApplyPatch(*patch, patch->before);
+	}
 
-	mIndexBuffer.Reset();
-	RebuildIndexBuffer(indexes);
+	RebuildBuffers();
+	mRedoEdits.push_back(std::move(edit));
+	return true;
 }
 
 
-void Entity::RebuildVertexBuffer(std::vector<Vertex>& vertexes)
+bool Entity::Redo()
 {
-	// Set vertex buffer properties.
-	mVertexBufferSize = sizeof(Vertex) * static_cast<uint32_t>(vertexes.size());
-	mVertexBufferStrides = sizeof(Vertex);
-	mVertexBufferOffset = 0;
+	if (mEditDepth > 0 || mRedoEdits.empty()) return false;
 
-	// Create dynamic vertex buffer description.
-	D3D11_BUFFER_DESC vertexBufferDesc{};
-	vertexBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
-	vertexBufferDesc.ByteWidth = mVertexBufferSize;
-	vertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-	vertexBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-	vertexBufferDesc.MiscFlags = 0;
-	vertexBufferDesc.StructureByteStride = 0;
+	std::unique_ptr<EntityEdit> edit = std::move(mRedoEdits.back());
+	mRedoEdits.pop_back();
 
-	// Create subresource data structure for vertex buffer.
-	D3D11_SUBRESOURCE_DATA vertexData{};
-	vertexData.pSysMem = &vertexes[0];
-	vertexData.SysMemPitch = 0;
-	vertexData.SysMemSlicePitch = 0;
+	if (mMesh->mRevision != edit->mesh->revisionBefore) {
+		ClearEdits();
+		return false;
+	}
 
-	// Create vertex buffer.
-	HREXCEPT(mDevice->CreateBuffer(&vertexBufferDesc, &vertexData, mVertexBuffer.GetAddressOf()));
+	mMesh->Redo(*edit->mesh);
+	for (auto& patch : edit->patches) {
+		ApplyPatch(patch, patch.after);
+	}
+
+	RebuildBuffers();
+	mUndoEdits.push_back(std::move(edit));
+	return true;
 }
 
 
-void Entity::RebuildIndexBuffer(std::vector<uint32_t>& indexes)
+uint64_t Entity::LastEdit() const
 {
-	// Set index buffer properties.
-	mIndexBufferSize = sizeof(uint32_t) * static_cast<uint32_t>(indexes.size());
-	mIndexBufferOffset = 0;
+	return mUndoEdits.empty() ? 0 : mUndoEdits.back()->serial;
+}
 
-	// Create static index buffer description.
-	D3D11_BUFFER_DESC indexBufferDesc{};
-	indexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
-	indexBufferDesc.ByteWidth = mIndexBufferSize;
-	indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-	indexBufferDesc.CPUAccessFlags = 0;
-	indexBufferDesc.MiscFlags = 0;
-	indexBufferDesc.StructureByteStride = 0;
+uint64_t Entity::NextEdit() const
+{
+	return mRedoEdits.empty() ? 0 : mRedoEdits.back()->serial;
+}
 
-	// Create subresource data structure for index buffer.
-	D3D11_SUBRESOURCE_DATA indexData{};
-	indexData.pSysMem = &indexes[0];
-	indexData.SysMemPitch = 0;
-	indexData.SysMemSlicePitch = 0;
 
-	// Create index buffer.
-	HREXCEPT(mDevice->CreateBuffer(&indexBufferDesc, &indexData, mIndexBuffer.GetAddressOf()));
+void Entity::ApplyPatch(TexturePatch& patch, ComPtr<ID3D11Texture2D>& texels)
+{
+	// Painting renders into a copy of the map, so the bound map is never an original texture.
+	ComPtr<ID3D11DeviceContext> context;
+	mDevice->GetImmediateContext(context.GetAddressOf());
+
+	ComPtr<ID3D11Texture2D> texture = Utility::GetTexture2D(*patch.map);
+	context->CopySubresourceRegion(texture.Get(), 0, patch.region.left, patch.region.top, 0, texels.Get(), 0, nullptr);
+}
+
+
+void Entity::ClearEdits()
+{
+	mUndoEdits.clear();
+	mRedoEdits.clear();
+}
+
+
+
+void Entity::SetResources(EntityResources& resources)
+{
+	mMesh = std::move(resources.mesh);
+	if (!mMesh) {
+		throw std::exception("Cannot create mesh!");
+	}
+
+	// texture maps
+	mColorMap = resources.colorMap;
+	mNormalMap = resources.normalMap;
+	mSpecularMap = resources.specularMap;
+	mDiscolorMap = resources.discolorMap;
+	mOcclusionMap = resources.occlusionMap;
+
+	// render chunks, partitioned by the faces of the loaded mesh
+	mChunks = std::unique_ptr<MeshChunks>(new MeshChunks(mDevice, *mMesh));
+	RebuildBuffers();
+	mChunks->MarkOrdered(); // (imported meshes are ordered)
+
+	// keep pristine state for reloading
+	mPristine.mesh = std::unique_ptr<MeshSnapshot>(new MeshSnapshot());
+	mMesh->Save(*mPristine.mesh);
+	mPristine.colorMap = mColorMap;
+	mPristine.normalMap = mNormalMap;
+	mPristine.specularMap = mSpecularMap;
+	mPristine.discolorMap = mDiscolorMap;
+	mPristine.occlusionMap = mOcclusionMap;
+}
+
+
+void Entity::RebuildBuffers()
+{
+	mMesh->RebuildIndexes();
+	mChunks->Update(*mMesh);
 }
 
 
@@ -176,11 +259,19 @@ bool Entity::RayIntersection(Ray& ray, Intersection& ix) const
 	return mMesh->RayIntersection(ray, ix);
 }
 
+bool Entity::RayIntersection(Ray& ray, Intersection& ix, const std::vector<Face*>& hints) const
+{
+	return mMesh->RayIntersection(ray, ix, hints);
+}
+
 
 void Entity::Subdivide(Face*& face, SplitType splitMode, Vector3& point)
 {
-	mMesh->Subdivide(face, splitMode, point); // split a particular face
-	RebuildBuffers(mMesh->mVertexes, mMesh->mIndexes);
+	{
+		Edit edit(*this);
+		mMesh->Subdivide(face, splitMode, point); // split a particular face
+	}
+	RebuildBuffers();
 }
 
 
@@ -193,13 +284,13 @@ void Entity::FormCutline(Intersection& i0, Intersection& i1, std::list<Link>& cu
 void Entity::FuseCutline(std::list<Link>& cutLine, std::vector<Edge*>& cutEdges)
 {
 	mMesh->FuseCutline(cutLine, cutEdges);
-	RebuildBuffers(mMesh->mVertexes, mMesh->mIndexes);
+	RebuildBuffers();
 }
 
 void Entity::OpenCutLine(std::vector<Edge*>& edges, Quadrilateral& cutQuad, bool gutter)
 {
 	mMesh->OpenCutLine(edges, cutQuad, gutter);
-	RebuildBuffers(mMesh->mVertexes, mMesh->mIndexes);
+	RebuildBuffers();
 }
 
 
@@ -212,10 +303,3 @@ void Entity::ChainFaces(LinkList& chain, LinkFaceMap& outerChainFaces, LinkFaceM
 {
 	mMesh->ChainFaces(chain, outerChainFaces, innerChainFaces, outerRadius, innerRadius);
 }
-
-
-
-uint32_t Entity::IndexCount() const
-{
-	return static_cast<uint32_t>(mMesh->mIndexes.size());
-}
@@ -21,6 +21,9 @@ namespace SkinCut
 {
 
 	class Mesh;
+	struct MeshDelta;
+	struct MeshSnapshot;
+	class MeshChunks;
 
 	typedef std::list<Link> LinkList;
 	typedef std::map<Link, std::vector<Face*>> LinkFaceMap;
@@ -38,11 +41,75 @@ namespace SkinCut
 		std::wstring occlusionPath;
 	};
 
+
+	struct EntityResources // loaded from the files of an EntityLoadInfo (see SceneLoader)
+	{
+		std::unique_ptr<Mesh> mesh;
+		ComPtr<ID3D11ShaderResourceView> colorMap;
+		ComPtr<ID3D11ShaderResourceView> normalMap;
+		ComPtr<ID3D11ShaderResourceView> specularMap;
+		ComPtr<ID3D11ShaderResourceView> discolorMap;
+		ComPtr<ID3D11ShaderResourceView> occlusionMap;
+	};
+
+
+	struct EntitySnapshot // pristine state, restored by Entity::Reload
+	{
+		std::unique_ptr<MeshSnapshot> mesh;
+		ComPtr<ID3D11ShaderResourceView> colorMap;
+		ComPtr<ID3D11ShaderResourceView> normalMap;
+		ComPtr<ID3D11ShaderResourceView> specularMap;
+		ComPtr<ID3D11ShaderResourceView> discolorMap;
+		ComPtr<ID3D11ShaderResourceView> occlusionMap;
+	};
+
+
+	struct TexturePatch // texel region of a painted texture map, before and after painting
+	{
+		ComPtr<ID3D11ShaderResourceView>* map; // map binding of the entity (e.g. mColorMap)
+		D3D11_BOX region;
+		ComPtr<ID3D11Texture2D> before;
+		ComPtr<ID3D11Texture2D> after;
+	};
+
+
+	struct EntityEdit // undoable edit (see Entity::Edit)
+	{
+		uint64_t serial; // edits of all entities are numbered in order
+		std::unique_ptr<MeshDelta> mesh;
+		std::vector<TexturePatch> patches;
+	};
+
 	
 	class Entity
 	{
+	public: // edit history
+		// Records all changes made to the entity while it exists (painting, cutting,
+		// subdividing) as one edit that can be undone. Edits can be nested.
+		class Edit
+		{
+		private:
+			Entity& mEntity;
+
+		public:
+			Edit(Entity& entity) : mEntity(entity) { mEntity.BeginEdit(); }
+			~Edit() { mEntity.EndEdit(); }
+		};
+
+		static const size_t cMaxEdits; // number of edits kept for undo
+
+
+	private:
+		uint32_t mEditDepth;
+		uint64_t mOrderedRevision; // mesh revision of the last vertex cache ordering
+		std::unique_ptr<EntityEdit> mEdit; // edit being recorded
+		std::vector<std::unique_ptr<EntityEdit>> mUndoEdits;
+		std::vector<std::unique_ptr<EntityEdit>> mRedoEdits;
+
+
 	private:
 		EntityLoadInfo mLoadInfo;
+		EntitySnapshot mPristine;
 		ComPtr<ID3D11Device> mDevice;
 
 	public:
@@ -56,18 +123,11 @@ namespace SkinCut
 		Math::Matrix mMatrixWorld;
 		Math::Matrix mMatrixWVP;
 
-		// vertex buffer
-		uint32_t mVertexBufferSize;
+		// render data (compressed copy of the mesh, in spatial chunks)
+		std::unique_ptr<MeshChunks> mChunks;
 		uint32_t mVertexBufferStrides;
 		uint32_t mVertexBufferOffset;
 		D3D11_PRIMITIVE_TOPOLOGY mTopology;
-		ComPtr<ID3D11Buffer> mVertexBuffer;
-
-		// index buffer
-		uint32_t mIndexBufferSize;
-		uint32_t mIndexBufferOffset;
-		DXGI_FORMAT mIndexBufferFormat;
-		ComPtr<ID3D11Buffer> mIndexBuffer;
 
 		// material data
 		Math::Color mColorWire;
@@ -81,25 +141,39 @@ namespace SkinCut
 
 
 	public: // constructor
-		Entity(ComPtr<ID3D11Device>& device, Math::Vector3 position, Math::Vector2 rotation,
-			std::wstring meshPath, std::wstring colorPath, std::wstring normalPath, std::wstring specularPath, std::wstring discolorPath, std::wstring occlusionPath);
+		// Creates the vertex and index buffers of the chunks, so it must run on the thread that owns the device context.
+		Entity(ComPtr<ID3D11Device>& device, const EntityLoadInfo& info, EntityResources&& resources);
 		~Entity();
 
 
 	private:
-		void LoadResources(EntityLoadInfo li);
+		void SetResources(EntityResources& resources);
+
+		void RebuildBuffers(); // (only the chunks of changed faces)
 
-		void RebuildBuffers(std::vector<Vertex>& vertexes, std::vector<uint32_t>& indexes);
-		void RebuildVertexBuffer(std::vector<Vertex>& vertexes);
-		void RebuildIndexBuffer(std::vector<uint32_t>& indexes);
+		void ApplyPatch(TexturePatch& patch, ComPtr<ID3D11Texture2D>& texels);
+		void ClearEdits();
 
 
 	public:
 		void Update(const Math::Matrix view, const Math::Matrix projection);
 		void Reload();
+		void OptimizeVertexCache(); // reorder the triangles of the chunks that edits changed for the vertex cache (e.g. when idle)
+
+		void BeginEdit();
+		void EndEdit();
+		bool Editing() const { return mEditDepth > 0; }
+		void RecordPaint(ComPtr<ID3D11ShaderResourceView>& map, const D3D11_BOX& region, 
+			ComPtr<ID3D11Texture2D> before, ComPtr<ID3D11Texture2D> after);
+
+		bool Undo(); // revert the last edit
+		bool Redo(); // reapply the last reverted edit
+		uint64_t LastEdit() const; // serial of the edit Undo reverts (0 if none)
+		uint64_t NextEdit() const; // serial of the edit Redo reapplies (0 if none)
 
 		bool RayIntersection(Math::Ray& ray) const;
 		bool RayIntersection(Math::Ray& ray, Intersection& intersection) const;
+		bool RayIntersection(Math::Ray& ray, Intersection& intersection, const std::vector<Face*>& hints) const; // (see Mesh::RayIntersection)
 
 		void Subdivide(Face*& face, SplitType splitMode, Math::Vector3& point);
 
@@ -109,8 +183,6 @@ namespace SkinCut
 
 		void ChainFaces(LinkList& chain, LinkFaceMap& cf, float r) const;
 		void ChainFaces(LinkList& chain, LinkFaceMap& cfo, LinkFaceMap& cfi, float ro, float ri) const;
-
-		uint32_t IndexCount() const;
 	};
 
 }
@@ -0,0 +1,413 @@
+#include "FaceBvh.hpp"
+
+#include <array>
+#include <cmath>
+#include <algorithm>
+
+
+using namespace SkinCut;
+using namespace SkinCut::Math;
+
+
+
+const uint32_t FaceBvh::cLeafSize = TrianglePackets::cLanes;
+const uint32_t FaceBvh::cMaxInserted = 25;
+const uint32_t FaceBvh::cNone = Bvh::cNone;
+
+
+
+namespace
+{
+	constexpr uint32_t cBins = 16; // centroid bins per axis when evaluating splits
+
+
+	float Area(const Vector3& lower, const Vector3& upper)
+	{
+		Vector3 d = upper - lower;
+		if (d.x < 0 || d.y < 0 || d.z < 0) return 0.0f; // (empty)
+		return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+	}
+
+
+	bool Finite(const Vector3& v)
+	{
+		return std::isfinite(v.x) && std::isfinite(v.y) && std::isfinite(v.z);
+	}
+
+
+	const Vector3 cEmptyLower(std::numeric_limits<float>::max());
+	const Vector3 cEmptyUpper(-std::numeric_limits<float>::max());
+}
+
+
+
+FaceBvh::FaceBvh(const Mesh& mesh)
+: mMesh(mesh), mRoot(cNone), mBuilt(0), mInserted(0)
+{
+}
+
+
+void FaceBvh::Build()
+{
+	Build(static_cast<uint32_t>(mMesh.mFaceArray.size()));
+}
+
+
+void FaceBvh::Build(uint32_t slotCount)
+{
+	mNodes.clear();
+	mSlots.clear();
+	mPackets.clear();
+	mSlotLeaves.assign(slotCount, cNone);
+
+	std::vector<Item> items;
+	items.reserve(slotCount);
+	for (uint32_t slot = 0; slot < slotCount; ++slot) {
+		if (Hittable(slot)) items.push_back(MakeItem(slot));
+	}
+
+	mRoot = items.empty() ? cNone : Build(items, 0, items.size());
+	mBuilt = static_cast<uint32_t>(items.size());
+	mInserted = 0;
+}
+
+
+void FaceBvh::Update(const std::vector<uint32_t>& changed)
+{
+	const std::vector<Face*>& faces = mMesh.mFaceArray;
+	const uint32_t known = static_cast<uint32_t>(mSlotLeaves.size());
+
+	if (faces.size() < known) { // (slots moved)
+		Build();
+		return;
+	}
+
+	// faces appended to the view since the last update, and changed ones that were left out
+	std::vector<uint32_t> added;
+	for (uint32_t slot : changed) {
+		if (slot < known && mSlotLeaves[slot] == cNone) added.push_back(slot);
+	}
+	std::sort(added.begin(), added.end());
+	added.erase(std::unique(added.begin(), added.end()), added.end());
+	for (uint32_t slot = known; slot < faces.size(); ++slot) {
+		added.push_back(slot);
+	}
+
+	std::vector<Item> items;
+	for (uint32_t slot : added) {
+		if (Hittable(slot)) items.push_back(MakeItem(slot));
+	}
+
+	if (mRoot == cNone || (size_t(mInserted) + items.size()) * 100 > size_t(mBuilt) * cMaxInserted) {
+		Build();
+		return;
+	}
+
+	// refit the leaves of faces changed in place or killed
+	std::vector<uint32_t> leaves;
+	for (uint32_t slot : changed) {
+		if (slot < known && mSlotLeaves[slot] != cNone) leaves.push_back(mSlotLeaves[slot]);
+	}
+	std::sort(leaves.begin(), leaves.end());
+	leaves.erase(std::unique(leaves.begin(), leaves.end()), leaves.end());
+
+	for (uint32_t leaf : leaves) {
+		Refit(leaf);
+	}
+
+	mSlotLeaves.resize(faces.size(), cNone);
+	if (!items.empty()) {
+		Insert(Build(items, 0, items.size()));
+		mInserted += static_cast<uint32_t>(items.size());
+	}
+}
+
+
+
+bool FaceBvh::Closest(const Ray& ray, Hit& hit) const
+{
+	hit.slot = cNone;
+	hit.t = std::numeric_limits<float>::max();
+	return Closer(ray, hit);
+}
+
+
+bool FaceBvh::Closer(const Ray& ray, Hit& hit) const
+{
+	const uint32_t known = hit.slot;
+
+	Bvh::Walk(mNodes, mRoot, ray, [&](const Node& leaf, float& tmax) {
+		float t[TrianglePackets::cLanes], u[TrianglePackets::cLanes], v[TrianglePackets::cLanes];
+		uint32_t hits = TrianglePackets::Intersect(ray, mPackets[leaf.first / cLeafSize], t, u, v);
+
+		for (uint32_t k = 0; k < leaf.count; ++k) {
+			if (!(hits & (1u << k)) || !(t[k] >= 0)) continue;
+
+			// replace if the face is hit earlier along the ray, or at the same distance on a
+			// face earlier in the view (killed faces have empty lanes)
+			uint32_t slot = mSlots[leaf.first + k];
+			if (t[k] < tmax || (t[k] == tmax && slot < hit.slot)) {
+				hit.slot = slot;
+				hit.t = tmax = t[k];
+				hit.u = u[k];
+				hit.v = v[k];
+			}
+		}
+		return false;
+	}, hit.t);
+
+	return hit.slot != known;
+}
+
+
+bool FaceBvh::Bounds(Vector3& lower, Vector3& upper) const
+{
+	if (mRoot == cNone) return false;
+
+	lower = mNodes[mRoot].lower;
+	upper = mNodes[mRoot].upper;
+	return true;
+}
+
+
+
+bool FaceBvh::Hittable(uint32_t slot) const
+{
+	const Face* face = mMesh.mFaceArray[slot];
+	if (!face) return false;
+
+	for (uint32_t k = 0; k < 3; ++k) {
+		if (!Finite(mMesh.Position(face->n[k])) || !Finite(mMesh.mVertexes[face->v[k]].position)) return false;
+	}
+	return true;
+}
+
+
+FaceBvh::Item FaceBvh::MakeItem(uint32_t slot) const
+{
+	const Face* face = mMesh.mFaceArray[slot];
+
+	Item item;
+	item.lower = cEmptyLower;
+	item.upper = cEmptyUpper;
+	for (uint32_t k = 0; k < 3; ++k) {
+		const Vector3& node = mMesh.Position(face->n[k]);
+		const Vector3& vertex = mMesh.mVertexes[face->v[k]].position;
+		Bvh::Grow(item.lower, item.upper, node);
+		Bvh::Grow(item.lower, item.upper, vertex);
+	}
+	item.centroid = (item.lower + item.upper) * 0.5f;
+	item.slot = slot;
+	return item;
+}
+
+
+void FaceBvh::Pack(const Node& leaf)
+{
+	TrianglePacket& packet = mPackets[leaf.first / cLeafSize];
+	TrianglePackets::Clear(packet);
+
+	for (uint32_t k = 0; k < leaf.count; ++k) {
+		if (!Hittable(mSlots[leaf.first + k])) continue; // (killed or left out)
+		const Face* face = mMesh.mFaceArray[mSlots[leaf.first + k]];
+
+		const Vector3& v0 = mMesh.mVertexes[face->v[0]].position;
+		const Vector3& v1 = mMesh.mVertexes[face->v[1]].position;
+		const Vector3& v2 = mMesh.mVertexes[face->v[2]].position;
+		TrianglePackets::Set(packet, k, Triangle(v0, v1, v2));
+	}
+}
+
+
+uint32_t FaceBvh::Build(std::vector<Item>& items, size_t begin, size_t end)
+{
+	uint32_t index = static_cast<uint32_t>(mNodes.size());
+	mNodes.push_back(Node());
+
+	Node node;
+	node.parent = cNone;
+	node.children[0] = node.children[1] = cNone;
+	node.first = node.count = 0;
+	node.lower = cEmptyLower;
+	node.upper = cEmptyUpper;
+
+	Vector3 centroidLower = cEmptyLower, centroidUpper = cEmptyUpper;
+	for (size_t i = begin; i < end; ++i) {
+		Bvh::Grow(node.lower, node.upper, items[i].lower, items[i].upper);
+		Bvh::Grow(centroidLower, centroidUpper, items[i].centroid);
+	}
+
+	const size_t count = end - begin;
+	if (count <= cLeafSize) {
+		node.first = static_cast<uint32_t>(mSlots.size());
+		node.count = static_cast<uint32_t>(count);
+		for (size_t i = begin; i < end; ++i) {
+			mSlots.push_back(items[i].slot);
+			mSlotLeaves[items[i].slot] = index;
+		}
+		mSlots.resize(node.first + cLeafSize, cNone);
+		mPackets.emplace_back();
+		Pack(node);
+		mNodes[index] = node;
+		return index;
+	}
+
+	// Split between the centroid bins (of any axis) with the lowest surface area heuristic:
+	// the areas of both sides weighted by their number of faces.
+	struct Bin
+	{
+		Vector3 lower, upper;
+		uint32_t count;
+	};
+
+	uint32_t bestAxis = cNone, bestSplit = 0;
+	float bestCost = std::numeric_limits<float>::max();
+
+	auto BinOf = [&](const Item& item, uint32_t axis) {
+		float lower = Bvh::Component(centroidLower, axis);
+		float extent = Bvh::Component(centroidUpper, axis) - lower;
+		uint32_t bin = static_cast<uint32_t>((Bvh::Component(item.centroid, axis) - lower) / extent * cBins);
+		return std::min(bin, cBins - 1);
+	};
+
+	for (uint32_t axis = 0; axis < 3; ++axis) {
+		if (Bvh::Component(centroidUpper, axis) <= Bvh::Component(centroidLower, axis)) continue; // (centroids in a plane)
+
+		std::array<Bin, cBins> bins;
+		bins.fill({ cEmptyLower, cEmptyUpper, 0 });
+		for (size_t i = begin; i < end; ++i) {
+			Bin& bin = bins[BinOf(items[i], axis)];
+			Bvh::Grow(bin.lower, bin.upper, items[i].lower, items[i].upper);
+			bin.count++;
+		}
+
+		// costs of the faces above each split (split s puts bins [0, s) below)
+		std::array<float, cBins> above;
+		Vector3 lower = cEmptyLower, upper = cEmptyUpper;
+		uint32_t n = 0;
+		for (uint32_t s = cBins - 1; s > 0; --s) {
+			Bvh::Grow(lower, upper, bins[s].lower, bins[s].upper);
+			n += bins[s].count;
+			above[s] = Area(lower, upper) * n;
+		}
+
+		lower = cEmptyLower;
+		upper = cEmptyUpper;
+		n = 0;
+		for (uint32_t s = 1; s < cBins; ++s) {
+			Bvh::Grow(lower, upper, bins[s - 1].lower, bins[s - 1].upper);
+			n += bins[s - 1].count;
+			if (n == 0 || n == count) continue; // (one side empty)
+
+			float cost = Area(lower, upper) * n + above[s];
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = s;
+			}
+		}
+	}
+
+	size_t middle;
+	if (bestAxis != cNone) {
+		middle = std::partition(items.begin() + begin, items.begin() + end,
+			[&](const Item& item) { return BinOf(item, bestAxis) < bestSplit; }) - items.begin();
+	}
+	else { // all centroids coincide
+		middle = begin + count / 2;
+	}
+
+	uint32_t below = Build(items, begin, middle);
+	uint32_t above = Build(items, middle, end);
+	mNodes[below].parent = index;
+	mNodes[above].parent = index;
+
+	node.children[0] = below;
+	node.children[1] = above;
+	mNodes[index] = node;
+	return index;
+}
+
+
+void FaceBvh::Refit(uint32_t index)
+{
+	while (index != cNone) {
+		Node& node = mNodes[index];
+		Vector3 lower = cEmptyLower, upper = cEmptyUpper;
+
+		if (node.children[0] == cNone) {
+			Pack(node);
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				if (!Hittable(mSlots[i])) continue; // (killed or left out)
+				Item item = MakeItem(mSlots[i]);
+				Bvh::Grow(lower, upper, item.lower, item.upper);
+			}
+		}
+		else {
+			for (uint32_t child : node.children) {
+				Bvh::Grow(lower, upper, mNodes[child].lower, mNodes[child].upper);
+			}
+		}
+
+		if (lower == node.lower && upper == node.upper) return; // (ancestors are unchanged too)
+		node.lower = lower;
+		node.upper = upper;
+		index = node.parent;
+	}
+}
+
+
+void FaceBvh::Insert(uint32_t subtree)
+{
+	const Vector3 lower = mNodes[subtree].lower, upper = mNodes[subtree].upper;
+
+	// Descend to the node that is cheapest to pair with the subtree: pairing with a node adds
+	// the area of the new parent, and every node passed on the way grows to hold the subtree.
+	uint32_t sibling = mRoot;
+	while (mNodes[sibling].children[0] != cNone) {
+		const Node& node = mNodes[sibling];
+
+		Vector3 combinedLower = node.lower, combinedUpper = node.upper;
+		Bvh::Grow(combinedLower, combinedUpper, lower, upper);
+		float combined = Area(combinedLower, combinedUpper);
+		float inherited = combined - Area(node.lower, node.upper);
+
+		float costs[2];
+		for (uint32_t k = 0; k < 2; ++k) {
+			const Node& child = mNodes[node.children[k]];
+			Vector3 childLower = child.lower, childUpper = child.upper;
+			Bvh::Grow(childLower, childUpper, lower, upper);
+			costs[k] = Area(childLower, childUpper) + inherited;
+			if (child.children[0] != cNone) costs[k] -= Area(child.lower, child.upper);
+		}
+
+		if (combined <= costs[0] && combined <= costs[1]) break;
+		sibling = node.children[(costs[1] < costs[0]) ? 1 : 0];
+	}
+
+	// replace the sibling by a new node holding the sibling and the subtree
+	uint32_t parent = mNodes[sibling].parent;
+	uint32_t index = static_cast<uint32_t>(mNodes.size());
+
+	Node node;
+	node.parent = parent;
+	node.children[0] = sibling;
+	node.children[1] = subtree;
+	node.first = node.count = 0;
+	node.lower = mNodes[sibling].lower;
+	node.upper = mNodes[sibling].upper;
+	Bvh::Grow(node.lower, node.upper, lower, upper);
+	mNodes.push_back(node);
+
+	mNodes[sibling].parent = index;
+	mNodes[subtree].parent = index;
+
+	if (parent == cNone) {
+		mRoot = index;
+	}
+	else {
+		Node& p = mNodes[parent];
+		p.children[(p.children[0] == sibling) ? 0 : 1] = index;
+		Refit(parent);
+	}
+}
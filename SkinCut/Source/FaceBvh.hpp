@@ -0,0 +1,100 @@
+#pragma once
+
+#include <vector>
+#include <limits>
+#include <cstdint>
+#include <utility>
+
+#include "Bvh.hpp"
+#include "Mesh.hpp"
+#include "Structures.hpp"
+#include "Mathematics.hpp"
+#include "TrianglePacket.hpp"
+
+
+
+namespace SkinCut
+{
+	// Bounding volume hierarchy over the face view slots of a mesh, for ray queries. It is built
+	// with the surface area heuristic (binned centroids) and kept up to date after edits: leaves
+	// of changed faces are refit, and faces appended to the view are built into a subtree that
+	// is inserted next to the node it enlarges least. Once inserted faces exceed cMaxInserted
+	// percent of the built ones, the hierarchy is rebuilt.
+	//
+	// Face bounds hold both the node positions and the vertex positions of a face, which can
+	// differ slightly after cuts. Faces with non-finite positions are left out, as no ray can hit
+	// them. Each leaf keeps the vertex positions of its faces in a triangle packet, so closest
+	// hits test all faces of a leaf at once.
+	class FaceBvh
+	{
+	public: // constants
+		static const uint32_t cLeafSize; // faces per leaf when building (the lanes of a triangle packet)
+		static const uint32_t cMaxInserted; // percentage of inserted faces before rebuilding
+		static const uint32_t cNone;
+
+	private:
+		struct Node
+		{
+			Math::Vector3 lower, upper;
+			uint32_t parent;
+			uint32_t children[2]; // (cNone for leaves)
+			uint32_t first, count; // slots of a leaf: mSlots[first, first + count)
+		};
+
+		struct Item // face being built into the hierarchy
+		{
+			Math::Vector3 lower, upper, centroid;
+			uint32_t slot;
+		};
+
+		const Mesh& mMesh;
+		uint32_t mRoot; // (cNone if there are no faces)
+		std::vector<Node> mNodes;
+		std::vector<uint32_t> mSlots; // face view slots, cLeafSize per leaf (killed faces are skipped, unused entries are cNone)
+		std::vector<TrianglePacket> mPackets; // vertex positions of the faces of a leaf: mPackets[first / cLeafSize]
+		std::vector<uint32_t> mSlotLeaves; // face view slot -> leaf (cNone if the slot had no face)
+		uint32_t mBuilt; // faces in the last build
+		uint32_t mInserted; // faces inserted since
+
+
+	public:
+		struct Hit
+		{
+			uint32_t slot; // face view slot
+			float t, u, v; // distance along the ray and barycentric coordinates (as Math::RayTriangleIntersection)
+		};
+
+		FaceBvh(const Mesh& mesh);
+
+		void Build(); // all faces of the face view
+		void Build(uint32_t slotCount); // faces of the first slotCount face view slots
+		void Update(const std::vector<uint32_t>& changed); // refit changed face view slots and insert appended ones
+
+		bool Closest(const Math::Ray& ray, Hit& hit) const; // nearest face hit in front of the ray origin (at equal distances, the earliest slot)
+		bool Closer(const Math::Ray& ray, Hit& hit) const; // as Closest, given a known hit: only nodes up to its distance are searched (true if hit was replaced)
+		bool Bounds(Math::Vector3& lower, Math::Vector3& upper) const; // of all faces in the hierarchy (false if there are none)
+
+		// Visits the faces whose bounds the ray enters within [0, tmax), nearest nodes first.
+		// test(face, tmax) returns true to end the traversal, and may lower tmax.
+		template <class Test>
+		void Traverse(const Math::Ray& ray, Test test) const
+		{
+			Bvh::Walk(mNodes, mRoot, ray, [&](const Node& leaf, float& tmax) {
+				for (uint32_t i = leaf.first; i < leaf.first + leaf.count; ++i) {
+					Face* face = mMesh.mFaceArray[mSlots[i]];
+					if (face && test(face, tmax)) return true;
+				}
+				return false;
+			});
+		}
+
+
+	private:
+		bool Hittable(uint32_t slot) const; // slot has a face with finite positions
+		Item MakeItem(uint32_t slot) const;
+		void Pack(const Node& leaf); // store the vertex positions of the faces of a leaf in its packet
+		uint32_t Build(std::vector<Item>& items, size_t begin, size_t end); // returns the root of the subtree
+		void Refit(uint32_t node); // recompute bounds of a node and its ancestors
+		void Insert(uint32_t subtree);
+	};
+}
@@ -0,0 +1,220 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <algorithm>
+
+
+
+namespace SkinCut
+{
+	// Open-addressing hash set of element pointers (linear probing, backward-shift erase).
+	// H provides a 64-bit hash of an element (H::Hash) and an equality test between two elements,
+	// so lookups can be done with a key element that is not stored in the table.
+	template <class T, class H>
+	class FlatTable
+	{
+	public: // constants
+		static const size_t cMinCapacity = 16;
+		static const size_t cMaxLoad = 70; // percent
+		static const uint32_t cNoHandle = 0xFFFFFFFF; // empty slot (see Handles)
+
+
+	public:
+		struct Statistics
+		{
+			size_t size;
+			size_t capacity;
+			double meanProbe;		// average displacement of stored elements from their home slot
+			size_t maxProbe;		// largest displacement
+		};
+
+
+	private:
+		struct Slot
+		{
+			uint64_t hash;
+			T* element;				// nullptr if empty
+		};
+
+		std::vector<Slot> mSlots;
+		size_t mSize;
+		size_t mMask;
+		H mHash;
+
+
+	public:
+		FlatTable(const H& hash = H()) : mSize(0), mMask(0), mHash(hash) {}
+
+		T* Find(const T* key) const
+		{
+			if (mSlots.empty()) return nullptr;
+
+			uint64_t hash = mHash.Hash(key);
+			for (size_t i = hash & mMask;; i = (i + 1) & mMask) {
+				const Slot& slot = mSlots[i];
+				if (!slot.element) return nullptr;
+				if (slot.hash == hash && mHash(slot.element, key)) return slot.element;
+			}
+		}
+
+		std::pair<T*, bool> Insert(T* element)
+		{
+			if ((mSize + 1) * 100 > mSlots.size() * cMaxLoad) {
+				Rehash(std::max(cMinCapacity, mSlots.size() * 2));
+			}
+
+			uint64_t hash = mHash.Hash(element);
+			for (size_t i = hash & mMask;; i = (i + 1) & mMask) {
+				Slot& slot = mSlots[i];
+				if (!slot.element) {
+					slot.hash = hash;
+					slot.element = element;
+					mSize++;
+					return std::make_pair(element, true);
+				}
+				if (slot.hash == hash && mHash(slot.element, element)) {
+					return std::make_pair(slot.element, false); // already exists
+				}
+			}
+		}
+
+		T* Erase(const T* key) // returns the erased element (nullptr if not found)
+		{
+			if (mSlots.empty()) return nullptr;
+
+			uint64_t hash = mHash.Hash(key);
+			for (size_t i = hash & mMask;; i = (i + 1) & mMask) {
+				if (!mSlots[i].element) return nullptr;
+				if (mSlots[i].hash == hash && mHash(mSlots[i].element, key)) {
+					T* element = mSlots[i].element;
+					EraseSlot(i);
+					return element;
+				}
+			}
+		}
+
+
+		// Insertion and removal of a specific element under a recorded hash, without comparing
+		// keys. Used to replay earlier changes exactly, even if the element has been modified
+		// since (its current contents may no longer hash to the recorded value).
+		void InsertHashed(uint64_t hash, T* element)
+		{
+			if ((mSize + 1) * 100 > mSlots.size() * cMaxLoad) {
+				Rehash(std::max(cMinCapacity, mSlots.size() * 2));
+			}
+
+			size_t i = hash & mMask;
+			while (mSlots[i].element) i = (i + 1) & mMask;
+			mSlots[i].hash = hash;
+			mSlots[i].element = element;
+			mSize++;
+		}
+
+		bool EraseHashed(uint64_t hash, const T* element)
+		{
+			if (mSlots.empty()) return false;
+
+			for (size_t i = hash & mMask;; i = (i + 1) & mMask) {
+				if (!mSlots[i].element) return false;
+				if (mSlots[i].element == element) {
+					EraseSlot(i);
+					return true;
+				}
+			}
+		}
+
+		uint64_t Hash(const T* key) const { return mHash.Hash(key); }
+
+
+		// Slot layout as element handles (cNoHandle for empty slots). A table assigned the same
+		// layout is rebuilt without probing; only the hashes are computed again.
+		void Handles(std::vector<uint32_t>& handles) const
+		{
+			handles.resize(mSlots.size());
+			for (size_t i = 0; i < mSlots.size(); ++i) {
+				handles[i] = mSlots[i].element ? mSlots[i].element->id : cNoHandle;
+			}
+		}
+
+		template <class G>
+		void Assign(const uint32_t* handles, size_t capacity, G element) // capacity must be a power of two (or zero)
+		{
+			mSlots.assign(capacity, Slot{ 0, nullptr });
+			mMask = capacity ? capacity - 1 : 0;
+			mSize = 0;
+
+			for (size_t i = 0; i < capacity; ++i) {
+				if (handles[i] == cNoHandle) continue;
+				T* e = element(handles[i]); // handle -> element pointer
+				mSlots[i].hash = mHash.Hash(e);
+				mSlots[i].element = e;
+				mSize++;
+			}
+		}
+
+		void Reserve(size_t count)
+		{
+			size_t capacity = cMinCapacity;
+			while (capacity * cMaxLoad < count * 100) capacity *= 2;
+			if (capacity > mSlots.size()) Rehash(capacity);
+		}
+
+		void Clear()
+		{
+			mSlots.clear();
+			mSize = 0;
+			mMask = 0;
+		}
+
+		size_t Size() const { return mSize; }
+		size_t Capacity() const { return mSlots.size(); }
+		size_t Bytes() const { return mSlots.capacity() * sizeof(Slot); }
+
+		Statistics Probes() const
+		{
+			Statistics stats = { mSize, mSlots.size(), 0.0, 0 };
+			size_t total = 0;
+			for (size_t i = 0; i < mSlots.size(); ++i) {
+				if (!mSlots[i].element) continue;
+				size_t probe = (i - mSlots[i].hash) & mMask;
+				stats.maxProbe = std::max(stats.maxProbe, probe);
+				total += probe;
+			}
+			stats.meanProbe = mSize ? double(total) / double(mSize) : 0.0;
+			return stats;
+		}
+
+
+	private:
+		void EraseSlot(size_t i)
+		{
+			// shift following elements of the probe sequence back into the gap
+			for (size_t j = (i + 1) & mMask; mSlots[j].element; j = (j + 1) & mMask) {
+				size_t home = mSlots[j].hash & mMask;
+				if (((j - home) & mMask) >= ((j - i) & mMask)) {
+					mSlots[i] = mSlots[j];
+					i = j;
+				}
+			}
+
+			mSlots[i].element = nullptr;
+			mSize--;
+		}
+
+		void Rehash(size_t capacity) // capacity must be a power of two
+		{
+			std::vector<Slot> slots(capacity, Slot{ 0, nullptr });
+			std::swap(mSlots, slots);
+			mMask = capacity - 1;
+
+			for (const Slot& slot : slots) {
+				if (!slot.element) continue;
+				size_t i = slot.hash & mMask;
+				while (mSlots[i].element) i = (i + 1) & mMask;
+				mSlots[i] = slot;
+			}
+		}
+	};
+}
@@ -11,9 +11,11 @@
 #include "Shader.hpp"
 #include "Target.hpp"
 #include "Utility.hpp"
+#include "MeshChunks.hpp"
 #include "Structures.hpp"
 #include "Mathematics.hpp"
 #include "VertexBuffer.hpp"
+#include "VertexFormat.hpp"
 
 
 
@@ -36,7 +38,7 @@ Generator::Generator(ComPtr<ID3D11Device>& device, ComPtr<ID3D11DeviceContext>&
 		return resdir + L"shaders/" + name;
 	};
 
-	mShaderStretch = std::make_shared<Shader>(mDevice, mContext, ShaderPath(L"Stretch.vs.cso"), ShaderPath(L"Stretch.ps.cso"));
+	mShaderStretch = std::make_shared<Shader>(mDevice, mContext, ShaderPath(L"Stretch.vs.cso"), ShaderPath(L"Stretch.ps.cso"), VertexFormat::InputLayout());
 	mShaderWoundPatch = std::make_shared<Shader>(mDevice, mContext, ShaderPath(L"Pass.vs.cso"), ShaderPath(L"Patch.ps.cso"));
 }
 
@@ -159,8 +161,6 @@ std::shared_ptr<Target> Generator::GenerateStretch(std::shared_ptr<Entity>& mode
 	
 	mContext->IASetInputLayout(mShaderStretch->mInputLayout.Get());
 	mContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-	mContext->IASetIndexBuffer(model->mIndexBuffer.Get(), model->mIndexBufferFormat, model->mIndexBufferOffset);
-	mContext->IASetVertexBuffers(0, 1, model->mVertexBuffer.GetAddressOf(), &model->mVertexBufferStrides, &model->mVertexBufferOffset);
 	mContext->VSSetConstantBuffers(0, 1, vertexBuffer.GetAddressOf());
 	mContext->PSSetConstantBuffers(0, 1, pixelBuffer.GetAddressOf());
 	mContext->VSSetShader(mShaderStretch->mVertexShader.Get(), 0, 0);
@@ -169,7 +169,13 @@ std::shared_ptr<Target> Generator::GenerateStretch(std::shared_ptr<Entity>& mode
 	mContext->RSSetViewports(1, &viewport);
 	mContext->OMSetRenderTargets(1, target->mRenderTarget.GetAddressOf(), nullptr);
 	
-	mContext->DrawIndexed(model->IndexCount(), 0, 0);
+	for (const MeshChunk& chunk : model->mChunks->Chunks()) {
+		if (chunk.indexCount == 0) continue;
+
+		mContext->IASetIndexBuffer(chunk.indexBuffer.Get(), chunk.indexFormat, 0);
+		mContext->IASetVertexBuffers(0, 1, chunk.vertexBuffer.GetAddressOf(), &model->mVertexBufferStrides, &model->mVertexBufferOffset);
+		mContext->DrawIndexed(chunk.indexCount, 0, 0);
+	}
 
 	
 	if (!outname.empty()) {
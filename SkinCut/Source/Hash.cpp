@@ -1,5 +1,8 @@
 #include "Hash.hpp"
 
+#include <cmath>
+#include <cstring>
+
 #include "Structures.hpp"
 #include "Mathematics.hpp"
 
@@ -20,6 +23,20 @@ inline void HashCombine(std::uint32_t& seed, const T& v)
 }
 
 
+// Finalizer of splitmix64: full avalanche of a 64-bit key.
+inline std::uint64_t Mix64(std::uint64_t x)
+{
+	x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ull;
+	x ^= x >> 27; x *= 0x94d049bb133111ebull;
+	x ^= x >> 31;
+	return x;
+}
+
+// Quantization grid for position hashing (steps per unit). Equal positions always map
+// to the same cell (including -0 and +0); the exact comparison is left to the equality test.
+static const float cHashQuantization = 1048576.0f;
+
+
 std::uint32_t SkinCut::hash_vector2(Math::Vector2 const& p)
 {
 	std::uint32_t seed = 0;
@@ -49,6 +66,52 @@ std::uint32_t SkinCut::hash_vector4(Math::Vector4 const& p)
 
 
 
+std::uint64_t SkinCut::hash_position(Math::Vector3 const& p)
+{
+	std::uint64_t x = static_cast<std::uint64_t>(std::llround(p.x * cHashQuantization));
+	std::uint64_t y = static_cast<std::uint64_t>(std::llround(p.y * cHashQuantization));
+	std::uint64_t z = static_cast<std::uint64_t>(std::llround(p.z * cHashQuantization));
+	return Mix64(x ^ Mix64(y ^ Mix64(z)));
+}
+
+std::uint64_t SkinCut::hash_fingerprint(Math::Vector3 const& p, Math::Vector2 const& x)
+{
+	std::uint64_t u = static_cast<std::uint64_t>(std::llround(x.x * cHashQuantization));
+	std::uint64_t v = static_cast<std::uint64_t>(std::llround(x.y * cHashQuantization));
+	return Mix64(hash_position(p) ^ Mix64(u ^ Mix64(v)));
+}
+
+// Four independent lanes of 64-bit words, so the multiplications overlap; the lanes and
+// the tail bytes are folded together at the end.
+std::uint64_t SkinCut::hash_bytes(const void* data, std::size_t size)
+{
+	const std::uint64_t prime = 0x9e3779b97f4a7c15ull;
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+	std::uint64_t lane[4] = { prime, prime ^ 1, prime ^ 2, prime ^ 3 };
+	std::size_t i = 0;
+	for (; i + 32 <= size; i += 32) {
+		for (int k = 0; k < 4; ++k) {
+			std::uint64_t w;
+			std::memcpy(&w, bytes + i + k * 8, 8);
+			lane[k] = (lane[k] ^ w) * prime;
+			lane[k] ^= lane[k] >> 29;
+		}
+	}
+
+	std::uint64_t tail = 0;
+	std::memcpy(&tail, bytes + i, size - i > 8 ? 8 : size - i);
+	for (std::size_t j = i + 8; j < size; j += 8) {
+		std::uint64_t w = 0;
+		std::memcpy(&w, bytes + j, size - j > 8 ? 8 : size - j);
+		tail = Mix64(tail ^ w);
+	}
+
+	return Mix64(Mix64(Mix64(lane[0] ^ Mix64(lane[1])) ^ Mix64(lane[2] ^ Mix64(lane[3]))) ^ tail ^ size);
+}
+
+
+
 std::uint32_t IndexerHash::operator()(const Indexer& it) const
 {
 	std::uint32_t seed = 0;
@@ -83,46 +146,46 @@ bool VertexHash::operator()(const Vertex& v0, const Vertex& v1) const
 
 
 
-std::uint32_t NodeHash::operator()(const Node& n) const
+std::uint64_t NodeHash::Hash(const Node* n) const
 {
-	std::uint32_t seed = 0;
-	HashCombine(seed, hash_vector3(n.p));
-	return seed;
+	return hash_position((*positions)[n->id]);
 }
 
-std::uint32_t NodeHash::operator()(const Node* n) const
+std::size_t NodeHash::operator()(const Node& n) const
 {
-	std::uint32_t seed = 0;
-	HashCombine(seed, hash_vector3(n->p));
-	return seed;
+	return static_cast<std::size_t>(Hash(&n));
+}
+
+std::size_t NodeHash::operator()(const Node* n) const
+{
+	return static_cast<std::size_t>(Hash(n));
 }
 
 bool NodeHash::operator()(const Node& n0, const Node& n1) const
 {
-	return n0.p == n1.p;
+	return (*positions)[n0.id] == (*positions)[n1.id];
 }
 
 bool NodeHash::operator()(const Node* n0, const Node* n1) const
 {
-	return n0->p == n1->p;
+	return (*positions)[n0->id] == (*positions)[n1->id];
 }
 
 
 
-std::uint32_t EdgeHash::operator()(const Edge& e) const
+std::uint64_t EdgeHash::Hash(const Edge* e) const
 {
-	std::uint32_t seed = 0;
-	HashCombine(seed, e.n[0]);
-	HashCombine(seed, e.n[1]);
-	return seed;
+	return Mix64((std::uint64_t(e->n[0]->id) << 32) | e->n[1]->id);
 }
 
-std::uint32_t EdgeHash::operator()(const Edge* e) const
+std::size_t EdgeHash::operator()(const Edge& e) const
 {
-	std::uint32_t seed = 0;
-	HashCombine(seed, e->n[0]);
-	HashCombine(seed, e->n[1]);
-	return seed;
+	return static_cast<std::size_t>(Hash(&e));
+}
+
+std::size_t EdgeHash::operator()(const Edge* e) const
+{
+	return static_cast<std::size_t>(Hash(e));
 }
 
 bool EdgeHash::operator()(const Edge& e0, const Edge& e1) const
@@ -137,22 +200,19 @@ bool EdgeHash::operator()(const Edge* e0, const Edge* e1) const
 
 
 
-std::uint32_t FaceHash::operator()(const Face& f) const
+std::uint64_t FaceHash::Hash(const Face* f) const
 {
-	std::uint32_t seed = 0;
-	HashCombine(seed, f.n[0]);
-	HashCombine(seed, f.n[1]);
-	HashCombine(seed, f.n[2]);
-	return seed;
+	return Mix64(((std::uint64_t(f->n[0]->id) << 32) | f->n[1]->id) ^ Mix64(f->n[2]->id));
 }
 
-std::uint32_t FaceHash::operator()(const Face* f) const
+std::size_t FaceHash::operator()(const Face& f) const
 {
-	std::uint32_t seed = 0;
-	HashCombine(seed, f->n[0]);
-	HashCombine(seed, f->n[1]);
-	HashCombine(seed, f->n[2]);
-	return seed;
+	return static_cast<std::size_t>(Hash(&f));
+}
+
+std::size_t FaceHash::operator()(const Face* f) const
+{
+	return static_cast<std::size_t>(Hash(f));
 }
 
 bool FaceHash::operator()(const Face& f0, const Face& f1) const
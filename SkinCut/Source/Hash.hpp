@@ -1,5 +1,7 @@
 #pragma once
 
+#include <vector>
+#include <cstddef>
 #include <cstdint>
 
 
@@ -22,6 +24,10 @@ namespace SkinCut
 	std::uint32_t hash_vector3(Math::Vector3 const& v);
 	std::uint32_t hash_vector4(Math::Vector4 const& v);
 
+	std::uint64_t hash_position(Math::Vector3 const& p); // 64-bit hash of quantized position
+	std::uint64_t hash_fingerprint(Math::Vector3 const& p, Math::Vector2 const& x); // 64-bit hash of quantized position and texcoord
+	std::uint64_t hash_bytes(const void* data, std::size_t size); // 64-bit checksum of a block of memory (not cryptographic)
+
 
 	struct IndexerHash
 	{
@@ -35,26 +41,33 @@ namespace SkinCut
 		bool operator()(const Vertex& v0, const Vertex& v1) const;
 	};
 
-	struct NodeHash
+	struct NodeHash // nodes are keyed by their canonical position
 	{
-		std::uint32_t operator()(const Node& n) const;
-		std::uint32_t operator()(const Node* n) const;
+		const std::vector<Math::Vector3>* positions;
+
+		NodeHash(const std::vector<Math::Vector3>* p = nullptr) : positions(p) {}
+
+		std::uint64_t Hash(const Node* n) const; // 64-bit, for FlatTable
+		std::size_t operator()(const Node& n) const; // for std containers
+		std::size_t operator()(const Node* n) const;
 		bool operator()(const Node& n0, const Node& n1) const;
 		bool operator()(const Node* n0, const Node* n1) const;
 	};
 
-	struct EdgeHash
+	struct EdgeHash // edges are keyed by their node handles
 	{
-		std::uint32_t operator()(const Edge& e) const;
-		std::uint32_t operator()(const Edge* e) const;
+		std::uint64_t Hash(const Edge* e) const; // 64-bit, for FlatTable
+		std::size_t operator()(const Edge& e) const; // for std containers
+		std::size_t operator()(const Edge* e) const;
 		bool operator()(const Edge& e0, const Edge& e1) const;
 		bool operator()(const Edge* e0, const Edge* e1) const;
 	};
 
-	struct FaceHash
+	struct FaceHash // faces are keyed by their node handles
 	{
-		std::uint32_t operator()(const Face& f) const;
-		std::uint32_t operator()(const Face* f) const;
+		std::uint64_t Hash(const Face* f) const; // 64-bit, for FlatTable
+		std::size_t operator()(const Face& f) const; // for std containers
+		std::size_t operator()(const Face* f) const;
 		bool operator()(const Face& f0, const Face& f1) const;
 		bool operator()(const Face* f0, const Face* f1) const;
 	};
@@ -10,7 +10,14 @@
 #include <unordered_map>
 
 #include <io.h>
-#include <float.h> // _finite
+
+#include "FaceBvh.hpp"
+#include "MeshCache.hpp"
+#include "ObjParser.hpp"
+#include "AssetCache.hpp"
+#include "Parallel.hpp"
+#include "TangentFrame.hpp"
+#include "VertexCache.hpp"
 
 
 #pragma warning(disable: 4996) // unsafe stdio functions
@@ -30,376 +37,724 @@ using namespace SkinCut::Math;
 
 const float Mesh::cMaxEdgeLength = 0.5f;
 const float Mesh::cInfluenceRadius = 0.5f;
+const uint32_t Mesh::cNoSlot = 0xFFFFFFFF;
+const uint32_t Mesh::cMaxTombstones = 25;
 
 
-Mesh::Mesh(const std::wstring& name)
-{
-	mVertexes = std::vector<Vertex>();
-	mVertexTable = std::unordered_map<Vertex, uint32_t, VertexHash, VertexHash>();
-
-	mNodeArray = std::vector<Node*>();
-	mEdgeArray = std::vector<Edge*>();
-	mFaceArray = std::vector<Face*>();
-
-	mNodeTable = std::unordered_set<Node*, NodeHash, NodeHash>();
-	mEdgeTable = std::unordered_set<Edge*, EdgeHash, EdgeHash>();
-	mFaceTable = std::unordered_set<Face*, FaceHash, FaceHash>();
 
-	// Binary file name
-	std::wstring binname = name + std::wstring(L".bin");
+// Topology views keep a slot index per element handle, so removal is a constant-time
+// tombstone and the view is only compacted once enough tombstones have piled up.
 
-	// See if binary exists
-	if (GetFileAttributes(binname.c_str()) != INVALID_FILE_ATTRIBUTES) {
-		LoadMesh(binname);
-		GenerateTopology();
-	}
-	else { // otherwise, load from .obj file
-		ParseMesh(name, true);
-		GenerateTopology();
-		SaveMesh(binname); // write binary file
+template <class T>
+inline void Enlist(std::vector<T*>& view, std::vector<uint32_t>& slots, T* element)
+{
+	if (element->id >= slots.size()) {
+		slots.resize(element->id + 1, Mesh::cNoSlot);
 	}
+	slots[element->id] = static_cast<uint32_t>(view.size());
+	view.push_back(element);
 }
 
-
-Mesh::~Mesh() // need explicit destructor to clean up std::unique_ptr<Topology>
+template <class T>
+inline bool Delist(std::vector<T*>& view, std::vector<uint32_t>& slots, T* element)
 {
-	for (auto node : mNodeArray) {
-		if (node) {
-			delete node;
-			node = nullptr;
-		}
+	if (!element || element->id >= slots.size() || slots[element->id] == Mesh::cNoSlot) {
+		return false; // not listed
 	}
+	view[slots[element->id]] = nullptr;
+	slots[element->id] = Mesh::cNoSlot;
+	return true;
+}
 
-	for (auto edge : mEdgeArray) {
-		if (edge) {
-			delete edge;
-			edge = nullptr;
+template <class T>
+inline void Compact(std::vector<T*>& view, std::vector<uint32_t>& slots)
+{
+	uint32_t count = 0;
+	for (T* element : view) {
+		if (element) {
+			slots[element->id] = count;
+			view[count++] = element;
 		}
 	}
+	view.resize(count);
+}
+
+template <class T>
+inline bool Listed(const std::vector<uint32_t>& slots, const T* element)
+{
+	return element->id < slots.size() && slots[element->id] != Mesh::cNoSlot;
+}
 
-	for (auto face : mFaceArray) {
-		if (face) {
-			delete face;
-			face = nullptr;
+
+// Slot layout of a topology table, for storage. Erasing a key removes the first equal element,
+// which may be a coincident one, so a table can still refer to killed elements; such a table
+// is stored as rebuilt from the listed elements instead.
+template <class T, class H>
+inline void Layout(const FlatTable<T, H>& table, const H& hash, const std::vector<T*>& view, const std::vector<uint32_t>& slots, std::vector<uint32_t>& handles)
+{
+	table.Handles(handles);
+	for (uint32_t h : handles) {
+		if (h != FlatTable<T, H>::cNoHandle && (h >= slots.size() || slots[h] == Mesh::cNoSlot)) {
+			FlatTable<T, H> rebuilt(hash);
+			rebuilt.Reserve(table.Size());
+			for (T* element : view) {
+				if (element) rebuilt.Insert(element);
+			}
+			rebuilt.Handles(handles);
+			return;
 		}
 	}
+}
 
-	mNodeArray.clear();
-	mNodeTable.clear();
 
-	mEdgeArray.clear();
-	mEdgeTable.clear();
+// A journal notes each element touched by a transaction once, with its contents before the
+// first change. Entry indexes per handle are only trusted if the entry is for that handle,
+// so they never need to be cleared between transactions.
 
-	mFaceArray.clear();
-	mFaceTable.clear();
+template <class T>
+inline bool Record(std::vector<MeshDelta::Change<T>>& changes, std::vector<uint32_t>& entries, const std::vector<uint32_t>& slots, const T* element)
+{
+	if (element->id >= entries.size()) {
+		entries.resize(element->id + 1, Mesh::cNoSlot);
+	}
+
+	uint32_t entry = entries[element->id];
+	if (entry < changes.size() && changes[entry].before.id == element->id) {
+		return false; // already noted
+	}
+
+	entries[element->id] = static_cast<uint32_t>(changes.size());
+	changes.push_back({ *element, *element, Listed(slots, element), false });
+	return true;
 }
 
+template <class T>
+inline void Close(std::vector<MeshDelta::Change<T>>& changes, const Pool<T>& pool, const std::vector<uint32_t>& slots)
+{
+	for (auto& change : changes) {
+		const T* element = pool.Get(change.before.id);
+		change.after = *element;
+		change.listedAfter = Listed(slots, element);
+	}
+}
 
-void Mesh::RebuildIndexes()
+// Return an element to journaled contents; listing it again takes it back from the store.
+template <class T>
+inline void Apply(const T& contents, bool listed, Pool<T>& pool, std::vector<T*>& view, std::vector<uint32_t>& slots, uint32_t& tombstones)
 {
-	uint32_t i = 0;
-	mIndexes.clear();
-	mIndexes.resize(mFaceTable.size() * 3); // three indexes per face
+	T* element = pool.Get(contents.id);
+	*element = contents;
+
+	if (listed == Listed(slots, element)) return;
 
-	for (Face*& face : mFaceArray) {
-		mIndexes[i++] = face->v[0];
-		mIndexes[i++] = face->v[1];
-		mIndexes[i++] = face->v[2];
+	if (listed) {
+		pool.Acquire(element->id);
+		Enlist(view, slots, element);
+	}
+	else {
+		Delist(view, slots, element);
+		pool.Release(element);
+		tombstones++;
 	}
 }
 
+template <class T, class H>
+inline void Apply(const MeshDelta::TableChange& change, bool insert, Pool<T>& pool, FlatTable<T, H>& table)
+{
+	if (insert) {
+		table.InsertHashed(change.hash, pool.Get(change.id));
+	}
+	else {
+		table.EraseHashed(change.hash, pool.Get(change.id));
+	}
+}
 
-/*******************************************************************************
-Mesh loading
-*******************************************************************************/
 
-void Mesh::ParseMesh(const std::wstring& name, bool computeNormals)
+// Contents of a mesh source: a resource, a file or a file in the resource folder (mapped).
+struct MeshSource
 {
-	std::stringstream contents;
+	std::wstring path;
+	const char* data;
+	size_t size;
+	MappedFile file;
+};
 
+inline void OpenSource(const std::wstring& name, MeshSource& source)
+{
 	HMODULE mod = GetModuleHandle(nullptr);
 	HRSRC hrsrc = FindResource(mod, name.c_str(), RT_RCDATA);
 
 	if (hrsrc) { // load from resource
-		HGLOBAL res = LoadResource(GetModuleHandle(nullptr), hrsrc);
-		char* data = (char*)LockResource(res); // does not actually lock memory
-		if (!data) throw std::exception("Mesh loading error: Unable to find mesh file.");
-		contents = std::stringstream(data);
-	}
-	else { // try to load from file
-		std::ifstream file(name);
-
-		if (file) { // found
-			std::copy(std::istreambuf_iterator<char>(file), 
-				std::istreambuf_iterator<char>(), 
-				std::ostreambuf_iterator<char>(contents)); // copy contents to stringstream
+		HGLOBAL res = LoadResource(mod, hrsrc);
+		source.path = name;
+		source.data = (const char*)LockResource(res); // does not actually lock memory
+		source.size = SizeofResource(mod, hrsrc);
+		if (!source.data) throw std::exception("Mesh loading error: Unable to find mesh file.");
+	}
+	else if (source.file.Open(source.path = name) || source.file.Open(source.path = L"Resources\\" + name)) { // map file (or file in resource folder)
+		source.data = reinterpret_cast<const char*>(source.file.Data());
+		source.size = static_cast<size_t>(source.file.Size());
+	}
+	else {
+		throw std::exception("Mesh loading error: Unable to find mesh file");
+	}
+}
+
+
+size_t MeshDelta::Bytes() const
+{
+	return nodes.capacity() * sizeof(Change<Node>) + edges.capacity() * sizeof(Change<Edge>) + 
+	       faces.capacity() * sizeof(Change<Face>) + positions.capacity() * sizeof(positions[0]) + 
+	       tables.capacity() * sizeof(TableChange) + vertexes.capacity() * sizeof(Vertex);
+}
+
+
+Mesh::Mesh(const std::wstring& name)
+{
+	mVertexes = std::vector<Vertex>();
+	mVertexTable = VertexIndex(&mVertexes);
+
+	mNodeArray = std::vector<Node*>();
+	mEdgeArray = std::vector<Edge*>();
+	mFaceArray = std::vector<Face*>();
+	mTombstones = 0;
+	mIndexesStale = true;
+	mBvh = std::unique_ptr<FaceBvh>(new FaceBvh(*this));
+	mBvhStale = true;
+	mConnectAll = true;
+
+	mNodeTable = FlatTable<Node, NodeHash>(NodeHash(&mPositions));
+	mEdgeTable = FlatTable<Edge, EdgeHash>();
+	mFaceTable = FlatTable<Face, FaceHash>();
+
+	mTransactionDepth = 0;
+	mTransactionStats = TransactionStats();
+	mJournal = nullptr;
+	mRevision = 0;
+	mRevisions = 0;
+	mProbe = CreateNode(); // reserves a position slot used for lookups
+
+	// Source file (kept mapped until the mesh is loaded)
+	MeshSource source;
+	OpenSource(name, source);
+
+	// Load binary (geometry and topology) from the asset cache if it has an entry for these contents
+	std::wstring entry = AssetCache::Entry(source.path, source.data, source.size, MeshCache::cVersion);
+	if (!LoadMesh(entry)) { // otherwise, load from .obj file
+		ParseMesh(source.data, source.size, true);
+		GenerateTopology();
+		Connect();
+		SaveMesh(entry, true); // write binary file while the parsed mesh is in use
+	}
+}
+
+
+Mesh::~Mesh() // need explicit destructor to clean up std::unique_ptr<Topology>
+{
+	mNodeArray.clear();
+	mNodeTable.Clear();
+
+	mEdgeArray.clear();
+	mEdgeTable.Clear();
+
+	mFaceArray.clear();
+	mFaceTable.Clear();
+
+	// topology elements are owned by their stores
+	mNodePool.Clear();
+	mEdgePool.Clear();
+	mFacePool.Clear();
+	mPositions.clear();
+}
+
+
+void Mesh::RebuildIndexes(bool full)
+{
+	// Killed faces keep their slot (as a degenerate triangle) and new faces are appended,
+	// so only changed slots are written. Views are compacted once killed elements pile up.
+	size_t listed = mNodeArray.size() + mEdgeArray.size() + mFaceArray.size();
+	if (full || size_t(mTombstones) * 100 > listed * cMaxTombstones) {
+		Compact();
+	}
+
+	mIndexes.resize(mFaceArray.size() * 3); // three indexes per face slot
+
+	auto Write = [&](uint32_t slot) {
+		Face* face = mFaceArray[slot];
+		uint32_t* indexes = &mIndexes[slot * 3];
+		indexes[0] = face ? face->v[0] : 0;
+		indexes[1] = face ? face->v[1] : 0;
+		indexes[2] = face ? face->v[2] : 0;
+	};
+
+	mChangedIndexes.clear();
+
+	if (full || mIndexesStale) {
+		for (uint32_t slot = 0; slot < mFaceArray.size(); ++slot) {
+			Write(slot);
 		}
-		else { // not found
-			// try to load from resource folder
-			std::wstring meshname2 = std::wstring(L"Resources\\") + name;
-			file = std::ifstream(meshname2);
-
-			if (file) {
-				// copy contents to stringstream
-				std::copy(std::istreambuf_iterator<char>(file), 
-					std::istreambuf_iterator<char>(), 
-					std::ostreambuf_iterator<char>(contents));
+		mChangedIndexes.emplace_back(0, static_cast<uint32_t>(mIndexes.size()));
+	}
+	else {
+		// write dirty slots in order, noting runs of consecutive slots as changed ranges
+		std::sort(mDirtyFaces.begin(), mDirtyFaces.end());
+		mDirtyFaces.erase(std::unique(mDirtyFaces.begin(), mDirtyFaces.end()), mDirtyFaces.end());
+
+		for (uint32_t slot : mDirtyFaces) {
+			if (slot >= mFaceArray.size()) break; // (slots beyond the view were compacted away)
+			Write(slot);
+
+			if (!mChangedIndexes.empty() && mChangedIndexes.back().second == slot * 3) {
+				mChangedIndexes.back().second += 3;
 			}
 			else {
-				throw std::exception("Mesh loading error: Unable to find mesh file");
+				mChangedIndexes.emplace_back(slot * 3, slot * 3 + 3);
 			}
 		}
 	}
 
-	if (!contents) {
-		throw std::exception("Mesh loading error: Unable to read mesh file.");
-	}
+	mDirtyFaces.clear();
+	mIndexesStale = false;
+}
 
-	
-	// Parse file contents (and obtain arrays of vertexes and indexes)
-	char space;
-	uint32_t index = 0;
-	std::string word;
 
-	std::vector<Vector3> positions;
-	std::vector<Vector2> texCoords;
-	std::vector<Vector3> faceNormals;
+void Mesh::Compact()
+{
+	if (mTombstones == 0) return;
+
+	::Compact(mNodeArray, mNodeSlots);
+	::Compact(mEdgeArray, mEdgeSlots);
+	::Compact(mFaceArray, mFaceSlots);
+	mTombstones = 0;
+	mIndexesStale = true;
+	mBvhStale = true;
+}
 
-	std::vector<Indexer> indexers;	// obj vertex definition (indexes to position/texcoord/normal) [with duplicates]
-	std::unordered_map<Indexer, uint32_t, IndexerHash, IndexerHash> indexerMap; // unique indexers
 
-	// Direct3D uses a left-handed coordinate system. If you are porting an application that is based on 
-	// a right-handed coordinate system, you must make two changes to the data passed to Direct3D:
-	// 1. Flip the order of triangle vertices so that the system traverses them clockwise from the front. 
-	//    In other words, if the vertices are v0, v1, v2, pass them to Direct3D as v0, v2, v1.
-	// 2. Use the view matrix to scale world space by -1 in the z-direction. 
-	//    To do this, flip the sign of the _31, _32, _33, and _34 member of the view matrix structure.
+void Mesh::BeginTransaction(MeshDelta* journal)
+{
+	if (mTransactionDepth++ > 0) return; // nested
 
-	auto decr = [&](Indexer& indexer) -> void { // convert indices to zero-based format
-		indexer.pi--;
-		if (indexer.xi > 0) indexer.xi--;
-		if (indexer.ni > 0) indexer.ni--;
-	};
+	mTransactionStart = { mNodePool.Allocated(), mEdgePool.Allocated(), mFacePool.Allocated(), 
+	                      mNodePool.Recycled(), mEdgePool.Recycled(), mFacePool.Recycled() };
 
-	while (!contents.eof()) {
-		contents >> word;
-		if (!contents) break;
+	mJournal = journal;
+	if (mJournal) {
+		*mJournal = MeshDelta();
+		mJournal->revisionBefore = mRevision;
+		mJournal->vertexCount = static_cast<uint32_t>(mVertexes.size());
+	}
+}
 
-		if (word.compare("#") == 0) {
-			contents.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
-			continue;
-		}
-		else if (word.compare("v") == 0) {
-			float x, y, z;
-			contents >> x >> y >> z;
-			positions.push_back(Vector3(x, z, y)); // convert to left-handed
-		}
-		else if (word.compare("vn") == 0) {
-			float x, y, z;
-			contents >> x >> y >> z;
-			faceNormals.push_back(Vector3(x, z, y)); // convert to left-handed
-		}
-		else if (word.compare("vt") == 0) {
-			float u, v;
-			contents >> u >> v;
-			texCoords.push_back(Vector2(u, 1.f-v)); // convert to top-left
-		}
-		else if (word.compare("g") == 0) {
-			// group (mesh part)
-			contents.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
-			continue;
-		}
-		else if (word.compare("s") == 0) {
-			// smoothing group
-			contents.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
-			continue;
-		}
+void Mesh::EndTransaction()
+{
+	if (mTransactionDepth == 0 || --mTransactionDepth > 0) return; // nested
 
-		// faces must always be defined last, or the logic used here breaks down
-		if (word.compare("f") == 0) {
-			Indexer faceDef[3]{};
-			ZeroMemory(&faceDef[0], sizeof(Indexer)*3);
+	mTransactionStats.allocated = { uint32_t(mNodePool.Allocated() - mTransactionStart[0]), 
+	                                uint32_t(mEdgePool.Allocated() - mTransactionStart[1]), 
+	                                uint32_t(mFacePool.Allocated() - mTransactionStart[2]) };
+	mTransactionStats.recycled  = { uint32_t(mNodePool.Recycled() - mTransactionStart[3]), 
+	                                uint32_t(mEdgePool.Recycled() - mTransactionStart[4]), 
+	                                uint32_t(mFacePool.Recycled() - mTransactionStart[5]) };
+	mTransactionStats.killed    = { uint32_t(mKilledNodes.size()), uint32_t(mKilledEdges.size()), uint32_t(mKilledFaces.size()) };
 
-			for (auto& indexer : faceDef) {
-				// Supported formats:
-				// [v|vt|vn]	(vertex position | texcoord | normal)
-				// [v|vt]		(vertex position | texcoord)
-				// [v]			(vertex position)
+	mRevision = ++mRevisions;
+	if (mJournal) {
+		CloseJournal();
+		mJournal = nullptr;
+	}
 
-				if (!texCoords.empty() && !faceNormals.empty()) { // case 1
-					contents >> indexer.pi >> space >> indexer.xi >> space >> indexer.ni;
-					decr(indexer); // decrement indices to make them zero-based
-				}
-				else if (!texCoords.empty() && faceNormals.empty()) { // case 2
-					contents >> indexer.pi >> space >> indexer.xi;
-					decr(indexer);
-				}
-				else if (texCoords.empty() && faceNormals.empty()) { // case 3
-					contents >> indexer.pi;
-					decr(indexer);
-				}
-				else {
-					throw std::exception("Mesh loading error: Unsupported face definition format.");
-				}
-			}
+	Connect();
 
-			// convert from right-handed to left-handed system
-			std::swap(faceDef[1], faceDef[2]);
+	// killed elements are no longer referenced; recycle their storage
+	for (Node* node : mKilledNodes) ReleaseNode(node);
+	for (Edge* edge : mKilledEdges) ReleaseEdge(edge);
+	for (Face* face : mKilledFaces) ReleaseFace(face);
 
-			for (auto& indexer : faceDef) {
-				indexers.push_back(indexer);
+	mKilledNodes.clear();
+	mKilledEdges.clear();
+	mKilledFaces.clear();
+}
 
-				// insert indexer and increment index
-				auto entry = indexerMap.emplace(indexer, index);
 
-				if (entry.second) { // new indexer
-					mIndexes.push_back(index++);
+void Mesh::Undo(const MeshDelta& delta)
+{
+	if (mTransactionDepth > 0) {
+		throw std::exception("Mesh journal error: cannot undo during a topology transaction");
+	}
+	if (mRevision != delta.revisionAfter || mVertexes.size() != delta.vertexCount + delta.vertexes.size()) {
+		throw std::exception("Mesh journal error: delta does not apply to the current mesh");
+	}
 
-					if (index == (uint32_t)-1) {
-						throw std::exception("Mesh loading error: Too many indexes (mesh is too large).");
-					}
-				}
-				else { // indexer already exists
-					mIndexes.push_back(entry.first->second);
-				}
-			}
+	// hash table changes are reverted in reverse order
+	for (auto change = delta.tables.rbegin(); change != delta.tables.rend(); ++change) {
+		switch (change->table) {
+			case 0: Apply(*change, !change->insert, mNodePool, mNodeTable); break;
+			case 1: Apply(*change, !change->insert, mEdgePool, mEdgeTable); break;
+			case 2: Apply(*change, !change->insert, mFacePool, mFaceTable); break;
 		}
 	}
 
-	// Analyze the data that was read.
-	if (positions.empty()) { // Throw error if no positions are recorded.
-		throw std::exception("Mesh loading error: No vertices found.");
+	for (size_t i = 0; i < delta.nodes.size(); ++i) {
+		Apply(delta.nodes[i].before, delta.nodes[i].listedBefore, mNodePool, mNodeArray, mNodeSlots, mTombstones);
+		mPositions[delta.nodes[i].before.id] = delta.positions[i].first;
+	}
+	// (outside transactions, Record only notes elements for the connectivity update)
+	for (auto& change : delta.edges) {
+		Record(mEdgePool.Get(change.before.id));
+		Apply(change.before, change.listedBefore, mEdgePool, mEdgeArray, mEdgeSlots, mTombstones);
+	}
+	for (auto& change : delta.faces) {
+		Touch(mFacePool.Get(change.before.id));
+		Record(mFacePool.Get(change.before.id));
+		Apply(change.before, change.listedBefore, mFacePool, mFaceArray, mFaceSlots, mTombstones);
+		Touch(mFacePool.Get(change.before.id));
+		Record(mFacePool.Get(change.before.id));
 	}
 
-	// Compute normals, tangents and bitangents
-	std::vector<Vector3> normals(positions.size());
-	std::vector<Vector4> tangents(positions.size());
-	std::vector<Vector3> bitangents(positions.size());
+	// appended vertexes are removed from the end
+	for (uint32_t i = static_cast<uint32_t>(mVertexes.size()); i-- > delta.vertexCount;) {
+		mVertexTable.Erase(mVertexes[i], i);
+	}
+	mVertexes.resize(delta.vertexCount);
 
-	for (uint32_t i = 0; i < indexers.size(); i+=3) {
-		const Vector3 p1 = positions[indexers[i+0].pi];
-		const Vector3 p2 = positions[indexers[i+1].pi];
-		const Vector3 p3 = positions[indexers[i+2].pi];
+	mRevision = delta.revisionBefore;
+	Connect();
+}
 
-		const Vector2 uv1 = texCoords[indexers[i+0].xi];
-		const Vector2 uv2 = texCoords[indexers[i+1].xi];
-		const Vector2 uv3 = texCoords[indexers[i+2].xi];
 
-		if (faceNormals.empty() || computeNormals) {
-			// explicitly compute face normal
-			Vector3 facenormal = Vector3::Cross(p2-p1, p3-p1);
-			
-			normals[indexers[i+0].pi] += facenormal;
-			normals[indexers[i+1].pi] += facenormal;
-			normals[indexers[i+2].pi] += facenormal;
-		}
-		else {
-			// use face normals from obj file
-			normals[indexers[i+0].pi] += faceNormals[indexers[i+0].ni];
-			normals[indexers[i+1].pi] += faceNormals[indexers[i+1].ni];
-			normals[indexers[i+2].pi] += faceNormals[indexers[i+2].ni];
-		}
-		
-		// Compute tangent (http://www.terathon.com/code/tangent.html)
-		float x1 = (p2.x - p1.x), y1 = (p2.y - p1.y), z1 = (p2.z - p1.z);
-		float x2 = (p3.x - p1.x), y2 = (p3.y - p1.y), z2 = (p3.z - p1.z);
-		float s1 = (uv2.x - uv1.x), t1 = (uv2.y - uv1.y);
-		float s2 = (uv3.x - uv1.x), t2 = (uv3.y - uv1.y);
-
-		// inverse of the (s,t) matrix
-		float r = 1.0f / (s1 * t2 - s2 * t1);
-		if (!_finite(r)) {
-			r = 0.0f;
+void Mesh::Redo(const MeshDelta& delta)
+{
+	if (mTransactionDepth > 0) {
+		throw std::exception("Mesh journal error: cannot redo during a topology transaction");
+	}
+	if (mRevision != delta.revisionBefore || mVertexes.size() != delta.vertexCount) {
+		throw std::exception("Mesh journal error: delta does not apply to the current mesh");
+	}
+
+	for (auto& change : delta.tables) {
+		switch (change.table) {
+			case 0: Apply(change, change.insert, mNodePool, mNodeTable); break;
+			case 1: Apply(change, change.insert, mEdgePool, mEdgeTable); break;
+			case 2: Apply(change, change.insert, mFacePool, mFaceTable); break;
 		}
+	}
+
+	for (size_t i = 0; i < delta.nodes.size(); ++i) {
+		Apply(delta.nodes[i].after, delta.nodes[i].listedAfter, mNodePool, mNodeArray, mNodeSlots, mTombstones);
+		mPositions[delta.nodes[i].after.id] = delta.positions[i].second;
+	}
+	for (auto& change : delta.edges) {
+		Record(mEdgePool.Get(change.after.id));
+		Apply(change.after, change.listedAfter, mEdgePool, mEdgeArray, mEdgeSlots, mTombstones);
+	}
+	for (auto& change : delta.faces) {
+		Touch(mFacePool.Get(change.after.id));
+		Record(mFacePool.Get(change.after.id));
+		Apply(change.after, change.listedAfter, mFacePool, mFaceArray, mFaceSlots, mTombstones);
+		Touch(mFacePool.Get(change.after.id));
+		Record(mFacePool.Get(change.after.id));
+	}
 
-		// tangent points in the u texture direction
-		Vector4 tangent   = Vector4((t2 * x1 - t1 * x2) * r, (t2 * y1 - t1 * y2) * r, (t2 * z1 - t1 * z2) * r, 0);
+	for (const Vertex& vertex : delta.vertexes) {
+		mVertexTable.Insert(vertex, static_cast<uint32_t>(mVertexes.size()));
+		mVertexes.push_back(vertex);
+	}
 
-		// bitangent points in the v texture direction
-		Vector3 bitangent = Vector3((s1 * x2 - s2 * x1) * r, (s1 * y2 - s2 * y1) * r, (s1 * z2 - s2 * z1) * r);
+	mRevision = delta.revisionAfter;
+	Connect();
+}
 
-		tangents[indexers[i+0].pi] += tangent;
-		tangents[indexers[i+1].pi] += tangent;
-		tangents[indexers[i+2].pi] += tangent;
 
-		bitangents[indexers[i+0].pi] += bitangent;
-		bitangents[indexers[i+1].pi] += bitangent;
-		bitangents[indexers[i+2].pi] += bitangent;
+void Mesh::Save(MeshSnapshot& snapshot) const
+{
+	if (mTransactionDepth > 0) {
+		throw std::exception("Mesh snapshot error: cannot save during a topology transaction");
 	}
 
-	// Create vertexes from vertex definitions.
-	mVertexes.resize(indexerMap.size());
-	for (auto& indexer : indexerMap) {
-		Vertex vertex;
-		vertex.position = positions[indexer.first.pi];
-		vertex.texcoord = texCoords[indexer.first.xi];
+	snapshot.mesh = this;
 
-		// position index can be used because index order is equivalent
-		vertex.normal = Vector3::Normalize(normals[indexer.first.pi]); 
-		vertex.tangent = tangents[indexer.first.pi];
-		vertex.bitangent = bitangents[indexer.first.pi];
-		
-		Vector3 vertexTangent = Vector3(vertex.tangent.x, vertex.tangent.y, vertex.tangent.z);
+	snapshot.indexes = mIndexes;
+	snapshot.vertexes = mVertexes;
+	snapshot.vertexTable = mVertexTable;
+
+	mNodePool.Save(snapshot.nodePool);
+	mEdgePool.Save(snapshot.edgePool);
+	mFacePool.Save(snapshot.facePool);
+	snapshot.positions = mPositions;
 
-		// normalize and orthogonalize tangent with Gram-Schmidt
-		Vector3 tangent = Vector3::Normalize(vertexTangent - vertex.normal * Vector3::Dot(vertex.normal, vertexTangent));
+	snapshot.nodeArray = mNodeArray;
+	snapshot.edgeArray = mEdgeArray;
+	snapshot.faceArray = mFaceArray;
+	snapshot.nodeSlots = mNodeSlots;
+	snapshot.edgeSlots = mEdgeSlots;
+	snapshot.faceSlots = mFaceSlots;
+	snapshot.tombstones = mTombstones;
 
-		// handedness of bitangent = sign of determinant of TBN matrix
-		float handedness = Math::Sign(Vector3::Dot(Vector3::Cross(vertex.normal, vertexTangent), vertex.bitangent));
+	snapshot.nodeTable = mNodeTable;
+	snapshot.edgeTable = mEdgeTable;
+	snapshot.faceTable = mFaceTable;
+}
 
-		vertex.tangent = Vector4(tangent.x, tangent.y, tangent.z, handedness); // store bitangent handedness in alpha channel
 
-		mVertexes[indexer.second] = vertex;
+void Mesh::Restore(const MeshSnapshot& snapshot)
+{
+	if (snapshot.mesh != this) {
+		throw std::exception("Mesh snapshot error: snapshot belongs to another mesh");
 	}
+	if (mTransactionDepth > 0) {
+		throw std::exception("Mesh snapshot error: cannot restore during a topology transaction");
+	}
+
+	// element pointers refer to pool storage, which is restored in place
+	mIndexes = snapshot.indexes;
+	mVertexes = snapshot.vertexes;
+	mVertexTable = snapshot.vertexTable;
+
+	mNodePool.Restore(snapshot.nodePool);
+	mEdgePool.Restore(snapshot.edgePool);
+	mFacePool.Restore(snapshot.facePool);
+	mPositions = snapshot.positions;
+
+	mNodeArray = snapshot.nodeArray;
+	mEdgeArray = snapshot.edgeArray;
+	mFaceArray = snapshot.faceArray;
+	mNodeSlots = snapshot.nodeSlots;
+	mEdgeSlots = snapshot.edgeSlots;
+	mFaceSlots = snapshot.faceSlots;
+	mTombstones = snapshot.tombstones;
+
+	mNodeTable = snapshot.nodeTable;
+	mEdgeTable = snapshot.edgeTable;
+	mFaceTable = snapshot.faceTable;
+
+	mTransactionStats = TransactionStats();
+	mRevision = ++mRevisions;
+
+	mDirtyFaces.clear();
+	mIndexesStale = true;
+	mBvhFaces.clear();
+	mBvhStale = true;
+
+	mConnectAll = true;
+	Connect();
 }
 
 
-void Mesh::LoadMesh(const std::wstring& filename)
+
+/*******************************************************************************
+Mesh loading
+*******************************************************************************/
+
+void Mesh::ParseMesh(const char* data, size_t size, bool computeNormals)
 {
-	std::ifstream in(filename, std::ios::in | std::ios::binary);
-	if (!in) {
-		throw std::exception("Mesh loading error: Unable to find mesh file");
-	}
-	
-	uint32_t indexCount = 0;
-	uint32_t vertexCount = 0;
+	// Direct3D uses a left-handed coordinate system. If you are porting an application that is based on 
+	// a right-handed coordinate system, you must make two changes to the data passed to Direct3D:
+	// 1. Flip the order of triangle vertices so that the system traverses them clockwise from the front. 
+	//    In other words, if the vertices are v0, v1, v2, pass them to Direct3D as v0, v2, v1.
+	// 2. Use the view matrix to scale world space by -1 in the z-direction. 
+	//    To do this, flip the sign of the _31, _32, _33, and _34 member of the view matrix structure.
+	// The parser takes care of the first (and of swapping y and z).
+	ObjData obj;
+	ObjParser::Parse(data, size, obj);
+
+	// Compute normals and tangent frames, and create vertexes from vertex definitions
+	TangentFrame::Generate(obj, obj.indexes, computeNormals, mVertexes);
+	mIndexes = std::move(obj.indexes);
+
+	// Order triangles for the vertex cache and vertexes for fetching (topology is generated in
+	// this order, so the face view and the rebuilt indexes keep it)
+	VertexCache::OptimizeTriangles(mIndexes, mVertexes.size());
+	VertexCache::OptimizeFetch(mIndexes, mVertexes);
+}
+
 
-	mIndexes.clear();
-	in.read((char*)&indexCount, sizeof(uint32_t));
-	mIndexes.resize(indexCount);
-	for (uint32_t i = 0; i < indexCount; ++i) {
-		in.read((char*)&mIndexes[i], sizeof(uint32_t));
+bool Mesh::LoadMesh(const std::wstring& filename)
+{
+	if (mNodePool.Size() > 1 || mEdgePool.Size() > 0 || mFacePool.Size() > 0) { // (the probe node is always present)
+		throw std::exception("Mesh loading error: Mesh already has a topology.");
+	}
+
+	MeshCache cache;
+	if (!cache.Open(filename)) {
+		return false;
+	}
+
+	const uint32_t *indexes, *nodes, *nodeTable, *edgeTable, *faceTable, *twins, *outgoing;
+	const Vertex* vertexes;
+	const Vector3* positions;
+	const MeshCache::EdgeRecord* edges;
+	const MeshCache::FaceRecord* faces;
+	size_t indexCount, vertexCount, positionCount, nodeCount, edgeCount, faceCount, nodeSlots, edgeSlots, faceSlots, twinCount, outgoingCount;
+
+	if (!cache.Get(MeshCache::SECTION_INDEXES, indexes, indexCount) ||
+	    !cache.Get(MeshCache::SECTION_VERTEXES, vertexes, vertexCount) ||
+	    !cache.Get(MeshCache::SECTION_POSITIONS, positions, positionCount) ||
+	    !cache.Get(MeshCache::SECTION_NODES, nodes, nodeCount) ||
+	    !cache.Get(MeshCache::SECTION_EDGES, edges, edgeCount) ||
+	    !cache.Get(MeshCache::SECTION_FACES, faces, faceCount) ||
+	    !cache.Get(MeshCache::SECTION_NODE_TABLE, nodeTable, nodeSlots) ||
+	    !cache.Get(MeshCache::SECTION_EDGE_TABLE, edgeTable, edgeSlots) ||
+	    !cache.Get(MeshCache::SECTION_FACE_TABLE, faceTable, faceSlots) ||
+	    !cache.Get(MeshCache::SECTION_TWINS, twins, twinCount) ||
+	    !cache.Get(MeshCache::SECTION_OUTGOING, outgoing, outgoingCount)) {
+		return false;
+	}
+
+	// Check all handles before anything is built (the checksum does not protect against a faulty writer).
+	uint32_t edgeCapacity = 0, faceCapacity = 0;
+	for (size_t i = 0; i < edgeCount; ++i) edgeCapacity = std::max(edgeCapacity, edges[i].id + 1);
+	for (size_t i = 0; i < faceCount; ++i) faceCapacity = std::max(faceCapacity, faces[i].id + 1);
+	faceCapacity = std::max(faceCapacity, static_cast<uint32_t>(twinCount / 3)); // (half-edges of trailing killed faces)
+
+	auto Valid = [](uint32_t h, size_t capacity, bool optional = false) { return (optional && h == MeshCache::cNoHandle) || h < capacity; };
+	auto PowerOfTwo = [](size_t n) { return (n & (n - 1)) == 0; };
+	bool valid = positionCount > 0 && positionCount < MeshCache::cNoHandle && PowerOfTwo(nodeSlots) && PowerOfTwo(edgeSlots) && PowerOfTwo(faceSlots) &&
+	             twinCount == size_t(faceCapacity) * 3 && outgoingCount == positionCount;
+
+	for (size_t i = 0; i < nodeCount; ++i) {
+		valid &= Valid(nodes[i], positionCount) && nodes[i] != mProbe->id;
+	}
+	for (size_t i = 0; i < edgeCount && valid; ++i) {
+		const MeshCache::EdgeRecord& e = edges[i];
+		valid &= Valid(e.id, edgeCapacity) && Valid(e.n[0], positionCount) && Valid(e.n[1], positionCount) && Valid(e.f[0], faceCapacity, true) && Valid(e.f[1], faceCapacity, true) &&
+		         Valid(e.p[0], positionCount, true) && Valid(e.p[1], positionCount, true);
+	}
+	for (size_t i = 0; i < faceCount && valid; ++i) {
+		const MeshCache::FaceRecord& f = faces[i];
+		valid &= Valid(f.id, faceCapacity);
+		for (uint32_t k = 0; k < 3; ++k) {
+			valid &= Valid(f.v[k], vertexCount) && Valid(f.n[k], positionCount) && Valid(f.e[k], edgeCapacity);
+		}
 	}
+	for (size_t i = 0; i < indexCount; ++i) valid &= Valid(indexes[i], vertexCount);
+	for (size_t i = 0; i < nodeSlots; ++i) valid &= Valid(nodeTable[i], positionCount, true);
+	for (size_t i = 0; i < edgeSlots; ++i) valid &= Valid(edgeTable[i], edgeCapacity, true);
+	for (size_t i = 0; i < faceSlots; ++i) valid &= Valid(faceTable[i], faceCapacity, true);
+	for (size_t i = 0; i < twinCount; ++i) valid &= Valid(twins[i], twinCount, true);
+	for (size_t i = 0; i < outgoingCount; ++i) valid &= Valid(outgoing[i], twinCount, true);
 
-	mVertexes.clear();
-	in.read((char*)&vertexCount, sizeof(uint32_t));
-	mVertexes.resize(vertexCount);
-	for (uint32_t i = 0; i < vertexCount; ++i) {
-		in.read((char*)&mVertexes[i], sizeof(Vertex));
+	if (!valid) {
+		return false;
 	}
 
-	in.close();
-}
+	// The mapped sections have the in-memory layout, so each array is a single bulk copy.
+	mIndexes.assign(indexes, indexes + indexCount);
+	mVertexes.assign(vertexes, vertexes + vertexCount);
+	mPositions.assign(positions, positions + positionCount);
 
+	// Issue the stored handles, then fix up the references of each element in one pass.
+	mNodePool.Issue(static_cast<uint32_t>(positionCount));
+	mEdgePool.Issue(edgeCapacity);
+	mFacePool.Issue(faceCapacity);
 
-void Mesh::SaveMesh(const std::wstring& filename)
-{
-	std::ofstream out(filename, std::ios::out | std::ios::binary);
+	auto node = [&](uint32_t h) { return (h == MeshCache::cNoHandle) ? nullptr : mNodePool.Get(h); };
+	auto edge = [&](uint32_t h) { return (h == MeshCache::cNoHandle) ? nullptr : mEdgePool.Get(h); };
+	auto face = [&](uint32_t h) { return (h == MeshCache::cNoHandle) ? nullptr : mFacePool.Get(h); };
 
-	uint32_t indexCount = static_cast<uint32_t>(mIndexes.size());
-	uint32_t vertexCount = static_cast<uint32_t>(mVertexes.size());
+	mNodeArray.reserve(nodeCount);
+	for (size_t i = 0; i < nodeCount; ++i) {
+		Enlist(mNodeArray, mNodeSlots, node(nodes[i]));
+	}
 
-	out.write((char*)&indexCount, sizeof(uint32_t));
-	for (uint32_t i = 0; i < indexCount; ++i) {
-		out.write((char*)&mIndexes[i], sizeof(uint32_t));
+	mEdgeArray.reserve(edgeCount);
+	for (size_t i = 0; i < edgeCount; ++i) {
+		const MeshCache::EdgeRecord& record = edges[i];
+		Edge* e = edge(record.id);
+		e->n = { node(record.n[0]), node(record.n[1]) };
+		e->f = { face(record.f[0]), face(record.f[1]) };
+		e->p[0] = std::make_pair(node(record.p[0]), record.pv[0]);
+		e->p[1] = std::make_pair(node(record.p[1]), record.pv[1]);
+		Enlist(mEdgeArray, mEdgeSlots, e);
 	}
 
-	out.write((char*)&vertexCount, sizeof(uint32_t));
-	for (uint32_t i = 0; i < vertexCount; ++i) {
-		out.write((char*)&mVertexes[i], sizeof(Vertex));
+	mFaceArray.reserve(faceCount);
+	for (size_t i = 0; i < faceCount; ++i) {
+		const MeshCache::FaceRecord& record = faces[i];
+		Face* f = face(record.id);
+		f->v = { record.v[0], record.v[1], record.v[2] };
+		f->n = { node(record.n[0]), node(record.n[1]), node(record.n[2]) };
+		f->e = { edge(record.e[0]), edge(record.e[1]), edge(record.e[2]) };
+		Enlist(mFaceArray, mFaceSlots, f);
 	}
 
-	out.close();
+	// Handles not in a view belonged to killed elements; they can be reused.
+	mNodeSlots.resize(positionCount, cNoSlot);
+	mEdgeSlots.resize(edgeCapacity, cNoSlot);
+	mFaceSlots.resize(faceCapacity, cNoSlot);
+	for (uint32_t h = 0; h < positionCount; ++h) {
+		if (mNodeSlots[h] == cNoSlot && h != mProbe->id) mNodePool.Release(mNodePool.Get(h));
+	}
+	for (uint32_t h = 0; h < edgeCapacity; ++h) {
+		if (mEdgeSlots[h] == cNoSlot) mEdgePool.Release(mEdgePool.Get(h));
+	}
+	for (uint32_t h = 0; h < faceCapacity; ++h) {
+		if (mFaceSlots[h] == cNoSlot) mFacePool.Release(mFacePool.Get(h));
+	}
+
+	// Hash tables get their stored slot layout, so no element is probed for.
+	mNodeTable.Assign(nodeTable, nodeSlots, node);
+	mEdgeTable.Assign(edgeTable, edgeSlots, edge);
+	mFaceTable.Assign(faceTable, faceSlots, face);
+
+	// Connectivity is stored as is (it is up to date whenever the mesh can be saved).
+	mTwins.assign(twins, twins + twinCount);
+	mOutgoing.assign(outgoing, outgoing + outgoingCount);
+	mConnectAll = false;
+
+	return true;
+}
+
+
+void Mesh::SaveMesh(const std::wstring& filename, bool background)
+{
+	auto Handle = [](const auto* element) { return element ? element->id : MeshCache::cNoHandle; };
+
+	// Views are stored without their tombstones.
+	std::vector<uint32_t> nodes;
+	std::vector<MeshCache::EdgeRecord> edges;
+	std::vector<MeshCache::FaceRecord> faces;
+
+	for (Node* n : mNodeArray) {
+		if (n) nodes.push_back(n->id);
+	}
+	for (Edge* e : mEdgeArray) {
+		if (!e) continue;
+		edges.push_back({ e->id, { Handle(e->n[0]), Handle(e->n[1]) }, { Handle(e->f[0]), Handle(e->f[1]) },
+		                  { Handle(e->p[0].first), Handle(e->p[1].first) }, { e->p[0].second, e->p[1].second } });
+	}
+	for (Face* f : mFaceArray) {
+		if (!f) continue;
+		faces.push_back({ f->id, { f->v[0], f->v[1], f->v[2] }, { Handle(f->n[0]), Handle(f->n[1]), Handle(f->n[2]) },
+		                  { Handle(f->e[0]), Handle(f->e[1]), Handle(f->e[2]) } });
+	}
+
+	std::vector<uint32_t> nodeTable, edgeTable, faceTable;
+	Layout(mNodeTable, NodeHash(&mPositions), mNodeArray, mNodeSlots, nodeTable);
+	Layout(mEdgeTable, EdgeHash(), mEdgeArray, mEdgeSlots, edgeTable);
+	Layout(mFaceTable, FaceHash(), mFaceArray, mFaceSlots, faceTable);
+
+	MeshCache cache;
+	cache.Add(MeshCache::SECTION_INDEXES, mIndexes.data(), sizeof(uint32_t), mIndexes.size());
+	cache.Add(MeshCache::SECTION_VERTEXES, mVertexes.data(), sizeof(Vertex), mVertexes.size());
+	cache.Add(MeshCache::SECTION_POSITIONS, mPositions.data(), sizeof(Vector3), mPositions.size());
+	cache.Add(MeshCache::SECTION_NODES, nodes.data(), sizeof(uint32_t), nodes.size());
+	cache.Add(MeshCache::SECTION_EDGES, edges.data(), sizeof(MeshCache::EdgeRecord), edges.size());
+	cache.Add(MeshCache::SECTION_FACES, faces.data(), sizeof(MeshCache::FaceRecord), faces.size());
+	cache.Add(MeshCache::SECTION_NODE_TABLE, nodeTable.data(), sizeof(uint32_t), nodeTable.size());
+	cache.Add(MeshCache::SECTION_EDGE_TABLE, edgeTable.data(), sizeof(uint32_t), edgeTable.size());
+	cache.Add(MeshCache::SECTION_FACE_TABLE, faceTable.data(), sizeof(uint32_t), faceTable.size());
+	cache.Add(MeshCache::SECTION_TWINS, mTwins.data(), sizeof(HalfEdge), mTwins.size());
+	cache.Add(MeshCache::SECTION_OUTGOING, mOutgoing.data(), sizeof(HalfEdge), mOutgoing.size());
+
+	if (background) { // (the sections are copied, so the mesh may change while the file is written)
+		std::vector<uint8_t> file;
+		cache.Assemble(file);
+		AssetCache::Store(filename, std::move(file));
+	}
+	else {
+		cache.Save(filename);
+	}
 }
 
 
@@ -410,6 +765,8 @@ Mesh manipulation
 
 void Mesh::Subdivide(Face*& f, SplitType splitMode, Vector3& p)
 {
+	Transaction transaction(*this);
+
 	switch (splitMode) {
 		case SplitType::SPLIT3: {
 			Split3(f, p);
@@ -424,7 +781,6 @@ void Mesh::Subdivide(Face*& f, SplitType splitMode, Vector3& p)
 			Split4(f);
 			for (auto& nb : neighbors) {
 				Split2(nb.first, nb.second);
-				delete nb.second;
 			}
 			break;
 		}
@@ -437,7 +793,6 @@ void Mesh::Subdivide(Face*& f, SplitType splitMode, Vector3& p)
 			Split6(f);
 			for (auto& nb : neighbors) {
 				Split2(nb.first, nb.second);
-				delete nb.second;
 			}
 			break;
 		}
@@ -447,54 +802,76 @@ void Mesh::Subdivide(Face*& f, SplitType splitMode, Vector3& p)
 
 bool Mesh::RayIntersection(Ray& ray)
 {
-	// Iterate over the faces of the mesh.
-	for (auto face : mFaceArray) {
+	UpdateBvh();
+
+	// Visit the faces whose bounds the ray passes through, until one is hit.
+	bool hit = false;
+	mBvh->Traverse(ray, [&](Face* face, float&) {
 		float t, u, v;
 
-		Vector3 v0 = face->n[0]->p;
-		Vector3 v1 = face->n[1]->p;
-		Vector3 v2 = face->n[2]->p;
+		Vector3 v0 = Position(face->n[0]);
+		Vector3 v1 = Position(face->n[1]);
+		Vector3 v2 = Position(face->n[2]);
 
 		// Test whether the ray passes through the triangle face.
-		if (Math::RayTriangleIntersection(ray, Triangle(v0, v1, v2), t, u, v)) {
-			return true;
-		}
-	}
+		hit = Math::RayTriangleIntersection(ray, Triangle(v0, v1, v2), t, u, v) && t >= 0;
+		return hit;
+	});
 
-	return false;
+	return hit;
 }
 
 bool Mesh::RayIntersection(Ray& ray, Intersection& ix)
 {
-	// Find the closest intersection of the ray with the model.
-	bool hit = false;
-	float tmin = std::numeric_limits<float>::max();
-
-	for (auto face : mFaceArray) {
-		Vertex v0 = mVertexes[face->v[0]];
-		Vertex v1 = mVertexes[face->v[1]];
-		Vertex v2 = mVertexes[face->v[2]];
+	return RayIntersection(ray, ix, std::vector<Face*>());
+}
 
-		// Test whether the ray passes through the triangle face.
-		float t, u, v;
-		if (Math::RayTriangleIntersection(ray, Triangle(v0.position, v1.position, v2.position), t, u, v)) {
-			hit = true;
+bool Mesh::RayIntersection(Ray& ray, Intersection& ix, const std::vector<Face*>& hints)
+{
+	UpdateBvh();
 
-			// Replace if this intersection occurs earlier along the ray.
-			if (t < tmin) {
-				ix.dist = t;
+	FaceBvh::Hit hit;
+	hit.slot = FaceBvh::cNone;
+	hit.t = std::numeric_limits<float>::max();
 
-				// (x,y,z) = origin + (distance * direction)
-				ix.pos_os = ray.origin + (t * ray.direction);
-				ix.pos_ts = Vector2::Barycentric(v0.texcoord, v1.texcoord, v2.texcoord, u, v);
-				ix.face = face;
+	// Test the hinted faces in order until one is hit; the hierarchy then only has to be searched
+	// up to that distance (any closer face, or one as close earlier in the view, replaces it).
+	for (Face* face : hints) {
+		const Vertex& v0 = mVertexes[face->v[0]];
+		const Vertex& v1 = mVertexes[face->v[1]];
+		const Vertex& v2 = mVertexes[face->v[2]];
 
-				tmin = t;
-			}
+		float t, u, v;
+		if (Math::RayTriangleIntersection(ray, Triangle(v0.position, v1.position, v2.position), t, u, v) && t >= 0) {
+			hit = { mFaceSlots[face->id], t, u, v };
+			break;
 		}
 	}
 
-	return hit;
+	// Find the closest intersection of the ray with the model (the faces of each visited leaf
+	// of the hierarchy are tested at once).
+	mBvh->Closer(ray, hit);
+	if (hit.slot == FaceBvh::cNone) return false;
+
+	SetIntersection(ray, hit.slot, hit.t, hit.u, hit.v, ix);
+	return true;
+}
+
+
+bool Mesh::ClosestIntersection(const Ray& ray, Intersection& ix) const
+{
+	FaceBvh::Hit hit;
+	if (!mBvh->Closest(ray, hit)) return false;
+
+	SetIntersection(ray, hit.slot, hit.t, hit.u, hit.v, ix);
+	return true;
+}
+
+
+bool Mesh::Bounds(Vector3& lower, Vector3& upper)
+{
+	UpdateBvh();
+	return mBvh->Bounds(lower, upper);
 }
 
 
@@ -574,6 +951,8 @@ void Mesh::FormCutline(Intersection& i0, Intersection& i1, std::list<Link>& cutL
 
 void Mesh::FuseCutline(std::list<Link>& cutLine, std::vector<Edge*>& cutEdges)
 {
+	Transaction transaction(*this);
+
 	// N(p0) & N(p1) => p0=p1 or p0->p1 is f->e[0,1,2]
 	// N(p0) & E(p1) => split2(p1)
 	// N(p0) & F(p1) => split3(p1)
@@ -587,22 +966,20 @@ void Mesh::FuseCutline(std::list<Link>& cutLine, std::vector<Edge*>& cutEdges)
 	// F(p0) & F(p1) => split3(p0), split3(p1)
 
 	std::function<Node*(Vector3& p, Face*& f)> N = [&](Vector3& p, Face*& f) -> Node* {
-		if (Equal(p, f->n[0]->p)) return f->n[0];
-		if (Equal(p, f->n[1]->p)) return f->n[1];
-		if (Equal(p, f->n[2]->p)) return f->n[2];
+		if (Equal(p, Position(f->n[0]))) return f->n[0];
+		if (Equal(p, Position(f->n[1]))) return f->n[1];
+		if (Equal(p, Position(f->n[2]))) return f->n[2];
 		return nullptr;
 	};
 
 	std::function<Edge*(Vector3& p, Face*& f)> E = [&](Vector3& p, Face*& f) -> Edge* {
-		if (SegmentPointIntersection(f->n[0]->p, f->n[1]->p, p)) return f->e[0];
-		if (SegmentPointIntersection(f->n[1]->p, f->n[2]->p, p)) return f->e[1];
-		if (SegmentPointIntersection(f->n[0]->p, f->n[2]->p, p)) return f->e[2];
+		if (SegmentPointIntersection(Position(f->n[0]), Position(f->n[1]), p)) return f->e[0];
+		if (SegmentPointIntersection(Position(f->n[1]), Position(f->n[2]), p)) return f->e[1];
+		if (SegmentPointIntersection(Position(f->n[0]), Position(f->n[2]), p)) return f->e[2];
 		return nullptr;
 	};
 
 
-	std::unordered_set<Edge*, EdgeHash, EdgeHash> sides;
-
 	for (auto l = cutLine.begin(); l != cutLine.end(); ++l) {
 		Face*& f = l->f;
 		Vector3& p0 = l->p0;
@@ -641,14 +1018,12 @@ void Mesh::FuseCutline(std::list<Link>& cutLine, std::vector<Edge*>& cutEdges)
 
 			// 2. N(p0) & E(p1) => split2(p1)
 			else if (e1 = E(p1, f)) {
-				// mark edge for removal
-				sides.insert(e1);
-
 				// 2-split at p1
 				Edge* ec = nullptr;
 				Split2(f, e1, p1, &ec);
 
 				// add splitting edge to collection
+				Record(ec);
 				std::swap(ec->p[0], ec->p[1]); // reverse direction
 				std::swap(ec->f[0], ec->f[1]); // flip face references
 				cutEdges.push_back(ec);
@@ -676,6 +1051,7 @@ void Mesh::FuseCutline(std::list<Link>& cutLine, std::vector<Edge*>& cutEdges)
 				}
 
 				// add splitting edge to collection
+				Record(ec);
 				std::swap(ec->p[0], ec->p[1]); // reverse direction
 				std::swap(ec->f[0], ec->f[1]); // flip face references
 				cutEdges.push_back(ec);
@@ -686,9 +1062,6 @@ void Mesh::FuseCutline(std::list<Link>& cutLine, std::vector<Edge*>& cutEdges)
 		else if (e0 = E(p0, f)) {
 			// 4. E(p0) & N(p1) => split2(p0)
 			if (n1 = N(p1, f)) {
-				// mark edge for removal
-				sides.insert(e0);
-
 				// 2-split at p0
 				Edge* ec = nullptr;
 				Split2(f, e0, p0, &ec);
@@ -699,10 +1072,6 @@ void Mesh::FuseCutline(std::list<Link>& cutLine, std::vector<Edge*>& cutEdges)
 
 			// 5. E(p0) & E(p1) => split2(p1), split2(p0)
 			else if (e1 = E(p1, f)) {
-				// mark edges for removal
-				sides.insert(e0);
-				sides.insert(e1);
-
 				// 2-split at p1
 				Edge* ec = nullptr;
 				Split2(f, e1, p1, &ec);
@@ -719,9 +1088,6 @@ void Mesh::FuseCutline(std::list<Link>& cutLine, std::vector<Edge*>& cutEdges)
 
 			// 6. E(p0) & F(p1) => split3(p1), split2(p0)
 			else {
-				// mark edge for removal
-				sides.insert(e0);
-
 				// 3-split at p1
 				Edge *ec0, *ec1, *ec2;
 				Split3(f, p1, &ec0, &ec1, &ec2);
@@ -770,9 +1136,6 @@ void Mesh::FuseCutline(std::list<Link>& cutLine, std::vector<Edge*>& cutEdges)
 
 			// 8. F(p0) & E(p1) => split3(p0), split2(p1)
 			else if (e1 = E(p1, f)) {
-				// mark edge for removal
-				sides.insert(e1);
-
 				// 3-split at p0
 				Edge *ec0, *ec1, *ec2;
 				Split3(f, p0, &ec0, &ec1, &ec2);
@@ -788,6 +1151,7 @@ void Mesh::FuseCutline(std::list<Link>& cutLine, std::vector<Edge*>& cutEdges)
 				Split2(f, e1, p1, &ec);
 
 				// add splitting edge to collection
+				Record(ec);
 				std::swap(ec->p[0], ec->p[1]); // reverse direction
 				std::swap(ec->f[0], ec->f[1]); // flip face references
 				cutEdges.push_back(ec);
@@ -800,16 +1164,13 @@ void Mesh::FuseCutline(std::list<Link>& cutLine, std::vector<Edge*>& cutEdges)
 			}
 		}
 	}
-
-	// delete edges that have been split
-	for (auto edge : sides) {
-		delete edge;
-	}
 }
 
 
 void Mesh::OpenCutLine(std::vector<Edge*>& EC, Math::Quadrilateral& cutQuad, bool gutter)
 {
+	Transaction transaction(*this);
+
 	uint32_t nEC = static_cast<uint32_t>(EC.size());
 	if (EC.size() < 2) { return; }		// must have at least two segments
 
@@ -823,7 +1184,7 @@ void Mesh::OpenCutLine(std::vector<Edge*>& EC, Math::Quadrilateral& cutQuad, boo
 	// Compute length, depth, and cut opening displacement
 	float cutLength = 0.0f;
 	for (auto e : EC) {
-		cutLength += Vector3::Distance(e->n[0]->p, e->n[1]->p); cutLength *= 20; // convert to cm
+		cutLength += Vector3::Distance(Position(e->n[0]), Position(e->n[1])); cutLength *= 20; // convert to cm
 	}
 	float cutDepth = std::max(0.1f, std::min(1.0f, 0.2f*cutLength)); // min: 0.1cm (0.005 units), max: 1cm (0.05 units)
 
@@ -1019,31 +1380,42 @@ void Mesh::OpenCutLine(std::vector<Edge*>& EC, Math::Quadrilateral& cutQuad, boo
 	// Find all upper/lower faces
 	FaceSet FUT = FaceSet(FU.begin(), FU.end());
 	FaceSet FLT = FaceSet(FL.begin(), FL.end());
+
+	// vertexes of the cut edges
+	std::unordered_set<uint32_t> VC;
+	for (auto e : EC) {
+		VC.insert(e->p[0].second);
+		VC.insert(e->p[1].second);
+	}
+
+	// faces that reference a vertex of a cut edge (all lie in the face fans of its nodes)
+	FaceSet FC;
+	std::vector<Face*> fan;
+	for (auto e : EC) {
+		for (auto n : e->n) {
+			FaceFan(n, fan);
+			for (auto f : fan) {
+				if (VC.count(f->v[0]) || VC.count(f->v[1]) || VC.count(f->v[2])) { FC.insert(f); }
+			}
+		}
+	}
 	
-	std::function<void(Face*& f, std::unordered_set<Face*, FaceHash, FaceHash>& table)> AddFace = 
-		[&](Face*& f, std::unordered_set<Face*, FaceHash, FaceHash>& table) -> void
+	std::function<void(Face*& f, FaceSet& table)> AddFace = [&](Face*& f, FaceSet& table) -> void
 	{
+		if (!f) { return; } // (boundary)
 		if (FUT.find(f) != FUT.end()) { return; }
 		if (FLT.find(f) != FLT.end()) { return; }
+		if (FC.find(f) == FC.end()) { return; }
 
-		for (auto e : EC) {
-			for (uint8_t i = 0; i < 3; ++i) {
-				// add face to table if it references either vertex (or node) of ce
-				if (f->v[i] == e->p[0].second || f->v[i] == e->p[1].second) {
-					table.insert(f);
+		table.insert(f);
 
-					std::array<Face*,3> nbs;
-					Neighbors(f, nbs);
-
-					// continue with neighbors
-					if (nbs[0]) { AddFace(nbs[0], table); }
-					if (nbs[1]) { AddFace(nbs[1], table); }
-					if (nbs[2]) { AddFace(nbs[2], table); }
+		std::array<Face*,3> nbs;
+		Neighbors(f, nbs);
 
-					break;
-				}
-			}
-		}
+		// continue with neighbors
+		AddFace(nbs[0], table);
+		AddFace(nbs[1], table);
+		AddFace(nbs[2], table);
 	};
 
 	for (auto f : FU) { // find all upper faces
@@ -1092,22 +1464,25 @@ void Mesh::OpenCutLine(std::vector<Edge*>& EC, Math::Quadrilateral& cutQuad, boo
 
 		// update upper face references
 		for (auto f : FUT) {
+			Record(f);
 			for (uint8_t k = 0; k < 3; ++k) {
 				// update face-node references
 				if (f->n[k] == n0) { f->n[k] = n0u; }
 				if (f->n[k] == n1) { f->n[k] = n1u; }
 
 				// update face-vertex references
-				if (f->v[k] == v0) { f->v[k] = v0u; }
-				if (f->v[k] == v1) { f->v[k] = v1u; }
+				if (f->v[k] == v0) { f->v[k] = v0u; Touch(f); }
+				if (f->v[k] == v1) { f->v[k] = v1u; Touch(f); }
 
 				// update face-edge reference
 				if (f->e[k] == ec) {
+					Record(eu);
 					eu->f[0] = f;
 					f->e[k] = eu;
 				}
 				
 				// update edge-node references
+				Record(f->e[k]);
 				if (f->e[k]->n[0] == n0) { f->e[k]->n[0] = n0u; }
 				if (f->e[k]->n[1] == n0) { f->e[k]->n[1] = n0u; }
 				if (f->e[k]->n[0] == n1) { f->e[k]->n[0] = n1u; }
@@ -1117,22 +1492,25 @@ void Mesh::OpenCutLine(std::vector<Edge*>& EC, Math::Quadrilateral& cutQuad, boo
 
 		// update lower face references
 		for (auto f : FLT) {
+			Record(f);
 			for (uint8_t k = 0; k < 3; ++k) {
 				// update face-node references
 				if (f->n[k] == n0) { f->n[k] = n0l; }
 				if (f->n[k] == n1) { f->n[k] = n1l; }
 
 				// update face-vertex references
-				if (f->v[k] == v0) { f->v[k] = v0l; }
-				if (f->v[k] == v1) { f->v[k] = v1l; }
+				if (f->v[k] == v0) { f->v[k] = v0l; Touch(f); }
+				if (f->v[k] == v1) { f->v[k] = v1l; Touch(f); }
 
 				// update face-edge reference
 				if (f->e[k] == ec) {
+					Record(el);
 					el->f[0] = f;
 					f->e[k] = el;
 				}
 
 				// update edge-node references
+				Record(f->e[k]);
 				if (f->e[k]->n[0] == n0) { f->e[k]->n[0] = n0l; }
 				if (f->e[k]->n[1] == n0) { f->e[k]->n[1] = n0l; }
 				if (f->e[k]->n[0] == n1) { f->e[k]->n[0] = n1l; }
@@ -1450,16 +1828,9 @@ void Mesh::ChainFaces(std::list<Link>& chain, std::map<Link, std::vector<Face*>>
 
 void Mesh::Neighbors(Face*& f, std::array<Face*,3>& neighbors)
 {
-	for (uint8_t i = 0; i < 3; ++i) {
-		if (f->e[i]->f[0] == f) {
-			neighbors[i] = f->e[i]->f[1];
-		}
-		else if (f->e[i]->f[1] == f) {
-			neighbors[i] = f->e[i]->f[0];
-		}
-		else {
-			throw std::exception("Degenerate mesh detected!");
-		}
+	for (uint32_t k = 0; k < 3; ++k) {
+		HalfEdge t = Twin(f->id * 3 + k);
+		neighbors[k] = (t != cNoSlot) ? FaceOf(t) : nullptr;
 	}
 }
 
@@ -1533,7 +1904,7 @@ void Mesh::Split2(Face*& f, Edge*& es, Vector3 p, Edge** ec)
 
 	// Make sure n0 is to the left of the midpoint and n2 is to its right
 	Vector3 N = Vector3::Normalize(mVertexes[f->v[0]].normal + mVertexes[f->v[1]].normal + mVertexes[f->v[2]].normal);
-	Vector3 V = Vector3::Normalize(Vector3::Cross(n[1]->p - n[0]->p, n[2]->p - n[0]->p));
+	Vector3 V = Vector3::Normalize(Vector3::Cross(Position(n[1]) - Position(n[0]), Position(n[2]) - Position(n[0])));
 
 	if (Vector3::Dot(N, V) < 0) {
 		std::swap(n[0], n[2]);
@@ -1825,38 +2196,187 @@ Topology
 
 void Mesh::GenerateTopology()
 {
-	// Use list of indices to set up faces.
-	for (uint32_t i = 0; i < mIndexes.size(); i+=3) { // each triplet makes up a face
-		// Acquire indexes
-		uint32_t i0 = mIndexes[i+0];
-		uint32_t i1 = mIndexes[i+1];
-		uint32_t i2 = mIndexes[i+2];
+	// Built in bulk from sorted keys instead of element-wise table lookups. Elements are created
+	// in the order in which MakeNode, MakeEdge and MakeFace would create them face by face, so
+	// handles, views and table layouts are the same as for incremental construction.
+	if (mNodePool.Size() > 1 || mEdgePool.Size() > 0 || mFacePool.Size() > 0) { // (the probe node is always present)
+		throw std::exception("Mesh loading error: Mesh already has a topology.");
+	}
+
+	const uint32_t vertexCount = static_cast<uint32_t>(mVertexes.size());
+	const uint32_t cornerCount = static_cast<uint32_t>(mIndexes.size() / 3 * 3);
+	const uint32_t faceCount = cornerCount / 3;
+
+	// Runs of equal keys in sorted order, handled in parallel. A task takes the runs that start
+	// in its range of the sorted array.
+	auto ForRuns = [](const std::vector<uint64_t>& keys, const std::function<void(size_t, size_t)>& run) {
+		size_t count = keys.size();
+		Parallel::For(Parallel::Tasks(count, Parallel::cSortGrain), [&](uint32_t t) {
+			size_t begin = t * Parallel::cSortGrain;
+			size_t end = std::min(count, begin + Parallel::cSortGrain);
+			while (begin > 0 && begin < end && keys[begin] == keys[begin - 1]) ++begin;
+
+			for (size_t i = begin; i < end;) {
+				size_t j = i + 1;
+				while (j < count && keys[j] == keys[i]) ++j;
+				run(i, j);
+				i = j;
+			}
+		});
+	};
+
+
+	// Node welding: vertexes are sorted by quantized position (the node table hash), and within
+	// a run every vertex maps to the first vertex with the exact same position.
+	std::vector<uint64_t> keys(vertexCount);
+	std::vector<uint32_t> order(vertexCount);
+	Parallel::For(Parallel::Tasks(vertexCount, Parallel::cSortGrain), [&](uint32_t t) {
+		uint32_t end = std::min(vertexCount, uint32_t((t + 1) * Parallel::cSortGrain));
+		for (uint32_t v = uint32_t(t * Parallel::cSortGrain); v < end; ++v) {
+			keys[v] = hash_position(mVertexes[v].position);
+			order[v] = v;
+		}
+	});
+	Parallel::Sort(keys, order);
+
+	std::vector<uint32_t> weld(vertexCount);
+	ForRuns(keys, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			size_t j = begin;
+			while (j < i && mVertexes[order[j]].position != mVertexes[order[i]].position) ++j;
+			weld[order[i]] = order[j];
+		}
+	});
+
+	// Nodes are numbered in order of first use (handle 0 is the probe).
+	std::vector<uint32_t> nodeOf(vertexCount, cNoSlot);
+	std::vector<uint32_t> nodeVertexes;
+	for (uint32_t c = 0; c < cornerCount; ++c) {
+		uint32_t v = weld[mIndexes[c]];
+		if (nodeOf[v] == cNoSlot) {
+			nodeOf[v] = static_cast<uint32_t>(nodeVertexes.size()) + 1;
+			nodeVertexes.push_back(v);
+		}
+	}
+	const uint32_t nodeCount = static_cast<uint32_t>(nodeVertexes.size());
+
+	std::vector<uint32_t> cornerNodes(cornerCount);
+	for (uint32_t c = 0; c < cornerCount; ++c) {
+		cornerNodes[c] = nodeOf[weld[mIndexes[c]]];
+	}
+
+
+	// Edge records: one per face side (face * 3 + side), keyed by their (unordered) node pair.
+	keys.resize(cornerCount);
+	order.resize(cornerCount);
+	Parallel::For(Parallel::Tasks(cornerCount, Parallel::cSortGrain), [&](uint32_t t) {
+		uint32_t end = std::min(cornerCount, uint32_t((t + 1) * Parallel::cSortGrain));
+		for (uint32_t r = uint32_t(t * Parallel::cSortGrain); r < end; ++r) {
+			uint64_t a = cornerNodes[r];
+			uint64_t b = cornerNodes[r - r % 3 + (r + 1) % 3];
+			keys[r] = (std::min(a, b) << 32) | std::max(a, b);
+			order[r] = r;
+		}
+	});
+	Parallel::Sort(keys, order);
+
+	// Each run of records is an edge; its first two records give its faces (further faces of
+	// non-manifold edges are ignored). A face with the same node sequence as an earlier face is
+	// merged with it, so it is found among the records of its first side.
+	std::vector<uint32_t> runOf(cornerCount), faceRep(faceCount);
+	std::vector<uint8_t> first(cornerCount, 0);
+	ForRuns(keys, [&](size_t begin, size_t end) {
+		first[order[begin]] = 1;
+		for (size_t i = begin; i < end; ++i) {
+			uint32_t r = order[i];
+			runOf[r] = static_cast<uint32_t>(begin);
+			if (r % 3 != 0) continue;
+
+			uint32_t f = r / 3;
+			faceRep[f] = f;
+			for (size_t j = begin; j < i; ++j) {
+				uint32_t g = order[j] / 3;
+				if (order[j] % 3 == 0 && std::equal(&cornerNodes[g * 3], &cornerNodes[g * 3 + 3], &cornerNodes[f * 3])) {
+					faceRep[f] = faceRep[g];
+					break;
+				}
+			}
+		}
+	});
+
+	// Edges and faces are numbered in order of first use.
+	std::vector<uint32_t> edgeOf(cornerCount, cNoSlot), faceOf(faceCount);
+	uint32_t edgeCount = 0, uniqueFaceCount = 0;
+	for (uint32_t f = 0; f < faceCount; ++f) {
+		for (uint32_t r = f * 3; r < f * 3 + 3; ++r) {
+			if (first[r]) edgeOf[runOf[r]] = edgeCount++;
+		}
+		faceOf[f] = (faceRep[f] == f) ? uniqueFaceCount++ : faceOf[faceRep[f]];
+	}
+
+
+	// Create the elements and set their references.
+	mNodePool.Issue(nodeCount + 1);
+	mEdgePool.Issue(edgeCount);
+	mFacePool.Issue(uniqueFaceCount);
+	mPositions.resize(nodeCount + 1);
+
+	auto node = [&](uint32_t h) { return mNodePool.Get(h); };
+	auto edge = [&](uint32_t h) { return mEdgePool.Get(h); };
+	auto face = [&](uint32_t h) { return mFacePool.Get(h); };
+
+	for (uint32_t i = 0; i < nodeCount; ++i) {
+		mPositions[i + 1] = mVertexes[nodeVertexes[i]].position;
+	}
+
+	ForRuns(keys, [&](size_t begin, size_t end) {
+		uint32_t r = order[begin];
+		Edge* e = edge(edgeOf[begin]);
+
+		// (invariant for hashing: n0 comes geometrically before n1)
+		e->n = { node(cornerNodes[r]), node(cornerNodes[r - r % 3 + (r + 1) % 3]) };
+		if (Position(e->n[1]) < Position(e->n[0])) {
+			std::swap(e->n[0], e->n[1]);
+		}
 
-		// Acquire vertexes
-		Vertex& v0 = mVertexes[i0];
-		Vertex& v1 = mVertexes[i1];
-		Vertex& v2 = mVertexes[i2];
+		e->f[0] = face(faceOf[r / 3]);
+		e->f[1] = (end - begin > 1) ? face(faceOf[order[begin + 1] / 3]) : nullptr;
+	});
 
-		// Create nodes
-		Node* n0 = MakeNode(v0.position);
-		Node* n1 = MakeNode(v1.position);
-		Node* n2 = MakeNode(v2.position);
+	Parallel::For(Parallel::Tasks(faceCount, Parallel::cSortGrain), [&](uint32_t t) {
+		uint32_t end = std::min(faceCount, uint32_t((t + 1) * Parallel::cSortGrain));
+		for (uint32_t i = uint32_t(t * Parallel::cSortGrain); i < end; ++i) {
+			if (faceRep[i] != i) continue;
 
-		// Create edges
-		Edge* e0 = MakeEdge(n0, n1);
-		Edge* e1 = MakeEdge(n1, n2);
-		Edge* e2 = MakeEdge(n2, n0);
+			Face* f = face(faceOf[i]);
+			for (uint32_t k = 0; k < 3; ++k) {
+				f->v[k] = mIndexes[i * 3 + k];
+				f->n[k] = node(cornerNodes[i * 3 + k]);
+				f->e[k] = edge(edgeOf[runOf[i * 3 + k]]);
+			}
+		}
+	});
 
-		// Create face
-		Face* f = MakeFace(n0, n1, n2, i0, i1, i2);
 
-		// Register edges
-		RegisterEdge(e0, f);
-		RegisterEdge(e1, f);
-		RegisterEdge(e2, f);
+	// Views and tables, in handle (creation) order.
+	mNodeArray.reserve(nodeCount);
+	mEdgeArray.reserve(edgeCount);
+	mFaceArray.reserve(uniqueFaceCount);
+	mNodeTable.Reserve(vertexCount);
+	mEdgeTable.Reserve(faceCount * 3 / 2 + faceCount / 16);
+	mFaceTable.Reserve(faceCount);
 
-		// Register face
-		RegisterFace(f, e0, e1, e2);
+	for (uint32_t h = 1; h <= nodeCount; ++h) {
+		Enlist(mNodeArray, mNodeSlots, node(h));
+		mNodeTable.InsertHashed(mNodeTable.Hash(node(h)), node(h));
+	}
+	for (uint32_t h = 0; h < edgeCount; ++h) {
+		Enlist(mEdgeArray, mEdgeSlots, edge(h));
+		mEdgeTable.InsertHashed(mEdgeTable.Hash(edge(h)), edge(h));
+	}
+	for (uint32_t h = 0; h < uniqueFaceCount; ++h) {
+		Enlist(mFaceArray, mFaceSlots, face(h));
+		mFaceTable.InsertHashed(mFaceTable.Hash(face(h)), face(h));
 	}
 }
 
@@ -1871,10 +2391,10 @@ uint32_t Mesh::MakeVertex(Vector3& p, Vector2& x, Vector3& n, Vector4& t, Vector
 	vertex.bitangent = b;
 
 	uint32_t index = static_cast<uint32_t>(mVertexes.size());
-	auto entry = mVertexTable.emplace(vertex, index);
+	auto entry = mVertexTable.Insert(vertex, index);
 
 	if (!entry.second) {
-		index = entry.first->second; // already exists
+		index = entry.first; // already exists
 	}
 	else {
 		mVertexes.push_back(vertex);
@@ -1895,10 +2415,10 @@ uint32_t Mesh::MakeVertex(Vertex& v0, Vertex& v1)
 		vertex.bitangent, vertex.normal).Determinant()); // bitangent handedness
 
 	uint32_t index = static_cast<uint32_t>(mVertexes.size());
-	auto entry = mVertexTable.emplace(vertex, index);
+	auto entry = mVertexTable.Insert(vertex, index);
 
 	if (!entry.second) {
-		index = entry.first->second; // already exists
+		index = entry.first; // already exists
 	}
 	else {
 		mVertexes.push_back(vertex);
@@ -1922,10 +2442,10 @@ uint32_t Mesh::MakeVertex(Vertex& v0, Vertex& v1, Vector3 p)
 		vertex.bitangent, vertex.normal).Determinant()); // bitangent handedness
 
 	uint32_t index = static_cast<uint32_t>(mVertexes.size());
-	auto entry = mVertexTable.emplace(vertex, index);
+	auto entry = mVertexTable.Insert(vertex, index);
 
 	if (!entry.second) {
-		index = entry.first->second; // already exists
+		index = entry.first; // already exists
 	}
 	else {
 		mVertexes.push_back(vertex);
@@ -1945,10 +2465,10 @@ uint32_t Mesh::MakeVertex(Vertex& v0, Vertex& v1, Vertex& v2)
 	vertex.tangent.w = Math::Sign(Matrix(Vector3((const float*)vertex.tangent), vertex.bitangent, vertex.normal).Determinant());
 
 	uint32_t index = static_cast<uint32_t>(mVertexes.size());
-	auto entry = mVertexTable.emplace(vertex, index);
+	auto entry = mVertexTable.Insert(vertex, index);
 
 	if (!entry.second) {
-		index = entry.first->second; // already exists
+		index = entry.first; // already exists
 	}
 	else {
 		mVertexes.push_back(vertex);
@@ -1972,10 +2492,10 @@ uint32_t Mesh::MakeVertex(Vertex& v0, Vertex& v1, Vertex& v2, Vector3 p)
 	vertex.tangent.w = Math::Sign(Matrix(Vector3((const float*)vertex.tangent), vertex.bitangent, vertex.normal).Determinant());
 
 	uint32_t index = static_cast<uint32_t>(mVertexes.size());
-	auto entry = mVertexTable.emplace(vertex, index);
+	auto entry = mVertexTable.Insert(vertex, index);
 
 	if (!entry.second) {
-		index = entry.first->second; // already exists
+		index = entry.first; // already exists
 	}
 	else {
 		mVertexes.push_back(vertex);
@@ -1987,138 +2507,175 @@ uint32_t Mesh::MakeVertex(Vertex& v0, Vertex& v1, Vertex& v2, Vector3 p)
 
 Node* Mesh::MakeNode(Vector3& p)
 {
-	Node* node = new Node;
-	node->p = p;
-
-	auto entry = mNodeTable.insert(node);
-	if (!entry.second) { // already exists
-		delete node;
-		node = (*entry.first);
-	}
-	else {
-		mNodeArray.push_back(node);
+	// Look up before allocating
+	Position(mProbe) = p;
+	Node* entry = mNodeTable.Find(mProbe);
+	if (entry) { // already exists
+		return entry;
 	}
 
+	Node* node = CreateNode();
+	Position(node) = Position(mProbe);
+
+	mNodeTable.Insert(node);
+	Enlist(mNodeArray, mNodeSlots, node);
+	if (mJournal) Record(0, node->id, true, mNodeTable.Hash(node));
+
 	return node;
 }
 
 Node* Mesh::MakeNode(Node*& n0, Node*& n1)
 {
-	Node* node = new Node;
-	node->p = Vector3::Lerp(n0->p, n1->p, 0.5f);
-
-	auto entry = mNodeTable.insert(node);
-	if (!entry.second) { // already exists
-		delete node;
-		node = (*entry.first);
-	}
-	else {
-		mNodeArray.push_back(node);
-	}
-
-	return node;
+	Vector3 p = Vector3::Lerp(Position(n0), Position(n1), 0.5f);
+	return MakeNode(p);
 }
 
 Node* Mesh::MakeNode(Node*& n0, Node*& n1, Node*& n2)
 {
-	Node* node = new Node;
-	node->p = Vector3::Barycentric(n0->p, n1->p, n2->p, (float)Math::cOneThird, (float)Math::cOneThird);
-
-	auto entry = mNodeTable.insert(node);
-	if (!entry.second) { // already exists
-		delete node;
-		node = (*entry.first);
-	}
-	else {
-		mNodeArray.push_back(node);
-	}
-
-	return node;
+	Vector3 p = Vector3::Barycentric(Position(n0), Position(n1), Position(n2), (float)Math::cOneThird, (float)Math::cOneThird);
+	return MakeNode(p);
 }
 
 
 Edge* Mesh::MakeEdge(Node*& n0, Node*& n1)
 {
-	Edge* edge = new Edge;
-	edge->n[0] = n0;
-	edge->n[1] = n1;
-	edge->f[0] = nullptr;
-	edge->f[1] = nullptr;
+	Edge key;
+	key.n[0] = n0;
+	key.n[1] = n1;
 
 	// Invariant for hashing: n0 should come geometrically before n1
-	if (edge->n[1]->p < edge->n[0]->p) {
-		std::swap(edge->n[0], edge->n[1]);
+	if (Position(key.n[1]) < Position(key.n[0])) {
+		std::swap(key.n[0], key.n[1]);
 	}
 
-	auto entry = mEdgeTable.insert(edge); // automatically discards duplicates
-	if (!entry.second) { // already exists
-		delete edge;
-		edge = (*entry.first);
-	}
-	else {
-		mEdgeArray.push_back(edge);
+	// Look up before allocating
+	Edge* entry = mEdgeTable.Find(&key);
+	if (entry) { // already exists
+		return entry;
 	}
 
+	Edge* edge = CreateEdge();
+	edge->n = key.n;
+	edge->f[0] = nullptr;
+	edge->f[1] = nullptr;
+
+	mEdgeTable.Insert(edge);
+	Enlist(mEdgeArray, mEdgeSlots, edge);
+	if (mJournal) Record(1, edge->id, true, mEdgeTable.Hash(edge));
+
 	return edge;
 }
 
 Edge* Mesh::MakeEdge(Node*& n0, Node*& n1, uint32_t i0, uint32_t i1)
 {
-	Edge* edge = new Edge;
-	edge->n[0] = n0;
-	edge->n[1] = n1;
-	edge->f[0] = nullptr;
-	edge->f[1] = nullptr;
-	edge->p[0] = std::make_pair(n0, i0);
-	edge->p[1] = std::make_pair(n1, i1);
+	Edge key;
+	key.n[0] = n0;
+	key.n[1] = n1;
 
 	// Invariant for hashing: n0 should come geometrically before n1
-	if (edge->n[1]->p < edge->n[0]->p) {
-		std::swap(edge->n[0], edge->n[1]);
+	if (Position(key.n[1]) < Position(key.n[0])) {
+		std::swap(key.n[0], key.n[1]);
 	}
 
-	auto entry = mEdgeTable.insert(edge); // automatically discards duplicates
-	if (!entry.second) { // already exists
-		delete edge;
-		edge = (*entry.first);
-	}
-	else {
-		mEdgeArray.push_back(edge);
+	// Look up before allocating
+	Edge* entry = mEdgeTable.Find(&key);
+	if (entry) { // already exists
+		return entry;
 	}
 
+	Edge* edge = CreateEdge();
+	edge->n = key.n;
+	edge->f[0] = nullptr;
+	edge->f[1] = nullptr;
+	edge->p[0] = std::make_pair(n0, i0);
+	edge->p[1] = std::make_pair(n1, i1);
+
+	mEdgeTable.Insert(edge);
+	Enlist(mEdgeArray, mEdgeSlots, edge);
+	if (mJournal) Record(1, edge->id, true, mEdgeTable.Hash(edge));
+
 	return edge;
 }
 
 
 Face* Mesh::MakeFace(Node*& n0, Node*& n1, Node*& n2, uint32_t i0, uint32_t i1, uint32_t i2)
 {
-	Face* face = new Face;
+	Face key;
+	key.n[0] = n0;
+	key.n[1] = n1;
+	key.n[2] = n2;
+
+	// Look up before allocating
+	Face* entry = mFaceTable.Find(&key);
+	if (entry) { // already exists
+		return entry;
+	}
+
+	Face* face = CreateFace();
 	face->v[0] = i0;
 	face->v[1] = i1;
 	face->v[2] = i2;
-	face->n[0] = n0;
-	face->n[1] = n1;
-	face->n[2] = n2;
+	face->n = key.n;
 	face->e[0] = nullptr;
 	face->e[1] = nullptr;
 	face->e[2] = nullptr;
 
-	auto entry = mFaceTable.insert(face);
-	if (!entry.second) { // already exists
-		delete face;
-		face = (*entry.first);
-	}
-	else {
-		mFaceArray.push_back(face);
+	mFaceTable.Insert(face);
+	Enlist(mFaceArray, mFaceSlots, face);
+	Touch(face);
+	if (mJournal) Record(2, face->id, true, mFaceTable.Hash(face));
+
+	return face;
+}
+
+
+
+Node* Mesh::CreateNode()
+{
+	Node* node = mNodePool.Create();
+	if (node->id >= mPositions.size()) {
+		mPositions.resize(node->id + 1);
 	}
+	Record(node);
+	return node;
+}
 
+Edge* Mesh::CreateEdge()
+{
+	Edge* edge = mEdgePool.Create();
+	Record(edge);
+	return edge;
+}
+
+Face* Mesh::CreateFace()
+{
+	Face* face = mFacePool.Create();
+	Record(face);
 	return face;
 }
 
 
+void Mesh::ReleaseNode(Node*& n)
+{
+	mNodePool.Release(n);
+}
+
+void Mesh::ReleaseEdge(Edge*& e)
+{
+	mEdgePool.Release(e);
+}
+
+void Mesh::ReleaseFace(Face*& f)
+{
+	mFacePool.Release(f);
+}
+
+
 
 void Mesh::RegisterEdge(Edge*& e, Face*& f)
 {
+	Record(e);
+
 	if (e->f[0] == nullptr && e->f[1] == nullptr) {
 		e->f[0] = f; // set first face
 	}
@@ -2133,12 +2690,14 @@ void Mesh::RegisterEdge(Edge*& e, Face*& f)
 
 void Mesh::RegisterEdge(Edge*& e, Face*& f0, Face*& f1)
 {
+	Record(e);
 	e->f[0] = f0;
 	e->f[1] = f1;
 }
 
 void Mesh::RegisterFace(Face*& f, Edge*& e0, Edge*& e1, Edge*& e2)
 {
+	Record(f);
 	f->e[0] = e0;
 	f->e[1] = e1;
 	f->e[2] = e2;
@@ -2147,6 +2706,8 @@ void Mesh::RegisterFace(Face*& f, Edge*& e0, Edge*& e1, Edge*& e2)
 
 void Mesh::UpdateEdge(Edge*& e, Face*& f, Face*& fn)
 {
+	Record(e);
+
 	if (e->f[0] == f) {
 		e->f[0] = fn;
 	}
@@ -2162,13 +2723,12 @@ uint32_t Mesh::CopyVertex(Vertex& v)
 	Vertex vertex = v;
 
 	uint32_t index = static_cast<uint32_t>(mVertexes.size());
-	auto entry = mVertexTable.emplace(vertex, index);
+	auto entry = mVertexTable.Insert(vertex, index);
 
 	if (!entry.second) {
-		index = entry.first->second;
+		index = entry.first;
 	}
 	else {
-		mIndexes.push_back(index);
 		mVertexes.push_back(vertex);
 	}
 
@@ -2177,60 +2737,33 @@ uint32_t Mesh::CopyVertex(Vertex& v)
 
 Node* Mesh::CopyNode(Node*& n)
 {
-	Node* node = new Node;
-	node->p = n->p;
-
-	auto entry = mNodeTable.insert(node);
-	if (!entry.second) {
-		delete node;
-		node = (*entry.first);
-	}
-	else {
-		mNodeArray.push_back(node);
-	}
-
-	return node;
+	return MakeNode(Position(n));
 }
 
 Edge* Mesh::CopyEdge(Edge*& e)
 {
-	Edge* edge = new Edge;
-	edge->n[0] = CopyNode(e->n[0]);
-	edge->n[1] = CopyNode(e->n[1]);
-	edge->f[0] = nullptr;
-	edge->f[1] = nullptr;
-
-	if (edge->n[1]->p < edge->n[0]->p) {
-		std::swap(edge->n[0], edge->n[1]);
-	}
-
-	auto entry = mEdgeTable.insert(edge);
-	if (!entry.second) {
-		delete edge;
-		edge = (*entry.first);
-	}
-	else {
-		mEdgeArray.push_back(edge);
-	}
-
-	return edge;
+	Node* n0 = CopyNode(e->n[0]);
+	Node* n1 = CopyNode(e->n[1]);
+	return MakeEdge(n0, n1);
 }
 
 Face* Mesh::CopyFace(Face*& f)
 {
-	Face* face = new Face;
+	Face* face = CreateFace();
 	face->v[0] = f->v[0];
 	face->v[1] = f->v[1];
 	face->v[2] = f->v[2];
-	face->n[0] = MakeNode(f->n[0]->p);
-	face->n[1] = MakeNode(f->n[1]->p);
-	face->n[2] = MakeNode(f->n[2]->p);
+	face->n[0] = MakeNode(Position(f->n[0]));
+	face->n[1] = MakeNode(Position(f->n[1]));
+	face->n[2] = MakeNode(Position(f->n[2]));
 	face->e[0] = MakeEdge(f->n[0], f->n[1]);
 	face->e[1] = MakeEdge(f->n[1], f->n[2]);
 	face->e[2] = MakeEdge(f->n[2], f->n[0]);
 
-	mFaceTable.insert(face);
-	mFaceArray.push_back(face);
+	mFaceTable.Insert(face);
+	Enlist(mFaceArray, mFaceSlots, face);
+	Touch(face);
+	if (mJournal) Record(2, face->id, true, mFaceTable.Hash(face));
 
 	RegisterEdge(face->e[0], face);
 	RegisterEdge(face->e[1], face);
@@ -2242,22 +2775,331 @@ Face* Mesh::CopyFace(Face*& f)
 
 void Mesh::KillNode(Node*& n, bool del)
 {
-	mNodeTable.erase(n);
-	mNodeArray.erase(std::remove(mNodeArray.begin(), mNodeArray.end(), n), mNodeArray.end());
-	if (del && n) delete n;
+	if (n) Record(n);
+	Node* entry = mNodeTable.Erase(n);
+	if (entry && mJournal) Record(0, entry->id, false, mNodeTable.Hash(n));
+
+	if (Delist(mNodeArray, mNodeSlots, n)) {
+		mTombstones++;
+		if (!del || mTransactionDepth > 0) mKilledNodes.push_back(n); // recycle at end of transaction
+		else ReleaseNode(n);
+	}
+	else if (del && n && mTransactionDepth == 0) ReleaseNode(n);
 }
 
 void Mesh::KillEdge(Edge*& e, bool del)
 {
-	mEdgeTable.erase(e);
-	mEdgeArray.erase(std::remove(mEdgeArray.begin(), mEdgeArray.end(), e), mEdgeArray.end());
-	if (del && e) delete e;
+	if (e) Record(e);
+	Edge* entry = mEdgeTable.Erase(e);
+	if (entry && mJournal) Record(1, entry->id, false, mEdgeTable.Hash(e));
+
+	if (Delist(mEdgeArray, mEdgeSlots, e)) {
+		mTombstones++;
+		if (!del || mTransactionDepth > 0) mKilledEdges.push_back(e);
+		else ReleaseEdge(e);
+	}
+	else if (del && e && mTransactionDepth == 0) ReleaseEdge(e);
 }
 
 void Mesh::KillFace(Face*& f, bool del)
 {
-	mFaceTable.erase(f);
-	mFaceArray.erase(std::remove(mFaceArray.begin(), mFaceArray.end(), f), mFaceArray.end());
-	if (del && f) delete f;
+	if (f) { Record(f); Touch(f); }
+	Face* entry = mFaceTable.Erase(f);
+	if (entry && mJournal) Record(2, entry->id, false, mFaceTable.Hash(f));
+
+	if (Delist(mFaceArray, mFaceSlots, f)) {
+		mTombstones++;
+		if (!del || mTransactionDepth > 0) mKilledFaces.push_back(f);
+		else ReleaseFace(f);
+	}
+	else if (del && f && mTransactionDepth == 0) ReleaseFace(f);
+}
+
+
+
+void Mesh::Touch(Face* f)
+{
+	uint32_t slot = (f->id < mFaceSlots.size()) ? mFaceSlots[f->id] : cNoSlot;
+	if (slot == cNoSlot) return;
+
+	mDirtyFaces.push_back(slot);
+	mBvhFaces.push_back(slot);
+}
+
+
+void Mesh::UpdateBvh()
+{
+	if (mBvhStale) {
+		mBvh->Build();
+	}
+	else {
+		mBvh->Update(mBvhFaces);
+	}
+
+	mBvhFaces.clear();
+	mBvhStale = false;
+}
+
+
+void Mesh::SetIntersection(const Ray& ray, uint32_t slot, float t, float u, float v, Intersection& ix) const
+{
+	Face* face = mFaceArray[slot];
+	const Vertex& v0 = mVertexes[face->v[0]];
+	const Vertex& v1 = mVertexes[face->v[1]];
+	const Vertex& v2 = mVertexes[face->v[2]];
+
+	ix.dist = t;
+
+	// (x,y,z) = origin + (distance * direction)
+	ix.pos_os = ray.origin + (t * ray.direction);
+	ix.pos_ts = Vector2::Barycentric(v0.texcoord, v1.texcoord, v2.texcoord, u, v);
+	ix.face = face;
+}
+
+
+
+/*******************************************************************************
+Connectivity
+*******************************************************************************/
+
+HalfEdge Mesh::Twin(HalfEdge h)
+{
+	if (mConnectAll || !mStaleFaces.empty() || !mStaleEdges.empty()) Connect();
+	return mTwins[h];
+}
+
+
+HalfEdge Mesh::Outgoing(Node* n)
+{
+	if (mConnectAll || !mStaleFaces.empty() || !mStaleEdges.empty()) Connect();
+	return (n->id < mOutgoing.size()) ? mOutgoing[n->id] : cNoSlot;
+}
+
+
+void Mesh::FaceFan(Node* n, std::vector<Face*>& fan)
+{
+	fan.clear();
+
+	HalfEdge start = Outgoing(n);
+	if (start == cNoSlot) return;
+
+	// rotate around the node: the twin of an outgoing half-edge comes back into it
+	HalfEdge h = start;
+	do {
+		fan.push_back(FaceOf(h));
+		HalfEdge t = mTwins[h];
+		if (t == cNoSlot) break; // boundary
+		h = Next(t);
+	} while (h != start);
+}
+
+
+void Mesh::OneRing(Node* n, std::vector<Node*>& ring)
+{
+	ring.clear();
+
+	HalfEdge start = Outgoing(n);
+	if (start == cNoSlot) return;
+
+	HalfEdge h = start;
+	do {
+		ring.push_back(Target(h));
+		HalfEdge t = mTwins[h];
+		if (t == cNoSlot) { // boundary: the last face also has an edge into the node
+			ring.push_back(Origin(Prev(h)));
+			break;
+		}
+		h = Next(t);
+	} while (h != start);
+}
+
+
+bool Mesh::Boundary(Node* n)
+{
+	HalfEdge h = Outgoing(n);
+	return h == cNoSlot || mTwins[Prev(h)] == cNoSlot;
+}
+
+
+void Mesh::BoundaryLoop(HalfEdge h, std::vector<HalfEdge>& loop)
+{
+	loop.clear();
+	if (Twin(h) != cNoSlot) return; // not a boundary half-edge
+
+	HalfEdge start = h;
+	do {
+		loop.push_back(h);
+
+		// next boundary half-edge leaves the target of this one
+		h = Next(h);
+		while (mTwins[h] != cNoSlot) {
+			h = Next(mTwins[h]);
+		}
+	} while (h != start && loop.size() < mTwins.size());
 }
 
+
+void Mesh::Connect()
+{
+	// elements are visited in handle order (not address order), so the result does not depend on where the pools put them
+	auto ByHandle = [](const auto* a, const auto* b) { return a->id < b->id; };
+
+	mTwins.resize(size_t(mFacePool.Capacity()) * 3, cNoSlot);
+	mOutgoing.resize(mNodePool.Capacity(), cNoSlot);
+
+	if (mConnectAll) {
+		std::fill(mTwins.begin(), mTwins.end(), cNoSlot);
+		std::fill(mOutgoing.begin(), mOutgoing.end(), cNoSlot);
+
+		mStaleFaces.clear();
+		for (Face* f : mFaceArray) {
+			if (f) mStaleFaces.push_back(f);
+		}
+		mStaleEdges.clear();
+		mStaleNodes.clear();
+	}
+	else {
+		// faces on either side of a changed edge may have gained or lost a neighbor
+		for (Edge* e : mStaleEdges) {
+			if (!::Listed(mEdgeSlots, e)) continue;
+			if (e->f[0]) mStaleFaces.push_back(e->f[0]);
+			if (e->f[1]) mStaleFaces.push_back(e->f[1]);
+		}
+		std::sort(mStaleFaces.begin(), mStaleFaces.end(), ByHandle);
+		mStaleFaces.erase(std::unique(mStaleFaces.begin(), mStaleFaces.end()), mStaleFaces.end());
+	}
+
+	// detach changed faces from their neighbors
+	for (Face* f : mStaleFaces) {
+		for (HalfEdge h = f->id * 3; h < f->id * 3 + 3; ++h) {
+			HalfEdge t = mTwins[h];
+			if (t != cNoSlot && mTwins[t] == h) mTwins[t] = cNoSlot;
+			mTwins[h] = cNoSlot;
+		}
+	}
+
+	// attach the listed ones again, and give their nodes an outgoing half-edge
+	for (Face* f : mStaleFaces) {
+		if (!::Listed(mFaceSlots, f)) continue;
+
+		for (uint32_t k = 0; k < 3; ++k) {
+			Pair(f, k);
+
+			Node* n = f->n[k];
+			HalfEdge h = mOutgoing[n->id];
+			if (h == cNoSlot || !::Listed(mFaceSlots, FaceOf(h)) || Origin(h) != n) {
+				mOutgoing[n->id] = f->id * 3 + k;
+			}
+			mStaleNodes.push_back(n);
+		}
+	}
+
+	// start face fans after a boundary gap (if any), so that a fan is walked in one direction
+	std::sort(mStaleNodes.begin(), mStaleNodes.end(), ByHandle);
+	mStaleNodes.erase(std::unique(mStaleNodes.begin(), mStaleNodes.end()), mStaleNodes.end());
+
+	for (Node* n : mStaleNodes) {
+		HalfEdge start = mOutgoing[n->id];
+		if (start == cNoSlot) continue;
+
+		if (!::Listed(mFaceSlots, FaceOf(start)) || Origin(start) != n) { // node lost all faces
+			mOutgoing[n->id] = cNoSlot;
+			continue;
+		}
+
+		HalfEdge h = start;
+		for (HalfEdge t = mTwins[Prev(h)]; t != cNoSlot && t != start; t = mTwins[Prev(h)]) {
+			h = t;
+		}
+		mOutgoing[n->id] = h;
+	}
+
+	mStaleFaces.clear();
+	mStaleEdges.clear();
+	mStaleNodes.clear();
+	mConnectAll = false;
+}
+
+
+void Mesh::Pair(Face* f, uint32_t k)
+{
+	if (mTwins[f->id * 3 + k] != cNoSlot) return; // linked from the other side
+
+	Node* n0 = f->n[k];
+	Node* n1 = f->n[(k + 1) % 3];
+
+	// opposite half-edge runs the other way in a face across an edge of f (any edge: opening a
+	// cut moves the nodes of edges, so those of faces along it need not match their corners)
+	for (Edge* e : f->e) {
+		if (!e) continue;
+
+		for (Face* g : e->f) {
+			if (!g || g == f || !::Listed(mFaceSlots, g)) continue;
+
+			for (uint32_t j = 0; j < 3; ++j) {
+				if (g->n[j] == n1 && g->n[(j + 1) % 3] == n0 && mTwins[g->id * 3 + j] == cNoSlot) { // (taken: non-manifold edge)
+					mTwins[f->id * 3 + k] = g->id * 3 + j;
+					mTwins[g->id * 3 + j] = f->id * 3 + k;
+					return;
+				}
+			}
+		}
+	}
+}
+
+
+
+/*******************************************************************************
+Journal
+*******************************************************************************/
+
+void Mesh::Record(Node* n)
+{
+	if (!mJournal || n == mProbe) return;
+
+	if (::Record(mJournal->nodes, mNodeEntries, mNodeSlots, n)) {
+		mJournal->positions.push_back(std::make_pair(Position(n), Position(n)));
+	}
+}
+
+void Mesh::Record(Edge* e)
+{
+	if (!mConnectAll) mStaleEdges.push_back(e);
+
+	if (!mJournal) return;
+	::Record(mJournal->edges, mEdgeEntries, mEdgeSlots, e);
+}
+
+void Mesh::Record(Face* f)
+{
+	if (!mConnectAll) {
+		mStaleFaces.push_back(f);
+		if (::Listed(mFaceSlots, f)) { // (contents of unlisted faces may not be initialized)
+			mStaleNodes.insert(mStaleNodes.end(), f->n.begin(), f->n.end());
+		}
+	}
+
+	if (!mJournal) return;
+	::Record(mJournal->faces, mFaceEntries, mFaceSlots, f);
+}
+
+void Mesh::Record(uint8_t table, uint32_t id, bool insert, uint64_t hash)
+{
+	if (!mJournal) return;
+	mJournal->tables.push_back({ id, table, insert, hash });
+}
+
+
+void Mesh::CloseJournal()
+{
+	Close(mJournal->nodes, mNodePool, mNodeSlots);
+	Close(mJournal->edges, mEdgePool, mEdgeSlots);
+	Close(mJournal->faces, mFacePool, mFaceSlots);
+
+	for (size_t i = 0; i < mJournal->nodes.size(); ++i) {
+		mJournal->positions[i].second = mPositions[mJournal->nodes[i].after.id];
+	}
+
+	mJournal->vertexes.assign(mVertexes.begin() + mJournal->vertexCount, mVertexes.end());
+	mJournal->revisionAfter = mRevision;
+}
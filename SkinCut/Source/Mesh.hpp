@@ -13,6 +13,9 @@
 #include <wrl/client.h>
 
 #include "Hash.hpp"
+#include "Pool.hpp"
+#include "FlatTable.hpp"
+#include "VertexIndex.hpp"
 #include "Structures.hpp"
 #include "Mathematics.hpp"
 
@@ -20,48 +23,203 @@
 
 namespace SkinCut
 {
+	class Mesh;
+	class FaceBvh;
+
 	typedef std::list<Link> LinkList;
 	typedef std::map<Link, std::vector<Face*>> LinkFaceMap;
 	typedef std::unordered_set<Face*, FaceHash, FaceHash> FaceSet;
 
+	// Half-edge handle: corner k of face f (3 * f->id + k), directed from f->n[k] to f->n[(k+1) % 3].
+	typedef uint32_t HalfEdge;
+
+
+	struct TransactionStats // topology store activity of one transaction
+	{
+		std::array<uint32_t, 3> allocated;	// node/edge/face elements taken from fresh storage
+		std::array<uint32_t, 3> recycled;	// node/edge/face elements reused from killed ones
+		std::array<uint32_t, 3> killed;		// node/edge/face elements killed
+	};
+
+
+	struct MeshSnapshot // complete mesh state, restored by bulk copies (see Mesh::Restore)
+	{
+		const Mesh* mesh = nullptr;
+
+		std::vector<uint32_t> indexes;
+		std::vector<Vertex> vertexes;
+		VertexIndex vertexTable;
+
+		Pool<Node>::Snapshot nodePool;
+		Pool<Edge>::Snapshot edgePool;
+		Pool<Face>::Snapshot facePool;
+		std::vector<Math::Vector3> positions;
+
+		std::vector<Node*> nodeArray;
+		std::vector<Edge*> edgeArray;
+		std::vector<Face*> faceArray;
+		std::vector<uint32_t> nodeSlots;
+		std::vector<uint32_t> edgeSlots;
+		std::vector<uint32_t> faceSlots;
+		uint32_t tombstones;
+
+		FlatTable<Node, NodeHash> nodeTable;
+		FlatTable<Edge, EdgeHash> edgeTable;
+		FlatTable<Face, FaceHash> faceTable;
+	};
+
+
+	struct MeshDelta // journal of one topology transaction, replayed by Mesh::Undo and Mesh::Redo
+	{
+		template <class T>
+		struct Change // element contents at the start and end of the transaction
+		{
+			T before, after;
+			bool listedBefore, listedAfter; // part of the topology (or released)
+		};
+
+		struct TableChange // hash table insertion or removal, in transaction order
+		{
+			uint32_t id;
+			uint8_t table; // 0: node, 1: edge, 2: face
+			bool insert;
+			uint64_t hash;
+		};
+
+		uint64_t revisionBefore, revisionAfter; // mesh revisions the delta applies to
+
+		std::vector<Change<Node>> nodes; // touched elements (each element once)
+		std::vector<Change<Edge>> edges;
+		std::vector<Change<Face>> faces;
+		std::vector<std::pair<Math::Vector3, Math::Vector3>> positions; // node positions before/after (parallel to nodes)
+		std::vector<TableChange> tables;
+
+		uint32_t vertexCount; // number of vertexes before (vertexes are only appended)
+		std::vector<Vertex> vertexes; // appended vertexes
+
+		bool Empty() const { return nodes.empty() && edges.empty() && faces.empty() && vertexes.empty(); }
+		size_t Bytes() const;
+	};
+
 
 	class Mesh
 	{
+	public: // topology transaction
+		// Groups topology changes (e.g. fusing and opening a cut). Killed elements remain valid
+		// until the outermost transaction ends, after which their storage is recycled.
+		class Transaction
+		{
+		private:
+			Mesh& mMesh;
+
+		public:
+			Transaction(Mesh& mesh, MeshDelta* journal = nullptr) : mMesh(mesh) { mMesh.BeginTransaction(journal); }
+			~Transaction() { mMesh.EndTransaction(); }
+		};
+
+
 	public: // constants
 		static const float cMaxEdgeLength;
 		static const float cInfluenceRadius;
+		static const uint32_t cNoSlot;
+		static const uint32_t cMaxTombstones; // percentage of killed elements in views before compaction
 
 
 	public:
 		// mesh geometry / attributes
-		std::vector<uint32_t> mIndexes; // numfaces * 3
+		std::vector<uint32_t> mIndexes; // three per face view slot (degenerate for killed faces)
+		std::vector<std::pair<uint32_t, uint32_t>> mChangedIndexes; // index ranges [begin, end) written by the last RebuildIndexes
 		std::vector<Vertex> mVertexes;
-		std::unordered_map<Vertex, uint32_t, VertexHash, VertexHash> mVertexTable;
+		VertexIndex mVertexTable; // deduplicates vertexes created by topology changes
+
+		// mesh topology store (elements are addressed by 32-bit handles)
+		Pool<Node> mNodePool;
+		Pool<Edge> mEdgePool;
+		Pool<Face> mFacePool;
+		std::vector<Math::Vector3> mPositions; // canonical node positions, indexed by node handle
 
-		// mesh topology
+		// mesh topology views (killed elements leave a nullptr until the next compaction)
 		std::vector<Node*> mNodeArray; // continuous memory allows iteration to be fast
 		std::vector<Edge*> mEdgeArray;
 		std::vector<Face*> mFaceArray;
 
-		std::unordered_set<Node*, NodeHash, NodeHash> mNodeTable; // buckets allows individual lookups to be fast
-		std::unordered_set<Edge*, EdgeHash, EdgeHash> mEdgeTable;
-		std::unordered_set<Face*, FaceHash, FaceHash> mFaceTable;
+		std::vector<uint32_t> mNodeSlots; // element handle -> index in view (cNoSlot if not listed)
+		std::vector<uint32_t> mEdgeSlots;
+		std::vector<uint32_t> mFaceSlots;
+		uint32_t mTombstones; // number of nullptr entries in views
+
+		std::vector<uint32_t> mDirtyFaces; // face view slots changed since the last index rebuild
+		bool mIndexesStale; // face view slots moved; all indexes must be rebuilt
+
+		std::unique_ptr<FaceBvh> mBvh; // hierarchy of faces for ray queries (updated by them)
+		std::vector<uint32_t> mBvhFaces; // face view slots changed since the last hierarchy update
+		bool mBvhStale; // face view slots moved; the hierarchy must be rebuilt
+
+		FlatTable<Node, NodeHash> mNodeTable; // hash tables allow individual lookups to be fast
+		FlatTable<Edge, EdgeHash> mEdgeTable;
+		FlatTable<Face, FaceHash> mFaceTable;
+
+		// mesh topology transactions
+		uint32_t mTransactionDepth;
+		TransactionStats mTransactionStats; // statistics of the last completed transaction
+		uint64_t mRevision; // identifies the current mesh state (changes with every transaction)
+
+
+	private:
+		Node* mProbe; // lookup key for node positions
+		std::vector<Node*> mKilledNodes; // killed elements awaiting recycling
+		std::vector<Edge*> mKilledEdges;
+		std::vector<Face*> mKilledFaces;
+		std::array<uint64_t, 6> mTransactionStart; // pool counters at start of transaction
+
+		MeshDelta* mJournal; // journal of the current transaction (nullptr if not journaled)
+		std::vector<uint32_t> mNodeEntries; // element handle -> index in journal (valid if the entry has that handle)
+		std::vector<uint32_t> mEdgeEntries;
+		std::vector<uint32_t> mFaceEntries;
+		uint64_t mRevisions; // number of revisions issued
+
+		std::vector<HalfEdge> mTwins; // half-edge -> opposite half-edge (cNoSlot on boundaries)
+		std::vector<HalfEdge> mOutgoing; // node handle -> half-edge leaving the node (first of its face fan)
+		std::vector<Face*> mStaleFaces; // elements changed since connectivity was last updated
+		std::vector<Edge*> mStaleEdges;
+		std::vector<Node*> mStaleNodes;
+		bool mConnectAll; // connectivity must be rebuilt for all faces
 
 
 	public:
 		Mesh(const std::wstring& meshname);
 		~Mesh();
 
-		void ParseMesh(const std::wstring& meshname, bool computeNormals = false);
-		void LoadMesh(const std::wstring& filename);
-		void SaveMesh(const std::wstring& filename);
+		void ParseMesh(const char* data, size_t size, bool computeNormals = false); // contents of an .obj file
+		bool LoadMesh(const std::wstring& filename); // geometry, topology and connectivity; false if the binary cache is missing, stale or corrupt
+		void SaveMesh(const std::wstring& filename, bool background = false); // geometry, topology and connectivity (killed elements are left out); background stores it as an asset cache entry
+
+		void RebuildIndexes(bool full = false); // update triangle list (only changed faces, unless full)
+		void Compact(); // remove killed elements from topology views (moves face slots)
 
-		void RebuildIndexes(); // extract triangle list
+		void BeginTransaction(MeshDelta* journal = nullptr); // journal is only used by the outermost transaction
+		void EndTransaction();
+
+		void Undo(const MeshDelta& delta); // revert a journaled transaction (mesh must be at delta.revisionAfter)
+		void Redo(const MeshDelta& delta); // reapply a journaled transaction (mesh must be at delta.revisionBefore)
+
+		void Save(MeshSnapshot& snapshot) const; // copy current state
+		void Restore(const MeshSnapshot& snapshot); // return to saved state (snapshot must be of this mesh)
+
+		Math::Vector3& Position(const Node* n) { return mPositions[n->id]; }
+		const Math::Vector3& Position(const Node* n) const { return mPositions[n->id]; }
 
 
 	public: // mesh manipulation
-		bool RayIntersection(Math::Ray& ray); // any ray-face intersection
-		bool RayIntersection(Math::Ray& ray, Intersection& ix); // closest ray-face intersection
+		bool RayIntersection(Math::Ray& ray); // any ray-face intersection (in front of the ray origin)
+		bool RayIntersection(Math::Ray& ray, Intersection& ix); // closest ray-face intersection (in front of the ray origin)
+		bool RayIntersection(Math::Ray& ray, Intersection& ix, const std::vector<Face*>& hints); // same result, found sooner if a hinted (live) face near the front is hit (hints are tried in order)
+		bool Bounds(Math::Vector3& lower, Math::Vector3& upper); // of the faces rays can hit (false if there are none)
+
+		// Closest ray-face intersection as above, without bringing the face hierarchy up to date
+		// first, so queries can run on several threads at once (after UpdateBvh).
+		bool ClosestIntersection(const Math::Ray& ray, Intersection& ix) const;
+		void UpdateBvh(); // bring the face hierarchy up to date with the face view
 
 		void Subdivide(Face*& face, SplitType splitmode, Math::Vector3& point); // subdivide face
 
@@ -69,12 +227,28 @@ namespace SkinCut
 		void FuseCutline(std::list<Link>& cutline, std::vector<Edge*>& cutedges);
 		void OpenCutLine(std::vector<Edge*>& edges, Math::Quadrilateral& cutquad, bool gutter = true);
 
-		void Neighbors(Face*& f, std::array<Face*, 3>& nbs);
-		void Neighbors(Face*& f, std::array<std::pair<Face*, Edge*>, 3>& nbs);
+		void Neighbors(Face*& f, std::array<Face*, 3>& nbs); // faces across the half-edges of f (nullptr on boundaries)
+		void Neighbors(Face*& f, std::array<std::pair<Face*, Edge*>, 3>& nbs); // faces across the edges of f, with those edges
 		void ChainFaces(std::list<Link>& cutline, std::map<Link, std::vector<Face*>>& CF, float r);
 		void ChainFaces(std::list<Link>& cutline, std::map<Link, std::vector<Face*>>& CF0, std::map<Link, std::vector<Face*>>& CF1, float r0, float r1);
 
 
+	public: // connectivity (half-edges are derived from faces and updated after each transaction)
+		Face* FaceOf(HalfEdge h) { return mFacePool.Get(h / 3); }
+		Node* Origin(HalfEdge h) { return FaceOf(h)->n[h % 3]; }
+		Node* Target(HalfEdge h) { return FaceOf(h)->n[(h + 1) % 3]; }
+
+		static HalfEdge Next(HalfEdge h) { return h - h % 3 + (h + 1) % 3; }
+		static HalfEdge Prev(HalfEdge h) { return h - h % 3 + (h + 2) % 3; }
+		HalfEdge Twin(HalfEdge h); // opposite half-edge (cNoSlot on boundaries)
+		HalfEdge Outgoing(Node* n); // half-edge leaving the node (on boundaries, the one after the gap)
+
+		void FaceFan(Node* n, std::vector<Face*>& fan); // faces around a node, in order
+		void OneRing(Node* n, std::vector<Node*>& ring); // nodes adjacent to a node, in order
+		bool Boundary(Node* n); // node lies on a mesh boundary
+		void BoundaryLoop(HalfEdge h, std::vector<HalfEdge>& loop); // boundary half-edges around the hole of boundary half-edge h
+
+
 
 	private: // geometry
 		void Split2(Face*& f, Edge*& e0, Math::Vector3 p = Math::Vector3(), Edge** ec = nullptr);
@@ -101,6 +275,14 @@ namespace SkinCut
 
 		Face* MakeFace(Node*& n0, Node*& n1, Node*& n2, uint32_t i0, uint32_t i1, uint32_t i2);
 
+		Node* CreateNode(); // allocate from topology store
+		Edge* CreateEdge();
+		Face* CreateFace();
+
+		void ReleaseNode(Node*& n); // return to topology store
+		void ReleaseEdge(Edge*& e);
+		void ReleaseFace(Face*& f);
+
 		void RegisterEdge(Edge*& e, Face*& f0);
 		void RegisterEdge(Edge*& e, Face*& f0, Face*& f1);
 		void RegisterFace(Face*& f, Edge*& e0, Edge*& e1, Edge*& e2);
@@ -112,9 +294,24 @@ namespace SkinCut
 		Edge* CopyEdge(Edge*& e);
 		Face* CopyFace(Face*& f);
 
-		void KillNode(Node*& n, bool del = false);
+		void KillNode(Node*& n, bool del = false); // del: recycle now, unless a transaction is open (see Transaction)
 		void KillEdge(Edge*& e, bool del = false);
 		void KillFace(Face*& f, bool del = false);
+
+		void Touch(Face* f); // mark face slot as changed (ignored if the face is not listed)
+		void SetIntersection(const Math::Ray& ray, uint32_t slot, float t, float u, float v, Intersection& ix) const; // fill ix with a hit of the ray on a face view slot
+
+		void Connect(); // update half-edge connectivity of changed elements
+		void Pair(Face* f, uint32_t k); // connect corner k of a face to its opposite half-edge
+
+
+	private: // journal
+		void Record(Node* n); // note element contents before its first change in the transaction
+		void Record(Edge* e);
+		void Record(Face* f);
+		void Record(uint8_t table, uint32_t id, bool insert, uint64_t hash);
+
+		void CloseJournal(); // note element contents at the end of the transaction
 	};
 
 }
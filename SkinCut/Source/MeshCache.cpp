@@ -0,0 +1,204 @@
+#include "MeshCache.hpp"
+
+#include <fstream>
+#include <algorithm>
+
+#include "Hash.hpp"
+#include "Structures.hpp"
+
+
+using namespace SkinCut;
+
+
+
+const uint32_t MeshCache::cMagic = 0x434D4B53; // "SKMC"
+const uint32_t MeshCache::cVersion = 2;
+const uint32_t MeshCache::cAlignment = 64;
+const uint32_t MeshCache::cNoHandle = 0xFFFFFFFF;
+
+
+
+/*******************************************************************************
+Mapped file
+*******************************************************************************/
+
+MappedFile::MappedFile()
+: mFile(INVALID_HANDLE_VALUE), mMapping(nullptr), mData(nullptr), mSize(0)
+{
+}
+
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+
+bool MappedFile::Open(const std::wstring& filename)
+{
+	Close();
+
+	mFile = CreateFile(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (mFile == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(mFile, &size) || size.QuadPart <= 0) { // empty files cannot be mapped
+		Close();
+		return false;
+	}
+
+	mMapping = CreateFileMapping(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mMapping) {
+		mData = static_cast<const uint8_t*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+	}
+	if (!mData) {
+		Close();
+		return false;
+	}
+
+	mSize = static_cast<uint64_t>(size.QuadPart);
+	return true;
+}
+
+
+void MappedFile::Close()
+{
+	if (mData) UnmapViewOfFile(mData);
+	if (mMapping) CloseHandle(mMapping);
+	if (mFile != INVALID_HANDLE_VALUE) CloseHandle(mFile);
+
+	mFile = INVALID_HANDLE_VALUE;
+	mMapping = nullptr;
+	mData = nullptr;
+	mSize = 0;
+}
+
+
+
+/*******************************************************************************
+Mesh cache
+*******************************************************************************/
+
+MeshCache::MeshCache()
+: mHeader(nullptr), mSections(nullptr)
+{
+}
+
+
+void MeshCache::Add(uint32_t id, const void* data, uint32_t elementSize, uint64_t count)
+{
+	mSources.push_back({ { id, elementSize, count, 0 }, data });
+}
+
+
+void MeshCache::Save(const std::wstring& filename) const
+{
+	std::vector<uint8_t> file;
+	Assemble(file);
+
+	std::ofstream out(filename, std::ios::out | std::ios::binary);
+	if (!out) {
+		throw std::exception("Mesh cache error: Unable to create cache file.");
+	}
+	out.write(reinterpret_cast<const char*>(file.data()), file.size());
+	out.close();
+}
+
+
+void MeshCache::Assemble(std::vector<uint8_t>& file) const
+{
+	auto Align = [](uint64_t offset) { return (offset + cAlignment - 1) / cAlignment * cAlignment; };
+
+	// Lay out the sections behind the header and the section table.
+	std::vector<Section> sections;
+	uint64_t offset = Align(sizeof(Header) + mSources.size() * sizeof(Section));
+	for (const Source& source : mSources) {
+		Section section = source.section;
+		section.offset = offset;
+		sections.push_back(section);
+		offset = Align(offset + section.count * section.elementSize);
+	}
+
+	// Assemble the file in memory, so the checksum can be computed over the exact bytes written.
+	file.assign(static_cast<size_t>(offset), 0);
+	if (!sections.empty()) {
+		std::copy_n(reinterpret_cast<const uint8_t*>(sections.data()), sections.size() * sizeof(Section), file.data() + sizeof(Header));
+	}
+	for (size_t i = 0; i < mSources.size(); ++i) {
+		size_t bytes = static_cast<size_t>(sections[i].count * sections[i].elementSize);
+		if (bytes > 0) std::copy_n(static_cast<const uint8_t*>(mSources[i].data), bytes, file.data() + sections[i].offset);
+	}
+
+	Header header{};
+	header.magic = cMagic;
+	header.version = cVersion;
+	header.headerSize = sizeof(Header);
+	header.vertexSize = sizeof(Vertex);
+	header.sectionCount = static_cast<uint32_t>(sections.size());
+	header.fileSize = offset;
+	header.checksum = hash_bytes(file.data() + sizeof(Header), file.size() - sizeof(Header));
+	std::copy_n(reinterpret_cast<const uint8_t*>(&header), sizeof(Header), file.data());
+}
+
+
+bool MeshCache::Open(const std::wstring& filename)
+{
+	Close();
+
+	if (!mFile.Open(filename)) return false;
+
+	const uint8_t* data = mFile.Data();
+	uint64_t size = mFile.Size();
+
+	// header
+	const Header* header = reinterpret_cast<const Header*>(data);
+	if (size < sizeof(Header) || header->magic != cMagic || header->version != cVersion ||
+	    header->headerSize != sizeof(Header) || header->vertexSize != sizeof(Vertex) || header->fileSize != size) {
+		Close();
+		return false;
+	}
+
+	// section table and section bounds
+	const Section* sections = reinterpret_cast<const Section*>(data + sizeof(Header));
+	if (header->sectionCount > (size - sizeof(Header)) / sizeof(Section)) {
+		Close();
+		return false;
+	}
+	for (uint32_t i = 0; i < header->sectionCount; ++i) {
+		const Section& section = sections[i];
+		if (section.offset % cAlignment != 0 || section.offset > size ||
+		    (section.elementSize > 0 && section.count > (size - section.offset) / section.elementSize)) {
+			Close();
+			return false;
+		}
+	}
+
+	// contents
+	if (hash_bytes(data + sizeof(Header), static_cast<size_t>(size - sizeof(Header))) != header->checksum) {
+		Close();
+		return false;
+	}
+
+	mHeader = header;
+	mSections = sections;
+	return true;
+}
+
+
+void MeshCache::Close()
+{
+	mFile.Close();
+	mHeader = nullptr;
+	mSections = nullptr;
+}
+
+
+const MeshCache::Section* MeshCache::Find(uint32_t id) const
+{
+	if (!mHeader) return nullptr;
+
+	for (uint32_t i = 0; i < mHeader->sectionCount; ++i) {
+		if (mSections[i].id == id) return &mSections[i];
+	}
+	return nullptr;
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <windows.h>
+
+
+
+namespace SkinCut
+{
+	// Read-only view of a file mapped into memory.
+	class MappedFile
+	{
+	private:
+		HANDLE mFile;
+		HANDLE mMapping;
+		const uint8_t* mData;
+		uint64_t mSize;
+
+	public:
+		MappedFile();
+		~MappedFile();
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		bool Open(const std::wstring& filename); // false if the file is missing, empty or cannot be mapped
+		void Close();
+
+		const uint8_t* Data() const { return mData; }
+		uint64_t Size() const { return mSize; }
+	};
+
+
+	// Binary mesh cache. The file starts with a header and a section table, followed by the
+	// sections themselves; each section is a plain array that starts at a multiple of cAlignment,
+	// so a mapped cache file can be used in place without parsing.
+	//
+	// Layout (little endian):
+	//   Header                        magic, version, layout sizes, section count, file size, checksum
+	//   Section[count]                id, element size, element count, offset
+	//   section data                  each padded to cAlignment
+	//
+	// The checksum covers everything after the header. Caches with a different magic, version,
+	// vertex layout, size or checksum are rejected (see Open), so they are rebuilt instead of loaded.
+	class MeshCache
+	{
+	public: // constants
+		static const uint32_t cMagic;
+		static const uint32_t cVersion; // increment whenever the layout or the contents of a section change
+		static const uint32_t cAlignment;
+		static const uint32_t cNoHandle;
+
+		enum SectionId : uint32_t
+		{
+			SECTION_INDEXES = 1,		// uint32_t per index
+			SECTION_VERTEXES = 2,		// Vertex per vertex
+			SECTION_POSITIONS = 3,		// Vector3 per node handle
+			SECTION_NODES = 4,			// uint32_t handle per node view entry
+			SECTION_EDGES = 5,			// EdgeRecord per edge view entry
+			SECTION_FACES = 6,			// FaceRecord per face view entry
+			SECTION_NODE_TABLE = 7,		// uint32_t handle per node table slot
+			SECTION_EDGE_TABLE = 8,		// uint32_t handle per edge table slot
+			SECTION_FACE_TABLE = 9,		// uint32_t handle per face table slot
+			SECTION_TWINS = 10,			// uint32_t opposite half-edge per half-edge
+			SECTION_OUTGOING = 11		// uint32_t outgoing half-edge per node handle
+		};
+
+		// Topology elements with their references stored as handles (cNoHandle for none).
+		struct EdgeRecord
+		{
+			uint32_t id;
+			uint32_t n[2];		// nodes
+			uint32_t f[2];		// faces
+			uint32_t p[2];		// endpoint nodes
+			uint32_t pv[2];		// endpoint vertexes
+		};
+
+		struct FaceRecord
+		{
+			uint32_t id;
+			uint32_t v[3];		// vertexes
+			uint32_t n[3];		// nodes
+			uint32_t e[3];		// edges
+		};
+
+
+	private:
+		struct Header
+		{
+			uint32_t magic;
+			uint32_t version;
+			uint32_t headerSize;
+			uint32_t vertexSize; // sizeof(Vertex) of the writer
+			uint32_t sectionCount;
+			uint32_t reserved;
+			uint64_t fileSize;
+			uint64_t checksum;
+		};
+
+		struct Section
+		{
+			uint32_t id;
+			uint32_t elementSize;
+			uint64_t count;
+			uint64_t offset; // from the start of the file
+		};
+
+		struct Source // section to be written
+		{
+			Section section;
+			const void* data;
+		};
+
+		MappedFile mFile;
+		const Header* mHeader;
+		const Section* mSections;
+		std::vector<Source> mSources;
+
+
+	public:
+		MeshCache();
+
+		// Writing: add sections (data must stay valid until Save), then save.
+		void Add(uint32_t id, const void* data, uint32_t elementSize, uint64_t count);
+		void Save(const std::wstring& filename) const;
+		void Assemble(std::vector<uint8_t>& file) const; // contents of the file Save writes
+
+		// Reading: map and validate a cache file, then read its sections in place.
+		bool Open(const std::wstring& filename); // false if the cache is missing, stale or corrupt
+		void Close();
+
+		template <class T>
+		bool Get(uint32_t id, const T*& data, size_t& count) const // false if the section is absent or of another type
+		{
+			const Section* section = Find(id);
+			if (!section || section->elementSize != sizeof(T)) return false;
+			data = reinterpret_cast<const T*>(mFile.Data() + section->offset);
+			count = static_cast<size_t>(section->count);
+			return true;
+		}
+
+	private:
+		const Section* Find(uint32_t id) const;
+	};
+}
@@ -0,0 +1,401 @@
+#include "MeshChunks.hpp"
+
+#include <limits>
+#include <cstring>
+#include <algorithm>
+
+#include "Bvh.hpp"
+#include "Mesh.hpp"
+#include "VertexCache.hpp"
+#include "VertexFormat.hpp"
+
+
+using namespace SkinCut;
+using namespace SkinCut::Math;
+
+
+
+const uint32_t MeshChunks::cMaxFaces = 1 << 14;
+const uint32_t MeshChunks::cMaxUnused = 50;
+const uint32_t MeshChunks::cNone = 0xFFFFFFFF;
+
+
+
+namespace
+{
+	constexpr uint32_t cLeaf = 3; // axis of leaf nodes
+	constexpr uint32_t cMaxShortVertexes = 1 << 16; // vertexes addressable by 16-bit indexes
+
+
+	Vector3 Centroid(const Mesh& mesh, const Face& face)
+	{
+		return (mesh.mVertexes[face.v[0]].position + mesh.mVertexes[face.v[1]].position + mesh.mVertexes[face.v[2]].position) * (1.0f / 3.0f);
+	}
+}
+
+
+
+MeshChunks::MeshChunks(ComPtr<ID3D11Device>& device, const Mesh& mesh)
+: mDevice(device)
+{
+	std::vector<Vector3> centroids;
+	centroids.reserve(mesh.mFaceArray.size());
+	for (Face* face : mesh.mFaceArray) {
+		if (face) centroids.push_back(Centroid(mesh, *face));
+	}
+
+	Partition(centroids, 0, centroids.size());
+
+	// (the buffer bindings of the chunks must not move once uploads refer to them)
+	for (MeshChunk& chunk : mChunks) {
+		mVertexUploads.push_back(std::unique_ptr<UploadPlanner>(new UploadPlanner(std::unique_ptr<UploadTarget>(
+			new DeviceBuffer(mDevice, chunk.vertexBuffer, D3D11_USAGE_DYNAMIC, D3D11_BIND_VERTEX_BUFFER)))));
+		mIndexUploads.push_back(std::unique_ptr<UploadPlanner>(new UploadPlanner(std::unique_ptr<UploadTarget>(
+			new DeviceBuffer(mDevice, chunk.indexBuffer, D3D11_USAGE_DEFAULT, D3D11_BIND_INDEX_BUFFER)))));
+	}
+
+	mLayouts.resize(mChunks.size());
+	mDirty.assign(mChunks.size(), false);
+	mOrdered.assign(mChunks.size(), false);
+}
+
+
+void MeshChunks::Update(const Mesh& mesh)
+{
+	const uint32_t slots = static_cast<uint32_t>(mesh.mFaceArray.size());
+
+	// A changed slot removes its face from its chunk and adds its new face to the chunk that
+	// contains its centroid. All faces are removed first: chunk vertexes still in use then hold
+	// the current contents of their mesh vertexes (unchanged faces keep theirs, and mesh vertexes
+	// are only replaced once no face uses them, see Mesh::Undo).
+	for (uint32_t slot = slots; slot < mSlotChunks.size(); ++slot) { // (slots removed from the view)
+		Remove(slot);
+	}
+	mSlotChunks.resize(slots, cNone);
+	mSlotTriangles.resize(slots, cNone);
+
+	for (auto& range : mesh.mChangedIndexes) {
+		for (uint32_t slot = range.first / 3; slot < range.second / 3; ++slot) {
+			Remove(slot);
+		}
+	}
+
+	for (auto& range : mesh.mChangedIndexes) {
+		for (uint32_t slot = range.first / 3; slot < range.second / 3; ++slot) {
+			Face* face = mesh.mFaceArray[slot];
+			if (face) Add(mesh, slot, Locate(Centroid(mesh, *face)));
+		}
+	}
+
+	for (uint32_t chunk = 0; chunk < mChunks.size(); ++chunk) {
+		if (!mDirty[chunk]) continue;
+		Upload(mesh, chunk);
+		mDirty[chunk] = false;
+	}
+}
+
+
+void MeshChunks::Optimize(const Mesh& mesh)
+{
+	// Chunks are ordered by their own indexes, so the cost depends on the chunks that edits
+	// changed rather than on the size of the mesh.
+	std::vector<uint32_t> indexes, order;
+
+	for (uint32_t chunk = 0; chunk < mChunks.size(); ++chunk) {
+		if (mOrdered[chunk]) continue;
+		const Layout& layout = mLayouts[chunk];
+
+		indexes.clear();
+		for (uint32_t triangle = 0; triangle < layout.triangles.size(); ++triangle) {
+			if (layout.triangles[triangle] == cNone) continue;
+			indexes.insert(indexes.end(), &layout.indexes[triangle * 3], &layout.indexes[triangle * 3 + 3]);
+		}
+		VertexCache::Order(indexes, layout.vertexes.size(), order);
+
+		Gather(chunk);
+		std::vector<uint32_t> slots(order.size());
+		for (size_t i = 0; i < order.size(); ++i) {
+			slots[i] = mSlots[order[i]];
+		}
+		mSlots.swap(slots);
+
+		Rebuild(mesh, chunk); // (renumbers the vertexes of the chunk by first use)
+		mOrdered[chunk] = true;
+	}
+}
+
+
+void MeshChunks::MarkOrdered()
+{
+	mOrdered.assign(mChunks.size(), true);
+}
+
+
+UploadStats MeshChunks::VertexStats() const
+{
+	UploadStats stats;
+	for (auto& uploads : mVertexUploads) {
+		stats.bytes += uploads->Stats().bytes;
+		stats.writes += uploads->Stats().writes;
+		stats.allocations += uploads->Stats().allocations;
+	}
+	return stats;
+}
+
+
+UploadStats MeshChunks::IndexStats() const
+{
+	UploadStats stats;
+	for (auto& uploads : mIndexUploads) {
+		stats.bytes += uploads->Stats().bytes;
+		stats.writes += uploads->Stats().writes;
+		stats.allocations += uploads->Stats().allocations;
+	}
+	return stats;
+}
+
+
+
+uint32_t MeshChunks::Partition(std::vector<Vector3>& centroids, size_t begin, size_t end)
+{
+	uint32_t node = static_cast<uint32_t>(mTree.size());
+	mTree.push_back(Split());
+
+	if (end - begin <= cMaxFaces) {
+		mTree[node] = { cLeaf, 0.0f, { static_cast<uint32_t>(mChunks.size()), cNone } };
+		mChunks.push_back(MeshChunk{});
+		return node;
+	}
+
+	// split at the median of the widest axis
+	Vector3 lower = centroids[begin], upper = centroids[begin];
+	for (size_t i = begin + 1; i < end; ++i) {
+		Bvh::Grow(lower, upper, centroids[i]);
+	}
+
+	Vector3 extent = upper - lower;
+	uint32_t axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z) ? 1 : 2;
+
+	size_t middle = begin + (end - begin) / 2;
+	std::nth_element(centroids.begin() + begin, centroids.begin() + middle, centroids.begin() + end,
+		[axis](const Vector3& a, const Vector3& b) { return Bvh::Component(a, axis) < Bvh::Component(b, axis); });
+	float position = Bvh::Component(centroids[middle], axis);
+
+	uint32_t below = Partition(centroids, begin, middle);
+	uint32_t above = Partition(centroids, middle, end);
+	mTree[node] = { axis, position, { below, above } };
+	return node;
+}
+
+
+uint32_t MeshChunks::Locate(const Vector3& point) const
+{
+	uint32_t node = 0;
+	while (mTree[node].axis != cLeaf) {
+		const Split& split = mTree[node];
+		node = (Bvh::Component(point, split.axis) < split.position) ? split.children[0] : split.children[1];
+	}
+	return mTree[node].children[0];
+}
+
+
+void MeshChunks::Remove(uint32_t slot)
+{
+	uint32_t chunk = mSlotChunks[slot];
+	if (chunk == cNone) return;
+
+	Layout& layout = mLayouts[chunk];
+	uint32_t triangle = mSlotTriangles[slot];
+
+	for (uint32_t k = 0; k < 3; ++k) {
+		uint32_t& index = layout.indexes[triangle * 3 + k];
+		if (--layout.uses[index] == 0) layout.unusedVertexes++;
+		index = 0; // (degenerate)
+	}
+
+	layout.triangles[triangle] = cNone;
+	layout.unusedTriangles.push_back(triangle);
+	layout.changed.push_back(triangle);
+
+	mSlotChunks[slot] = cNone;
+	mSlotTriangles[slot] = cNone;
+	mDirty[chunk] = true;
+	mOrdered[chunk] = false;
+}
+
+
+void MeshChunks::Add(const Mesh& mesh, uint32_t slot, uint32_t chunk)
+{
+	Layout& layout = mLayouts[chunk];
+
+	uint32_t triangle;
+	if (!layout.unusedTriangles.empty()) {
+		triangle = layout.unusedTriangles.back();
+		layout.unusedTriangles.pop_back();
+	}
+	else {
+		triangle = static_cast<uint32_t>(layout.triangles.size());
+		layout.triangles.push_back(cNone);
+		layout.indexes.resize(layout.indexes.size() + 3);
+	}
+
+	const Face* face = mesh.mFaceArray[slot];
+	for (uint32_t k = 0; k < 3; ++k) {
+		uint32_t local = Local(mesh, chunk, face->v[k]);
+		layout.uses[local]++;
+		layout.indexes[triangle * 3 + k] = local;
+	}
+
+	layout.triangles[triangle] = slot;
+	layout.changed.push_back(triangle);
+
+	mSlotChunks[slot] = chunk;
+	mSlotTriangles[slot] = triangle;
+	mDirty[chunk] = true;
+	mOrdered[chunk] = false;
+}
+
+
+uint32_t MeshChunks::Local(const Mesh& mesh, uint32_t chunk, uint32_t vertex)
+{
+	Layout& layout = mLayouts[chunk];
+
+	auto found = layout.locals.find(vertex);
+	if (found != layout.locals.end() && layout.uses[found->second] > 0) {
+		return found->second;
+	}
+
+	// An unused chunk vertex is only taken back if the mesh vertex still has the same contents.
+	PackedVertex packed;
+	VertexFormat::Pack(mesh.mVertexes[vertex], packed);
+
+	if (found != layout.locals.end() && std::memcmp(&layout.vertexes[found->second], &packed, sizeof(PackedVertex)) == 0) {
+		layout.unusedVertexes--;
+		return found->second;
+	}
+
+	uint32_t local = static_cast<uint32_t>(layout.vertexes.size());
+	layout.vertexes.push_back(packed);
+	layout.uses.push_back(0);
+	layout.locals[vertex] = local;
+
+	Bvh::Grow(mChunks[chunk].lower, mChunks[chunk].upper, mesh.mVertexes[vertex].position);
+	return local;
+}
+
+
+void MeshChunks::Upload(const Mesh& mesh, uint32_t index)
+{
+	MeshChunk& chunk = mChunks[index];
+	Layout& layout = mLayouts[index];
+
+	std::sort(layout.changed.begin(), layout.changed.end());
+	layout.changed.erase(std::unique(layout.changed.begin(), layout.changed.end()), layout.changed.end());
+
+	const uint32_t triangles = static_cast<uint32_t>(layout.triangles.size());
+	const uint32_t vertexes = static_cast<uint32_t>(layout.vertexes.size());
+
+	bool rebuild = (chunk.indexFormat == DXGI_FORMAT_UNKNOWN) || // (not uploaded yet)
+		(chunk.indexFormat == DXGI_FORMAT_R16_UINT && vertexes > cMaxShortVertexes) ||
+		(uint64_t(layout.unusedTriangles.size()) * 100 > uint64_t(triangles) * cMaxUnused) ||
+		(uint64_t(layout.unusedVertexes) * 100 > uint64_t(vertexes) * cMaxUnused) ||
+		(uint64_t(layout.changed.size()) * 100 > uint64_t(triangles) * cMaxUnused);
+
+	if (rebuild) {
+		Gather(index);
+		std::sort(mSlots.begin(), mSlots.end()); // (view order)
+		Rebuild(mesh, index);
+		return;
+	}
+
+	// appended vertexes
+	const uint32_t stride = static_cast<uint32_t>(sizeof(PackedVertex));
+	mVertexUploads[index]->Upload(layout.vertexes.data(), stride * vertexes, { { stride * chunk.vertexCount, stride * (vertexes - chunk.vertexCount) } });
+
+	// indexes of changed triangles
+	std::vector<ByteRange> ranges;
+	ranges.reserve(layout.changed.size());
+
+	if (chunk.indexFormat == DXGI_FORMAT_R16_UINT) {
+		const uint32_t size = 3 * static_cast<uint32_t>(sizeof(uint16_t));
+		layout.shortIndexes.resize(layout.indexes.size());
+		for (uint32_t triangle : layout.changed) {
+			for (uint32_t i = triangle * 3; i < triangle * 3 + 3; ++i) {
+				layout.shortIndexes[i] = static_cast<uint16_t>(layout.indexes[i]);
+			}
+			ranges.push_back({ triangle * size, size });
+		}
+		mIndexUploads[index]->Upload(layout.shortIndexes.data(), size * triangles, ranges);
+	}
+	else {
+		const uint32_t size = 3 * static_cast<uint32_t>(sizeof(uint32_t));
+		for (uint32_t triangle : layout.changed) {
+			ranges.push_back({ triangle * size, size });
+		}
+		mIndexUploads[index]->Upload(layout.indexes.data(), size * triangles, ranges);
+	}
+
+	chunk.vertexCount = vertexes;
+	chunk.indexCount = triangles * 3;
+	layout.changed.clear();
+}
+
+
+void MeshChunks::Gather(uint32_t index)
+{
+	mSlots.clear();
+	for (uint32_t slot : mLayouts[index].triangles) {
+		if (slot != cNone) mSlots.push_back(slot);
+	}
+}
+
+
+void MeshChunks::Rebuild(const Mesh& mesh, uint32_t index)
+{
+	MeshChunk& chunk = mChunks[index];
+	Layout& layout = mLayouts[index];
+
+	// faces in the order of mSlots, vertexes numbered by first use
+	layout.triangles.swap(mSlots);
+	layout.unusedTriangles.clear();
+	layout.indexes.clear();
+	layout.vertexes.clear();
+	layout.uses.clear();
+	layout.locals.clear();
+	layout.unusedVertexes = 0;
+	layout.changed.clear();
+
+	chunk.lower = Vector3(std::numeric_limits<float>::max()); // (inverted if the chunk is empty)
+	chunk.upper = Vector3(-std::numeric_limits<float>::max());
+
+	for (uint32_t triangle = 0; triangle < layout.triangles.size(); ++triangle) {
+		uint32_t slot = layout.triangles[triangle];
+		mSlotTriangles[slot] = triangle;
+
+		for (uint32_t v : mesh.mFaceArray[slot]->v) {
+			uint32_t local = Local(mesh, index, v);
+			layout.uses[local]++;
+			layout.indexes.push_back(local);
+		}
+	}
+
+	chunk.vertexCount = static_cast<uint32_t>(layout.vertexes.size());
+	chunk.indexCount = static_cast<uint32_t>(layout.indexes.size());
+
+	// The whole chunk is written, discarding the old contents.
+	mVertexUploads[index]->Upload(layout.vertexes.data(), static_cast<uint32_t>(sizeof(PackedVertex)) * chunk.vertexCount);
+
+	if (chunk.vertexCount <= cMaxShortVertexes) {
+		layout.shortIndexes.resize(layout.indexes.size());
+		for (size_t i = 0; i < layout.indexes.size(); ++i) {
+			layout.shortIndexes[i] = static_cast<uint16_t>(layout.indexes[i]);
+		}
+		chunk.indexFormat = DXGI_FORMAT_R16_UINT;
+		mIndexUploads[index]->Upload(layout.shortIndexes.data(), static_cast<uint32_t>(sizeof(uint16_t)) * chunk.indexCount);
+	}
+	else {
+		layout.shortIndexes.clear();
+		chunk.indexFormat = DXGI_FORMAT_R32_UINT;
+		mIndexUploads[index]->Upload(layout.indexes.data(), static_cast<uint32_t>(sizeof(uint32_t)) * chunk.indexCount);
+	}
+}
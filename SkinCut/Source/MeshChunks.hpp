@@ -0,0 +1,120 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+
+#include <d3d11.h>
+#include <wrl/client.h>
+
+#include "Structures.hpp"
+#include "Mathematics.hpp"
+#include "UploadPlanner.hpp"
+
+
+using Microsoft::WRL::ComPtr;
+
+
+
+namespace SkinCut
+{
+	class Mesh;
+
+
+	struct MeshChunk
+	{
+		uint32_t vertexCount; // (including unused vertexes, see MeshChunks)
+		uint32_t indexCount; // (including degenerate triangles)
+		DXGI_FORMAT indexFormat; // 16-bit indexes unless the chunk has more than 65536 vertexes
+		Math::Vector3 lower, upper; // bounds of the vertexes (e.g. for culling)
+
+		ComPtr<ID3D11Buffer> vertexBuffer; // PackedVertex per vertex
+		ComPtr<ID3D11Buffer> indexBuffer;
+	};
+
+
+	// Spatially coherent parts of a mesh, each drawn from its own vertex and index buffer. The
+	// chunks are the leaves of a k-d tree over the face centroids of the mesh as it was loaded
+	// (split at the median of the widest axis until a leaf has at most cMaxFaces faces). Every
+	// face, including those created by later edits, belongs to the leaf that contains its
+	// centroid, so an edit only changes the chunks of the faces it changed.
+	//
+	// Chunks hold copies of the vertexes of their faces (vertexes on chunk borders are copied
+	// into each chunk). Edits change the chunks in place: a removed face leaves a degenerate
+	// triangle, which the next face added to the chunk replaces, and vertexes are only appended
+	// (the GPU may still read the old ones), so an edit uploads just the changed indexes and the
+	// new vertexes. A chunk is rebuilt, with its faces in view order and its vertexes numbered
+	// by first use, once cMaxUnused percent of its triangles or vertexes are unused or changed
+	// at once, and when its vertexes outgrow 16-bit indexes.
+	//
+	// The faces of an imported mesh are in vertex cache order, and so are the chunks built from
+	// them. Optimize orders the triangles of the chunks that edits changed since (the face view
+	// of the mesh keeps its order, so face slots stay valid).
+	class MeshChunks
+	{
+	public: // constants
+		static const uint32_t cMaxFaces; // faces per chunk when partitioning (edits may add more)
+		static const uint32_t cMaxUnused; // percentage of unused (or changed) triangles or vertexes before a chunk is rebuilt
+		static const uint32_t cNone;
+
+	private:
+		struct Split // k-d tree node (a leaf if axis is 3)
+		{
+			uint32_t axis;
+			float position;
+			uint32_t children[2]; // nodes below and above position (for leaves, children[0] is the chunk)
+		};
+
+		struct Layout // contents of the buffers of a chunk, kept to edit them in place
+		{
+			std::vector<uint32_t> triangles; // chunk triangle -> face view slot (cNone if unused)
+			std::vector<uint32_t> unusedTriangles; // (degenerate until reused)
+			std::vector<uint32_t> indexes; // three chunk vertexes per chunk triangle
+			std::vector<uint16_t> shortIndexes; // indexes as uploaded (if the index format is 16-bit)
+			std::vector<PackedVertex> vertexes;
+			std::vector<uint32_t> uses; // chunk vertex -> triangles that use it
+			std::unordered_map<uint32_t, uint32_t> locals; // mesh vertex -> chunk vertex (possibly unused, see Local)
+			uint32_t unusedVertexes;
+			std::vector<uint32_t> changed; // chunk triangles changed since the last upload
+		};
+
+		ComPtr<ID3D11Device> mDevice;
+		std::vector<Split> mTree; // (root first)
+		std::vector<MeshChunk> mChunks;
+		std::vector<Layout> mLayouts; // per chunk
+		std::vector<std::unique_ptr<UploadPlanner>> mVertexUploads; // per chunk
+		std::vector<std::unique_ptr<UploadPlanner>> mIndexUploads;
+
+		std::vector<uint32_t> mSlotChunks; // face view slot -> chunk (cNone for killed faces)
+		std::vector<uint32_t> mSlotTriangles; // face view slot -> triangle in its chunk
+		std::vector<bool> mDirty; // chunks to upload
+		std::vector<bool> mOrdered; // chunks whose triangles are in vertex cache order
+		std::vector<uint32_t> mSlots; // faces of a chunk to rebuild it with, in order
+
+
+	public:
+		MeshChunks(ComPtr<ID3D11Device>& device, const Mesh& mesh);
+
+		void Update(const Mesh& mesh); // after Mesh::RebuildIndexes: move the faces of the changed face view slots and upload the chunks they changed
+		void Optimize(const Mesh& mesh); // order the triangles of the chunks changed since they were last ordered for the vertex cache, and rebuild them
+		void MarkOrdered(); // all chunks are in vertex cache order (e.g. built from an imported or restored mesh)
+
+		const std::vector<MeshChunk>& Chunks() const { return mChunks; }
+		UploadStats VertexStats() const; // (summed over chunks)
+		UploadStats IndexStats() const;
+
+
+	private:
+		uint32_t Partition(std::vector<Math::Vector3>& centroids, size_t begin, size_t end); // returns the node
+		uint32_t Locate(const Math::Vector3& point) const;
+
+		void Remove(uint32_t slot); // remove the face of a slot from its chunk
+		void Add(const Mesh& mesh, uint32_t slot, uint32_t chunk);
+		uint32_t Local(const Mesh& mesh, uint32_t chunk, uint32_t vertex); // chunk vertex of a mesh vertex (appended if needed)
+
+		void Upload(const Mesh& mesh, uint32_t chunk); // changes since the last upload (or rebuild the chunk)
+		void Gather(uint32_t chunk); // faces of a chunk into mSlots, in triangle order
+		void Rebuild(const Mesh& mesh, uint32_t chunk); // with the faces of mSlots, in that order
+	};
+}
@@ -0,0 +1,280 @@
+#include "ObjParser.hpp"
+
+#include <array>
+#include <cstring>
+#include <charconv>
+#include <exception>
+#include <algorithm>
+
+#include "Parallel.hpp"
+
+
+using namespace SkinCut;
+using namespace SkinCut::Math;
+
+
+
+namespace
+{
+	constexpr uint32_t cEmpty = 0xFFFFFFFF;	// empty corner table slot
+
+
+	// Statements of one block. Face corners hold indexes as they are resolved within the block:
+	// absolute ones are final, relative ones (listed in 'relative') still need the number of
+	// elements defined in preceding blocks added.
+	struct Block
+	{
+		std::vector<Vector3> positions;
+		std::vector<Vector2> texcoords;
+		std::vector<Vector3> normals;
+
+		std::vector<std::array<uint32_t, 3>> corners; // position/texcoord/normal index, three per triangle
+		std::vector<std::pair<size_t, uint32_t>> relative; // corner and component
+	};
+
+
+	inline bool Blank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+	inline const char* SkipBlank(const char* p, const char* end)
+	{
+		while (p < end && Blank(*p)) ++p;
+		return p;
+	}
+
+	inline const char* SkipLine(const char* p, const char* end)
+	{
+		const char* eol = static_cast<const char*>(std::memchr(p, '\n', end - p));
+		return eol ? eol + 1 : end;
+	}
+
+	inline float ReadFloat(const char*& p, const char* end)
+	{
+		p = SkipBlank(p, end);
+		if (p < end && *p == '+') ++p; // (not accepted by from_chars)
+
+		float value = 0.0f;
+		auto result = std::from_chars(p, end, value);
+		if (result.ec != std::errc()) {
+			throw std::exception("Mesh loading error: Invalid number in mesh file.");
+		}
+		p = result.ptr;
+		return value;
+	}
+
+
+	// Face corner "p", "p/t", "p//n" or "p/t/n". Absent indexes are 0, which is also the
+	// zero-based index of the first element; the index of an absent component is never used.
+	bool ReadCorner(const char*& p, const char* end, Block& block, std::array<uint32_t, 3>& corner, std::array<bool, 3>& relative)
+	{
+		p = SkipBlank(p, end);
+		if (p >= end || *p == '\n' || *p == '#') return false;
+
+		const size_t counts[3] = { block.positions.size(), block.texcoords.size(), block.normals.size() };
+		corner = { 0, 0, 0 };
+		relative = { false, false, false };
+
+		for (uint32_t k = 0; k < 3; ++k) {
+			if (k > 0) {
+				if (p >= end || *p != '/') break;
+				++p;
+				if (p < end && *p == '/') continue; // empty component
+			}
+
+			int64_t index = 0;
+			auto result = std::from_chars(p, end, index);
+			if (result.ec != std::errc() || index == 0) {
+				throw std::exception("Mesh loading error: Invalid face definition.");
+			}
+			p = result.ptr;
+
+			if (index > 0) { // one-based
+				corner[k] = static_cast<uint32_t>(index - 1);
+			}
+			else { // relative to the elements defined so far (wraps if it reaches into preceding blocks)
+				corner[k] = static_cast<uint32_t>(int64_t(counts[k]) + index);
+				relative[k] = true;
+			}
+		}
+
+		if (p < end && !Blank(*p) && *p != '\n') {
+			throw std::exception("Mesh loading error: Invalid face definition.");
+		}
+		return true;
+	}
+
+
+	void ParseBlock(const char* p, const char* end, Block& block)
+	{
+		std::vector<std::array<uint32_t, 3>> polygon;
+		std::vector<std::array<bool, 3>> polygonRelative;
+
+		while (p < end) {
+			p = SkipBlank(p, end);
+			const char* word = p;
+			while (p < end && !Blank(*p) && *p != '\n') ++p;
+			size_t length = p - word;
+
+			if (length == 1 && word[0] == 'v') {
+				float x = ReadFloat(p, end), y = ReadFloat(p, end), z = ReadFloat(p, end);
+				block.positions.push_back(Vector3(x, z, y)); // convert to left-handed
+			}
+			else if (length == 2 && word[0] == 'v' && word[1] == 'n') {
+				float x = ReadFloat(p, end), y = ReadFloat(p, end), z = ReadFloat(p, end);
+				block.normals.push_back(Vector3(x, z, y)); // convert to left-handed
+			}
+			else if (length == 2 && word[0] == 'v' && word[1] == 't') {
+				float u = ReadFloat(p, end), v = ReadFloat(p, end);
+				block.texcoords.push_back(Vector2(u, 1.f-v)); // convert to top-left
+			}
+			else if (length == 1 && word[0] == 'f') {
+				polygon.clear();
+				polygonRelative.clear();
+
+				std::array<uint32_t, 3> corner;
+				std::array<bool, 3> relative;
+				while (ReadCorner(p, end, block, corner, relative)) {
+					polygon.push_back(corner);
+					polygonRelative.push_back(relative);
+				}
+				if (polygon.size() < 3) {
+					throw std::exception("Mesh loading error: Face with fewer than three vertexes.");
+				}
+
+				// fan triangulation; corners 1 and 2 are swapped to convert to clockwise order
+				for (size_t k = 1; k + 1 < polygon.size(); ++k) {
+					for (size_t c : { size_t(0), k + 1, k }) {
+						for (uint32_t j = 0; j < 3; ++j) {
+							if (polygonRelative[c][j]) block.relative.emplace_back(block.corners.size(), j);
+						}
+						block.corners.push_back(polygon[c]);
+					}
+				}
+			}
+			// other statements (comments, groups, smoothing groups, materials, ...) are ignored
+
+			p = SkipLine(p, end);
+		}
+	}
+
+
+	// Open-addressing table of unique corners, numbered in order of first use.
+	class CornerTable
+	{
+	private:
+		std::vector<uint32_t> mSlots; // index into mCorners (cEmpty if empty)
+		std::vector<Indexer>& mCorners;
+		size_t mMask;
+
+		static uint64_t Hash(const Indexer& c)
+		{
+			uint64_t x = (uint64_t(c.pi) << 32 | c.xi) ^ (uint64_t(c.ni) * 0x9e3779b97f4a7c15ull);
+			x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ull;
+			x ^= x >> 27; x *= 0x94d049bb133111ebull;
+			return x ^ (x >> 31);
+		}
+
+		void Rehash(size_t capacity)
+		{
+			mSlots.assign(capacity, cEmpty);
+			mMask = capacity - 1;
+			for (uint32_t i = 0; i < mCorners.size(); ++i) {
+				size_t s = Hash(mCorners[i]) & mMask;
+				while (mSlots[s] != cEmpty) s = (s + 1) & mMask;
+				mSlots[s] = i;
+			}
+		}
+
+	public:
+		CornerTable(std::vector<Indexer>& corners, size_t expected) : mCorners(corners), mMask(0)
+		{
+			size_t capacity = 64;
+			while (capacity * 7 < expected * 10) capacity *= 2;
+			Rehash(capacity);
+		}
+
+		uint32_t Insert(const Indexer& c)
+		{
+			if ((mCorners.size() + 1) * 10 > mSlots.size() * 7) Rehash(mSlots.size() * 2);
+
+			for (size_t s = Hash(c) & mMask;; s = (s + 1) & mMask) {
+				uint32_t i = mSlots[s];
+				if (i == cEmpty) {
+					if (mCorners.size() >= cEmpty) {
+						throw std::exception("Mesh loading error: Too many indexes (mesh is too large).");
+					}
+					mSlots[s] = static_cast<uint32_t>(mCorners.size());
+					mCorners.push_back(c);
+					return mSlots[s];
+				}
+				const Indexer& e = mCorners[i];
+				if (e.pi == c.pi && e.xi == c.xi && e.ni == c.ni) return i;
+			}
+		}
+	};
+}
+
+
+
+void ObjParser::Parse(const char* data, size_t size, ObjData& obj)
+{
+	// Blocks of about cBlockSize bytes, each extended to the end of its last line.
+	std::vector<const char*> bounds = { data };
+	const char* end = data + size;
+	while (bounds.back() < end) {
+		const char* p = bounds.back() + std::min(cBlockSize, size_t(end - bounds.back()));
+		bounds.push_back((p < end) ? SkipLine(p, end) : end);
+	}
+
+	std::vector<Block> blocks(bounds.size() - 1);
+	Parallel::For(static_cast<uint32_t>(blocks.size()), [&](uint32_t b) {
+		ParseBlock(bounds[b], bounds[b + 1], blocks[b]);
+	});
+
+
+	// Merge blocks in file order, resolving relative indexes.
+	size_t counts[4] = { 0, 0, 0, 0 }; // positions, texcoords, normals, corners
+	for (Block& block : blocks) {
+		for (auto& r : block.relative) {
+			block.corners[r.first][r.second] += static_cast<uint32_t>(counts[r.second]);
+		}
+		counts[0] += block.positions.size();
+		counts[1] += block.texcoords.size();
+		counts[2] += block.normals.size();
+		counts[3] += block.corners.size();
+	}
+
+	obj.positions.clear();
+	obj.texcoords.clear();
+	obj.normals.clear();
+	obj.positions.reserve(counts[0]);
+	obj.texcoords.reserve(counts[1] + 1);
+	obj.normals.reserve(counts[2]);
+	for (const Block& block : blocks) {
+		obj.positions.insert(obj.positions.end(), block.positions.begin(), block.positions.end());
+		obj.texcoords.insert(obj.texcoords.end(), block.texcoords.begin(), block.texcoords.end());
+		obj.normals.insert(obj.normals.end(), block.normals.begin(), block.normals.end());
+	}
+	if (obj.texcoords.empty()) {
+		obj.texcoords.push_back(Vector2(0.0f, 0.0f));
+	}
+
+	if (obj.positions.empty()) {
+		throw std::exception("Mesh loading error: No vertices found.");
+	}
+
+
+	// Number the unique corners (vertexes) in order of first use.
+	obj.vertexes.clear();
+	obj.indexes.clear();
+	obj.indexes.reserve(counts[3]);
+
+	CornerTable table(obj.vertexes, counts[3] / 4);
+	for (const Block& block : blocks) {
+		for (const auto& corner : block.corners) {
+			if (corner[0] >= obj.positions.size() || corner[1] >= obj.texcoords.size() || (corner[2] > 0 && corner[2] >= obj.normals.size())) {
+				throw std::exception("Mesh loading error: Face refers to a missing vertex.");
+			}
+			obj.indexes.push_back(table.Insert(Indexer{ corner[0], corner[2], corner[1] }));
+		}
+	}
+}
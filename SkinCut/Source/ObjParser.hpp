@@ -0,0 +1,36 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "Structures.hpp"
+#include "Mathematics.hpp"
+
+
+
+namespace SkinCut
+{
+	// Geometry of a Wavefront OBJ file, converted to the conventions of the renderer:
+	// left-handed (y and z swapped, clockwise triangles) with texture coordinates from the top left.
+	struct ObjData
+	{
+		std::vector<Math::Vector3> positions;
+		std::vector<Math::Vector2> texcoords;	// (at least one, so absent texture coordinates can refer to it)
+		std::vector<Math::Vector3> normals;
+
+		std::vector<Indexer> vertexes;			// unique position/texcoord/normal combinations, in order of first use
+		std::vector<uint32_t> indexes;			// three per triangle, into vertexes
+	};
+
+
+	// OBJ parsing. The file is split into blocks that end at line ends, which are parsed in
+	// parallel and merged in file order, so the result does not depend on the number of threads.
+	// Supports v, vt, vn and f statements (polygons are triangulated as fans, negative indexes are
+	// relative); other statements are ignored.
+	namespace ObjParser
+	{
+		static const size_t cBlockSize = 1 << 20; // bytes per parsing task
+
+		void Parse(const char* data, size_t size, ObjData& obj);
+	}
+}
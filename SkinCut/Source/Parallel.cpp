@@ -0,0 +1,219 @@
+#include "Parallel.hpp"
+
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <exception>
+#include <algorithm>
+#include <condition_variable>
+
+
+using namespace SkinCut;
+
+
+
+namespace
+{
+	std::atomic<uint32_t> gThreads(0); // 0: hardware concurrency
+
+
+	struct Job // tasks of one call to For
+	{
+		uint32_t count;
+		const std::function<void(uint32_t)>* task;
+		uint32_t helpers; // workers that may take part (besides the calling thread)
+
+		std::atomic<uint32_t> next; // first task not handed out
+		uint32_t joined; // workers that took part (guarded by the pool lock)
+		uint32_t active; // workers still taking part (guarded by the pool lock)
+
+		std::mutex errorLock;
+		std::exception_ptr error; // first exception of a task
+
+		void Run()
+		{
+			for (uint32_t i = next++; i < count; i = next++) {
+				try {
+					(*task)(i);
+				}
+				catch (...) {
+					std::lock_guard<std::mutex> lock(errorLock);
+					if (!error) error = std::current_exception();
+				}
+			}
+		}
+	};
+
+
+	// Worker threads shared by all calls to For, created on first use and kept until exit.
+	// Workers take part in the oldest job that has tasks left and room for helpers. Threads
+	// that wait for a job have handed out all of its tasks, and only wait for the ones still
+	// running, so tasks may call For themselves (from any thread) without deadlock.
+	class WorkerPool
+	{
+	private:
+		std::mutex mLock;
+		std::condition_variable mWake; // jobs were submitted (or the pool stops)
+		std::condition_variable mIdle; // a worker left a job
+		std::vector<std::thread> mWorkers;
+		std::vector<Job*> mJobs; // jobs taking helpers, oldest first
+		bool mStop;
+
+	public:
+		WorkerPool() : mStop(false) {}
+
+		~WorkerPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mLock);
+				mStop = true;
+			}
+			mWake.notify_all();
+
+			for (auto& worker : mWorkers) {
+				worker.join();
+			}
+		}
+
+		void Submit(Job& job)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mLock);
+				while (mWorkers.size() < job.helpers) {
+					mWorkers.emplace_back(&WorkerPool::Work, this);
+				}
+				mJobs.push_back(&job);
+			}
+			mWake.notify_all();
+		}
+
+		void Retire(Job& job) // once all tasks have been handed out; waits for the workers that took part
+		{
+			std::unique_lock<std::mutex> lock(mLock);
+			mJobs.erase(std::find(mJobs.begin(), mJobs.end(), &job));
+			mIdle.wait(lock, [&]() { return job.active == 0; });
+		}
+
+	private:
+		Job* Available()
+		{
+			for (Job* job : mJobs) {
+				if (job->joined < job->helpers && job->next.load() < job->count) return job;
+			}
+			return nullptr;
+		}
+
+		void Work()
+		{
+			std::unique_lock<std::mutex> lock(mLock);
+
+			for (;;) {
+				Job* job = nullptr;
+				mWake.wait(lock, [&]() { return mStop || (job = Available()) != nullptr; });
+				if (!job) return;
+
+				job->joined++;
+				job->active++;
+				lock.unlock();
+
+				job->Run();
+
+				lock.lock();
+				if (--job->active == 0) mIdle.notify_all();
+			}
+		}
+	};
+
+
+	WorkerPool& Workers()
+	{
+		static WorkerPool pool;
+		return pool;
+	}
+}
+
+
+
+uint32_t Parallel::Threads()
+{
+	uint32_t threads = gThreads.load();
+	if (threads == 0) threads = std::thread::hardware_concurrency();
+	return std::max(threads, 1u);
+}
+
+
+void Parallel::SetThreads(uint32_t threads)
+{
+	gThreads.store(threads);
+}
+
+
+void Parallel::For(uint32_t count, const std::function<void(uint32_t)>& task)
+{
+	if (count == 0) return;
+
+	Job job;
+	job.count = count;
+	job.task = &task;
+	job.helpers = std::min(Threads(), count) - 1;
+	job.next = 0;
+	job.joined = 0;
+	job.active = 0;
+
+	if (job.helpers > 0) Workers().Submit(job);
+	job.Run();
+	if (job.helpers > 0) Workers().Retire(job);
+
+	if (job.error) std::rethrow_exception(job.error);
+}
+
+
+void Parallel::Sort(std::vector<uint64_t>& keys, std::vector<uint32_t>& values)
+{
+	const size_t count = keys.size();
+	const uint32_t tasks = Tasks(count, cSortGrain);
+
+	std::vector<uint64_t> sortedKeys(count);
+	std::vector<uint32_t> sortedValues(count);
+	std::vector<std::array<size_t, 256>> offsets(tasks);
+
+	for (uint32_t shift = 0; shift < 64; shift += 8) {
+		// digit histogram of each task
+		For(tasks, [&](uint32_t t) {
+			offsets[t].fill(0);
+			size_t end = std::min(count, (t + 1) * cSortGrain);
+			for (size_t i = t * cSortGrain; i < end; ++i) {
+				offsets[t][(keys[i] >> shift) & 0xFF]++;
+			}
+		});
+
+		// output offsets: by digit, then by task (which keeps equal digits in input order)
+		size_t offset = 0;
+		bool skip = false;
+		for (uint32_t d = 0; d < 256; ++d) {
+			size_t total = 0;
+			for (uint32_t t = 0; t < tasks; ++t) {
+				size_t n = offsets[t][d];
+				offsets[t][d] = offset + total;
+				total += n;
+			}
+			skip |= (total == count);
+			offset += total;
+		}
+		if (skip) continue;
+
+		For(tasks, [&](uint32_t t) {
+			size_t end = std::min(count, (t + 1) * cSortGrain);
+			for (size_t i = t * cSortGrain; i < end; ++i) {
+				size_t j = offsets[t][(keys[i] >> shift) & 0xFF]++;
+				sortedKeys[j] = keys[i];
+				sortedValues[j] = values[i];
+			}
+		});
+
+		std::swap(keys, sortedKeys);
+		std::swap(values, sortedValues);
+	}
+}
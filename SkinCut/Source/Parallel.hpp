@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+
+
+namespace SkinCut
+{
+	// Fork-join helpers on a pool of worker threads that is created once and shared by all
+	// callers. Work is handed out in tasks whose boundaries are chosen by the caller (never by
+	// the number of threads), so results that are combined in task order are the same for any
+	// thread count.
+	namespace Parallel
+	{
+		static const size_t cSortGrain = 1 << 16; // pairs per sorting task
+
+		uint32_t Threads(); // number of threads used (hardware concurrency, at least 1)
+		void SetThreads(uint32_t threads); // override the number of threads (0: hardware concurrency)
+
+		// Run task(i) for all i in [0, count) and wait for them to finish. The calling thread
+		// takes part, helped by up to Threads() - 1 pool workers. Tasks may call For themselves.
+		// If tasks throw, the first exception is rethrown once all tasks are done.
+		void For(uint32_t count, const std::function<void(uint32_t)>& task);
+
+		// Number of tasks of at most grain items each that cover count items.
+		inline uint32_t Tasks(size_t count, size_t grain) { return static_cast<uint32_t>((count + grain - 1) / grain); }
+
+		// Stable sort of key/value pairs by key (least significant digit radix sort, one byte per
+		// pass; passes in which all keys have the same digit are skipped).
+		void Sort(std::vector<uint64_t>& keys, std::vector<uint32_t>& values);
+	}
+}
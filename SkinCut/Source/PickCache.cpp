@@ -0,0 +1,110 @@
+#include "PickCache.hpp"
+
+#include <chrono>
+#include <algorithm>
+
+#include "Mesh.hpp"
+#include "Entity.hpp"
+
+
+using namespace SkinCut;
+using namespace SkinCut::Math;
+
+
+
+const uint32_t PickCache::cRings = 2;
+
+
+
+PickCache::PickCache()
+: mFace(nullptr), mRevision(0)
+{
+}
+
+
+bool PickCache::RayIntersection(const std::shared_ptr<Entity>& model, Ray& ray, Intersection& ix)
+{
+	auto start = std::chrono::steady_clock::now();
+	Mesh& mesh = *model->mMesh;
+
+	// rings are only used on the model of the last hit, and while its face exists
+	bool cached = mFace && mModel.lock() == model;
+	if (cached && !Live(mesh, mFace)) {
+		Reset();
+		cached = false;
+	}
+	else if (cached && mesh.mRevision != mRevision) { // (neighbors may have changed)
+		Gather(mesh);
+	}
+
+	const std::vector<Face*> none;
+	bool hit = model->RayIntersection(ray, ix, cached ? mRings : none);
+	bool ringHit = cached && hit && std::find(mRings.begin(), mRings.end(), ix.face) != mRings.end();
+
+	double time = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+	mStats.queries++;
+	mStats.time += time;
+	if (ringHit) {
+		mStats.ringHits++;
+		mStats.ringTime += time;
+	}
+
+	return hit;
+}
+
+
+void PickCache::Remember(const Intersection& ix)
+{
+	if (!ix.hit || (ix.face == mFace && mModel.lock() == ix.model)) return;
+
+	mModel = ix.model;
+	mFace = ix.face;
+	Gather(*ix.model->mMesh);
+}
+
+
+void PickCache::Reset()
+{
+	mModel.reset();
+	mFace = nullptr;
+	mRings.clear();
+}
+
+
+
+bool PickCache::Live(const Mesh& mesh, const Face* face) const
+{
+	return face->id < mesh.mFaceSlots.size() && mesh.mFaceSlots[face->id] != Mesh::cNoSlot &&
+	       mesh.mFaceArray[mesh.mFaceSlots[face->id]] == face;
+}
+
+
+void PickCache::Gather(Mesh& mesh)
+{
+	mRevision = mesh.mRevision;
+	mRings.assign(1, mFace);
+
+	// breadth first over the nodes of mFace and their one-rings, taking the face fan of each
+	// node (rings are small, so lookups are linear)
+	std::vector<Node*> nodes(mFace->n.begin(), mFace->n.end());
+	std::vector<Face*> fan;
+	std::vector<Node*> ring;
+
+	size_t begin = 0;
+	for (uint32_t r = 0; r < cRings; ++r) {
+		size_t end = nodes.size();
+		for (size_t i = begin; i < end; ++i) {
+			mesh.FaceFan(nodes[i], fan);
+			for (Face* face : fan) {
+				if (std::find(mRings.begin(), mRings.end(), face) == mRings.end()) mRings.push_back(face);
+			}
+
+			if (r + 1 == cRings) continue; // (nodes of the next ring are not needed)
+			mesh.OneRing(nodes[i], ring);
+			for (Node* node : ring) {
+				if (std::find(nodes.begin(), nodes.end(), node) == nodes.end()) nodes.push_back(node);
+			}
+		}
+		begin = end;
+	}
+}
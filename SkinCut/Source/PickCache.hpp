@@ -0,0 +1,59 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+
+#include "Structures.hpp"
+#include "Mathematics.hpp"
+
+
+
+namespace SkinCut
+{
+	class Mesh;
+	class Entity;
+
+
+	struct PickStats // cumulative picking activity
+	{
+		uint64_t queries = 0;		// ray queries on models
+		uint64_t ringHits = 0;		// queries whose closest face was among the ring faces
+		double time = 0.0;			// microseconds spent in queries
+		double ringTime = 0.0;		// microseconds spent in queries with a ring hit
+	};
+
+
+	// Picking for continuous cursor feedback (hovering, cut previews). The cursor moves little
+	// between queries, so on the model of the last pick, the face hit then and the faces around
+	// its nodes, out to cRings rings of nodes, are tested first; once one of them is hit, the face
+	// hierarchy of the mesh only has to be searched for faces at most as far. Without a ring hit
+	// this is the full search. Results are the same as those of Entity::RayIntersection.
+	class PickCache
+	{
+	public: // constants
+		static const uint32_t cRings;
+
+	private:
+		std::weak_ptr<Entity> mModel; // model of the last remembered hit
+		Face* mFace; // face of the last remembered hit (nullptr if none)
+		uint64_t mRevision; // mesh revision at which the rings were gathered
+		std::vector<Face*> mRings; // mFace and the face fans around it, ring by ring
+		PickStats mStats;
+
+
+	public:
+		PickCache();
+
+		bool RayIntersection(const std::shared_ptr<Entity>& model, Math::Ray& ray, Intersection& ix); // closest intersection (as Entity::RayIntersection)
+		void Remember(const Intersection& ix); // nearest hit of a pick across models (its face is tested first from now on)
+		void Reset(); // forget the last hit (e.g. when the models are replaced)
+
+		const PickStats& Stats() const { return mStats; }
+
+
+	private:
+		bool Live(const Mesh& mesh, const Face* face) const; // face is in the face view of the mesh
+		void Gather(Mesh& mesh); // rings around mFace
+	};
+}
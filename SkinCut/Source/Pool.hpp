@@ -0,0 +1,172 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+
+
+namespace SkinCut
+{
+	// Element store addressed by 32-bit handles. Elements live in fixed-size chunks,
+	// so handles map to addresses in O(1) and addresses stay valid when the pool grows.
+	// This lets the topology hand out plain pointers as a view on contiguous storage.
+	template <class T>
+	class Pool
+	{
+	public: // constants
+		static const uint32_t cChunkBits = 12;
+		static const uint32_t cChunkSize = 1u << cChunkBits;
+		static const uint32_t cChunkMask = cChunkSize - 1;
+
+
+	public:
+		struct Snapshot // copy of all issued elements and the allocation state
+		{
+			std::vector<T> elements;
+			std::vector<uint32_t> freeList;
+			std::vector<bool> released;
+			uint64_t allocated;
+			uint64_t recycled;
+		};
+
+
+	private:
+		std::vector<std::unique_ptr<T[]>> mChunks;
+		std::vector<uint32_t> mFreeList;	// released handles, reused before issuing new ones (may hold stale entries, see Acquire)
+		std::vector<bool> mReleased;		// per handle: currently released
+		uint32_t mCount;					// number of handles issued
+		uint32_t mFree;						// number of released handles
+
+		uint64_t mAllocated;				// elements taken from fresh storage
+		uint64_t mRecycled;					// elements taken from the free list
+
+
+	public:
+		Pool() : mCount(0), mFree(0), mAllocated(0), mRecycled(0) {}
+		Pool(const Pool&) = delete;
+		Pool& operator=(const Pool&) = delete;
+
+		T* Create()
+		{
+			uint32_t id;
+			while (!mFreeList.empty() && !mReleased[mFreeList.back()]) {
+				mFreeList.pop_back(); // handle was acquired again
+			}
+
+			if (!mFreeList.empty()) {
+				id = mFreeList.back();
+				mFreeList.pop_back();
+				mReleased[id] = false;
+				mFree--;
+				mRecycled++;
+			}
+			else {
+				id = mCount++;
+				if ((id >> cChunkBits) >= mChunks.size()) {
+					mChunks.emplace_back(new T[cChunkSize]);
+				}
+				mReleased.push_back(false);
+				mAllocated++;
+			}
+
+			T* element = Get(id);
+			*element = T();
+			element->id = id;
+			return element;
+		}
+
+		// Issue all handles below count at once, in order (e.g. to load stored elements).
+		// The new elements only have their handle set.
+		void Issue(uint32_t count)
+		{
+			if (count <= mCount) return;
+
+			while (mChunks.size() * cChunkSize < count) {
+				mChunks.emplace_back(new T[cChunkSize]);
+			}
+			mReleased.resize(count, false);
+			mAllocated += count - mCount;
+
+			for (uint32_t id = mCount; id < count; ++id) {
+				T* element = Get(id);
+				*element = T();
+				element->id = id;
+			}
+			mCount = count;
+		}
+
+		void Release(T* element)
+		{
+			if (!element || mReleased[element->id]) return; // already released
+			mReleased[element->id] = true;
+			mFreeList.push_back(element->id);
+			mFree++;
+		}
+
+		// Take a specific released handle back into use, keeping the element contents
+		// (e.g. when undoing its release). Its free list entry becomes stale and is skipped.
+		T* Acquire(uint32_t id)
+		{
+			if (mReleased[id]) {
+				mReleased[id] = false;
+				mFree--;
+			}
+			return Get(id);
+		}
+
+		void Clear()
+		{
+			mChunks.clear();
+			mFreeList.clear();
+			mReleased.clear();
+			mCount = 0;
+			mFree = 0;
+			mAllocated = 0;
+			mRecycled = 0;
+		}
+
+
+		void Save(Snapshot& snapshot) const
+		{
+			snapshot.elements.resize(mCount);
+			for (uint32_t i = 0; i < mCount; i += cChunkSize) {
+				const T* chunk = mChunks[i >> cChunkBits].get();
+				std::copy(chunk, chunk + std::min(cChunkSize, mCount - i), snapshot.elements.begin() + i);
+			}
+			snapshot.freeList = mFreeList;
+			snapshot.released = mReleased;
+			snapshot.allocated = mAllocated;
+			snapshot.recycled = mRecycled;
+		}
+
+		// Elements are copied back to their original addresses, so pointers held by the
+		// restored elements (and by saved views on them) are valid again. The snapshot must
+		// have been saved from this pool and the pool must not have been cleared since.
+		void Restore(const Snapshot& snapshot)
+		{
+			uint32_t count = static_cast<uint32_t>(snapshot.elements.size());
+			for (uint32_t i = 0; i < count; i += cChunkSize) {
+				auto first = snapshot.elements.begin() + i;
+				std::copy(first, first + std::min(cChunkSize, count - i), mChunks[i >> cChunkBits].get());
+			}
+			mFreeList = snapshot.freeList;
+			mReleased = snapshot.released;
+			mCount = count;
+			mFree = static_cast<uint32_t>(std::count(mReleased.begin(), mReleased.end(), true));
+			mAllocated = snapshot.allocated;
+			mRecycled = snapshot.recycled;
+		}
+
+
+		bool Released(uint32_t id) const { return mReleased[id]; }
+		T* Get(uint32_t id) const { return &mChunks[id >> cChunkBits][id & cChunkMask]; }
+
+		uint32_t Capacity() const { return mCount; } // upper bound of issued handles
+		size_t Size() const { return mCount - mFree; }
+		uint64_t Allocated() const { return mAllocated; }
+		uint64_t Recycled() const { return mRecycled; }
+		size_t Bytes() const { return mChunks.size() * cChunkSize * sizeof(T) + mFreeList.capacity() * sizeof(uint32_t); }
+	};
+}
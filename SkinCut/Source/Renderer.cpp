@@ -1,9 +1,12 @@
 #include "Renderer.hpp"
 
+#include <cmath>
+#include <cfloat>
 #include <wincodec.h>
 
 #include "DirectXTex/DirectXTex.h"
 #include "DirectXTK/Inc/DDSTextureLoader.h"
+#include "DirectXTK/Inc/DirectXHelpers.h"
 
 #include "Mesh.hpp"
 #include "Decal.hpp"
@@ -18,8 +21,10 @@
 #include "Generator.hpp"
 #include "Structures.hpp"
 #include "FrameBuffer.hpp"
+#include "MeshChunks.hpp"
 #include "Mathematics.hpp"
 #include "VertexBuffer.hpp"
+#include "VertexFormat.hpp"
 
 
 #pragma warning(disable: 4996)
@@ -53,6 +58,7 @@ Renderer::Renderer(HWND hwnd, uint32_t width, uint32_t height)
 	InitializeRasterizer();
 	InitializeTargets();
 	InitializeKernel();
+	InitializeHighlight();
 }
 
 
@@ -85,6 +91,11 @@ void Renderer::Resize(uint32_t width, uint32_t height)
 
 void Renderer::Render(std::vector<std::shared_ptr<Entity>>& models, std::vector<std::shared_ptr<Light>>& lights, std::unique_ptr<Camera>& camera)
 {
+	if (models.empty()) { // (while the first scene is loading)
+		ClearBuffer(mBackBuffer, Color(0.1f, 0.1f, 0.1f, 1.0));
+		mContext->OMSetRenderTargets(1, mBackBuffer->mColorBuffer.GetAddressOf(), nullptr);
+	}
+
 	for (auto& model : models) {
 		if (!model) {
 			throw std::exception("Render error: could not find model");
@@ -118,6 +129,40 @@ void Renderer::Render(std::vector<std::shared_ptr<Entity>>& models, std::vector<
 }
 
 
+void Renderer::RenderHighlight(Intersection& hover, std::unique_ptr<Camera>& camera)
+{
+	if (!hover.hit || !hover.face || !hover.model) return;
+
+	auto& vertexes = hover.model->mMesh->mVertexes;
+	Vector3 p0 = vertexes[hover.face->v[0]].position;
+	Vector3 p1 = vertexes[hover.face->v[1]].position;
+	Vector3 p2 = vertexes[hover.face->v[2]].position;
+
+	Color tint(1.0f, 0.65f, 0.0f, 0.35f);
+	Color outline(1.0f, 0.65f, 0.0f, 1.0f);
+
+	mHighlightEffect->SetMatrices(hover.model->mMatrixWorld, camera->mView, camera->mProjection);
+	mHighlightEffect->Apply(mContext.Get());
+	mContext->IASetInputLayout(mHighlightLayout.Get());
+
+	// no depth test: the hovered face is the nearest one under the cursor
+	mContext->RSSetState(mStates->CullNone());
+	mContext->RSSetViewports(1, &mBackBuffer->mViewport);
+	mContext->OMSetBlendState(mStates->NonPremultiplied(), nullptr, 0xFFFFFFFF);
+	mContext->OMSetDepthStencilState(mStates->DepthNone(), 0);
+	mContext->OMSetRenderTargets(1, mBackBuffer->mColorBuffer.GetAddressOf(), nullptr);
+
+	mHighlightBatch->Begin();
+	mHighlightBatch->DrawTriangle(VertexPositionColor(p0, tint), VertexPositionColor(p1, tint), VertexPositionColor(p2, tint));
+	mHighlightBatch->DrawLine(VertexPositionColor(p0, outline), VertexPositionColor(p1, outline));
+	mHighlightBatch->DrawLine(VertexPositionColor(p1, outline), VertexPositionColor(p2, outline));
+	mHighlightBatch->DrawLine(VertexPositionColor(p2, outline), VertexPositionColor(p0, outline));
+	mHighlightBatch->End();
+
+	mContext->RSSetState(mRasterizer.Get());
+}
+
+
 
 ///////////////////////////////////////////////////////////////////////////////
 // INITIALIZATION
@@ -194,7 +239,7 @@ void Renderer::InitializeShaders()
 	shaderDepth->SetDepthState(dsdesc);
 
 	// initialize Kelemen/Szirmay-Kalos shader
-	auto shaderKelemen = std::make_shared<Shader>(mDevice, mContext, ShaderPath(L"Main.vs.cso"), ShaderPath(L"Main.ps.cso"));
+	auto shaderKelemen = std::make_shared<Shader>(mDevice, mContext, ShaderPath(L"Main.vs.cso"), ShaderPath(L"Main.ps.cso"), VertexFormat::InputLayout());
 	dsdesc = Shader::DefaultDepthDesc();
 	dsdesc.StencilEnable = TRUE;
 	dsdesc.FrontFace.StencilPassOp = D3D11_STENCIL_OP_REPLACE;
@@ -239,8 +284,8 @@ void Renderer::InitializeShaders()
 
 
 	// initialize alternative shaders (Blinn-Phong and Lambertian)
-	auto shaderPhong = std::make_shared<Shader>(mDevice, mContext, ShaderPath(L"Phong.vs.cso"), ShaderPath(L"Phong.ps.cso"));
-	auto shaderLambert = std::make_shared<Shader>(mDevice, mContext, ShaderPath(L"Lambert.vs.cso"), ShaderPath(L"Lambert.ps.cso"));
+	auto shaderPhong = std::make_shared<Shader>(mDevice, mContext, ShaderPath(L"Phong.vs.cso"), ShaderPath(L"Phong.ps.cso"), VertexFormat::InputLayout());
+	auto shaderLambert = std::make_shared<Shader>(mDevice, mContext, ShaderPath(L"Lambert.vs.cso"), ShaderPath(L"Lambert.ps.cso"), VertexFormat::InputLayout());
 
 
 	mShaders.emplace("decal", shaderDecal);
@@ -421,6 +466,18 @@ void Renderer::InitializeKernel()
 }
 
 
+void Renderer::InitializeHighlight()
+{
+	mStates = std::make_unique<CommonStates>(mDevice.Get());
+
+	mHighlightEffect = std::make_unique<BasicEffect>(mDevice.Get());
+	mHighlightEffect->SetVertexColorEnabled(true);
+	HREXCEPT(CreateInputLayoutFromEffect<VertexPositionColor>(mDevice.Get(), mHighlightEffect.get(), mHighlightLayout.ReleaseAndGetAddressOf()));
+
+	mHighlightBatch = std::make_unique<PrimitiveBatch<VertexPositionColor>>(mContext.Get());
+}
+
+
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -499,8 +556,6 @@ void Renderer::Draw(std::shared_ptr<Entity>& model,
 	// input assembler
 	mContext->IASetInputLayout(shader->mInputLayout.Get());
 	mContext->IASetPrimitiveTopology(model->mTopology);
-	mContext->IASetVertexBuffers(0, 1, model->mVertexBuffer.GetAddressOf(), &model->mVertexBufferStrides, &model->mVertexBufferOffset);
-	mContext->IASetIndexBuffer(model->mIndexBuffer.Get(), model->mIndexBufferFormat, model->mIndexBufferOffset);
 
 	// vertex shader
 	mContext->VSSetShader(shader->mVertexShader.Get(), nullptr, 0);
@@ -539,7 +594,14 @@ void Renderer::Draw(std::shared_ptr<Entity>& model,
 		mContext->OMSetRenderTargets(0, nullptr, frameBuffer->mDepthBuffer.Get());
 	}
 
-	mContext->DrawIndexed(model->IndexCount(), 0, 0);
+	// chunks share all state but their buffers
+	for (const MeshChunk& chunk : model->mChunks->Chunks()) {
+		if (chunk.indexCount == 0) continue;
+
+		mContext->IASetVertexBuffers(0, 1, chunk.vertexBuffer.GetAddressOf(), &model->mVertexBufferStrides, &model->mVertexBufferOffset);
+		mContext->IASetIndexBuffer(chunk.indexBuffer.Get(), chunk.indexFormat, 0);
+		mContext->DrawIndexed(chunk.indexCount, 0, 0);
+	}
 }
 
 
@@ -880,7 +942,7 @@ void Renderer::CreateWoundDecal(Intersection& ix)
 
 	// create rotation matrix from direction vector
 	Vector3 position = ix.pos_ws;
-	Vector3 dir = Vector3::Normalize(-ix.ray.direction);
+	Vector3 dir = Vector3::Normalize(-Vector3::TransformNormal(ix.ray.direction, ix.model->mMatrixWorld)); // (ray is in object space)
 
 	Vector3 forward = Vector3::Normalize(Vector3(1,0,0));
 // 	Vector3 right = Vector3::Normalize(Vector3::Cross(dir, Vector3(0,1,0)));
@@ -918,7 +980,9 @@ void Renderer::CreateWoundDecal(Intersection& i0, Intersection& i1)
 {
 	// acquire center position, scale, and average normal from intersections
 	Vector3 position = Vector3::Lerp(i0.pos_ws, i1.pos_ws, 0.5f);
-	Vector3 normal = -Vector3::Normalize(Vector3::Lerp(i0.ray.direction, i1.ray.direction, 0.5f));
+	Vector3 d0 = Vector3::TransformNormal(i0.ray.direction, i0.model->mMatrixWorld); // (rays are in object space)
+	Vector3 d1 = Vector3::TransformNormal(i1.ray.direction, i1.model->mMatrixWorld);
+	Vector3 normal = -Vector3::Normalize(Vector3::Lerp(d0, d1, 0.5f));
 
 	auto& decalTexture = mResources.at("decal");
 
@@ -960,7 +1024,14 @@ void Renderer::PaintWoundPatch(std::shared_ptr<Entity>& model, std::shared_ptr<T
 	
 	// DrawDecal to color map
 	auto rtColor = std::unique_ptr<Target>(new Target(mDevice, mContext, colorDesc.Width, colorDesc.Height, DXGI_FORMAT_B8G8R8A8_UNORM_SRGB, colorTex));
-	
+
+	// Keep painted region for undo
+	D3D11_BOX region = PaintRegion(model, innerFaces, colorDesc.Width, colorDesc.Height);
+	ComPtr<ID3D11Texture2D> before;
+	if (model->Editing() && region.right > region.left && region.bottom > region.top) {
+		before = Utility::CopyTextureRegion(mDevice, mContext, rtColor->mTexture, region);
+	}
+
 	// Loop over faces
 	for (auto& linkfaces : innerFaces) {
 		for (auto& face : linkfaces.second) {
@@ -997,6 +1068,9 @@ void Renderer::PaintWoundPatch(std::shared_ptr<Entity>& model, std::shared_ptr<T
 	}
 
 	model->mColorMap = rtColor->mShaderResource;
+	if (before) {
+		model->RecordPaint(model->mColorMap, region, before, Utility::CopyTextureRegion(mDevice, mContext, rtColor->mTexture, region));
+	}
 }
 
 
@@ -1029,6 +1103,13 @@ void Renderer::PaintDiscoloration(std::shared_ptr<Entity>& model, std::map<Link,
 	// DrawDecal to discolor texture
 	auto target = std::unique_ptr<Target>(new Target(mDevice, mContext, discolorDesc.Width, discolorDesc.Height, DXGI_FORMAT_B8G8R8A8_UNORM, discolorTex));
 
+	// Keep painted region for undo
+	D3D11_BOX region = PaintRegion(model, outerFaces, discolorDesc.Width, discolorDesc.Height);
+	ComPtr<ID3D11Texture2D> before;
+	if (model->Editing() && region.right > region.left && region.bottom > region.top) {
+		before = Utility::CopyTextureRegion(mDevice, mContext, target->mTexture, region);
+	}
+
 	// Configure blending
 	D3D11_RENDER_TARGET_BLEND_DESC rtbDesc{};
 	rtbDesc.BlendEnable = TRUE;
@@ -1075,6 +1156,9 @@ void Renderer::PaintDiscoloration(std::shared_ptr<Entity>& model, std::map<Link,
 	}
 
 	model->mDiscolorMap = target->mShaderResource;
+	if (before) {
+		model->RecordPaint(model->mDiscolorMap, region, before, Utility::CopyTextureRegion(mDevice, mContext, target->mTexture, region));
+	}
 }
 
 
@@ -1082,6 +1166,34 @@ void Renderer::PaintDiscoloration(std::shared_ptr<Entity>& model, std::map<Link,
 ///////////////////////////////////////////////////////////////////////////////
 // ALTERNATIVE RENDERERS
 
+D3D11_BOX Renderer::PaintRegion(std::shared_ptr<Entity>& model, std::map<Link, std::vector<Face*>>& faces, uint32_t width, uint32_t height) const
+{
+	// Texel bounds of the painted faces in texture space (with a margin for rasterization)
+	const float margin = 2.0f;
+	Vector2 lower(FLT_MAX, FLT_MAX), upper(-FLT_MAX, -FLT_MAX);
+
+	for (auto& linkfaces : faces) {
+		for (auto& face : linkfaces.second) {
+			for (uint8_t k = 0; k < 3; ++k) {
+				Vector2 t = model->mMesh->mVertexes[face->v[k]].texcoord;
+				lower = Vector2::Min(lower, t);
+				upper = Vector2::Max(upper, t);
+			}
+		}
+	}
+
+	D3D11_BOX region{};
+	region.left   = (uint32_t)Clamp(std::floor(lower.x * width  - margin), 0.0f, (float)width);
+	region.top    = (uint32_t)Clamp(std::floor(lower.y * height - margin), 0.0f, (float)height);
+	region.right  = (uint32_t)Clamp(std::ceil(upper.x * width  + margin), 0.0f, (float)width);
+	region.bottom = (uint32_t)Clamp(std::ceil(upper.y * height + margin), 0.0f, (float)height);
+	region.front  = 0;
+	region.back   = 1;
+	return region;
+}
+
+
+
 void Renderer::RenderBlinnPhong(std::shared_ptr<Entity>& model, std::vector<std::shared_ptr<Light>>& lights, std::unique_ptr<Camera>& camera)
 {
 	auto& shaderPhong = mShaders.at("phong");
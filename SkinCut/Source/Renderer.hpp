@@ -14,6 +14,11 @@
 #include <d3dcompiler.h>
 #include <DirectXColors.h>
 
+#include "DirectXTK/Inc/Effects.h"
+#include "DirectXTK/Inc/VertexTypes.h"
+#include "DirectXTK/Inc/CommonStates.h"
+#include "DirectXTK/Inc/PrimitiveBatch.h"
+
 #include "Structures.hpp"
 #include "Mathematics.hpp"
 
@@ -62,6 +67,12 @@ namespace SkinCut
 		std::unordered_map<std::string, std::shared_ptr<Texture>> mResources;
 		std::unordered_map<std::string, std::shared_ptr<Target>> mTargets;
 
+		// highlight of the face under the cursor
+		std::unique_ptr<DirectX::CommonStates> mStates;
+		std::unique_ptr<DirectX::BasicEffect> mHighlightEffect;
+		std::unique_ptr<DirectX::PrimitiveBatch<DirectX::VertexPositionColor>> mHighlightBatch;
+		ComPtr<ID3D11InputLayout> mHighlightLayout;
+
 
 	public:
 		Renderer(HWND hwnd, uint32_t width, uint32_t height);
@@ -69,6 +80,7 @@ namespace SkinCut
 
 		void Resize(uint32_t width, uint32_t height);
 		void Render(std::vector<std::shared_ptr<Entity>>& models, std::vector<std::shared_ptr<Light>>& lights, std::unique_ptr<Camera>& camera);
+		void RenderHighlight(Intersection& hover, std::unique_ptr<Camera>& camera); // tint the hovered face over the rendered scene
 
 		void CreateWoundDecal(Intersection& ix);
 		void CreateWoundDecal(Intersection& i0, Intersection& i1);
@@ -85,6 +97,7 @@ namespace SkinCut
 		void InitializeRasterizer();
 		void InitializeTargets();
 		void InitializeKernel();
+		void InitializeHighlight();
 
 		void Draw(std::shared_ptr<VertexBuffer>& vertexbuffer,
 			      std::shared_ptr<Shader>& shader,
@@ -131,6 +144,8 @@ namespace SkinCut
 
 		void UnbindResources(uint32_t numViews, uint32_t startSlot = 0) const;
 		void UnbindRenderTargets(uint32_t numViews) const;
+
+		D3D11_BOX PaintRegion(std::shared_ptr<Entity>& model, std::map<Link, std::vector<Face*>>& faces, uint32_t width, uint32_t height) const;
 	};
 }
 
@@ -0,0 +1,136 @@
+#include "SceneBvh.hpp"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include "Mesh.hpp"
+#include "Entity.hpp"
+
+
+using namespace SkinCut;
+using namespace SkinCut::Math;
+
+
+
+const uint32_t SceneBvh::cNone = Bvh::cNone;
+const float SceneBvh::cPadding = 1e-5f;
+
+
+
+SceneBvh::SceneBvh()
+: mRoot(cNone)
+{
+}
+
+
+void SceneBvh::Update(const std::vector<std::shared_ptr<Entity>>& entities)
+{
+	bool changed = (entities.size() != mEntities.size());
+	mEntities.resize(entities.size());
+
+	for (size_t i = 0; i < entities.size(); ++i) {
+		entities[i]->mMesh->UpdateBvh();
+
+		Item& item = mEntities[i];
+		if (item.entity != entities[i]) {
+			item.entity = entities[i];
+		}
+		else if (item.revision == item.entity->mMesh->mRevision && item.world == item.entity->mMatrixWorld) {
+			continue;
+		}
+
+		Measure(item);
+		changed = true;
+	}
+
+	if (!changed) return;
+
+	std::vector<uint32_t> items;
+	for (uint32_t i = 0; i < mEntities.size(); ++i) {
+		if (!mEntities[i].empty) items.push_back(i);
+	}
+
+	mNodes.clear();
+	mRoot = items.empty() ? cNone : Build(items, 0, items.size());
+}
+
+
+
+void SceneBvh::Measure(Item& item)
+{
+	item.revision = item.entity->mMesh->mRevision;
+	item.world = item.entity->mMatrixWorld;
+	item.inverse = item.world.Invert();
+
+	Vector3 lower, upper;
+	item.empty = !item.entity->mMesh->Bounds(lower, upper);
+	if (item.empty) return;
+
+	// bounds of the corners of the object space bounds in world space
+	const float max = std::numeric_limits<float>::max();
+	item.lower = Vector3(max, max, max);
+	item.upper = Vector3(-max, -max, -max);
+
+	for (uint32_t corner = 0; corner < 8; ++corner) {
+		Vector3 point((corner & 1) ? upper.x : lower.x, (corner & 2) ? upper.y : lower.y, (corner & 4) ? upper.z : lower.z);
+		Bvh::Grow(item.lower, item.upper, Vector3::Transform(point, item.world));
+	}
+
+	// enlarge by the rounding of transforming rays and points (relative to their magnitude)
+	float magnitude = 0.0f;
+	for (uint32_t axis = 0; axis < 3; ++axis) {
+		magnitude = std::max(magnitude, std::max(std::abs(Bvh::Component(item.lower, axis)), std::abs(Bvh::Component(item.upper, axis))));
+	}
+
+	Vector3 padding(magnitude * cPadding, magnitude * cPadding, magnitude * cPadding);
+	item.lower -= padding;
+	item.upper += padding;
+}
+
+
+uint32_t SceneBvh::Build(std::vector<uint32_t>& entities, size_t begin, size_t end)
+{
+	uint32_t index = static_cast<uint32_t>(mNodes.size());
+	mNodes.emplace_back();
+
+	const float max = std::numeric_limits<float>::max();
+	Vector3 lower(max, max, max), upper(-max, -max, -max);
+	Vector3 centroidLower = lower, centroidUpper = upper;
+
+	for (size_t i = begin; i < end; ++i) {
+		const Item& item = mEntities[entities[i]];
+		Bvh::Grow(lower, upper, item.lower);
+		Bvh::Grow(lower, upper, item.upper);
+		Bvh::Grow(centroidLower, centroidUpper, (item.lower + item.upper) * 0.5f);
+	}
+
+	if (end - begin == 1) {
+		Node& node = mNodes[index];
+		node.lower = lower;
+		node.upper = upper;
+		node.children[0] = node.children[1] = cNone;
+		node.entity = entities[begin];
+		return index;
+	}
+
+	// split at the median centroid along the axis on which centroids are spread most
+	Vector3 spread = centroidUpper - centroidLower;
+	uint32_t axis = (spread.x >= spread.y && spread.x >= spread.z) ? 0 : (spread.y >= spread.z) ? 1 : 2;
+
+	size_t middle = begin + (end - begin) / 2;
+	std::nth_element(entities.begin() + begin, entities.begin() + middle, entities.begin() + end, [&](uint32_t a, uint32_t b) {
+		return Bvh::Component(mEntities[a].lower + mEntities[a].upper, axis) < Bvh::Component(mEntities[b].lower + mEntities[b].upper, axis);
+	});
+
+	uint32_t left = Build(entities, begin, middle);
+	uint32_t right = Build(entities, middle, end);
+
+	Node& node = mNodes[index]; // (after building the children, which may move the nodes)
+	node.lower = lower;
+	node.upper = upper;
+	node.children[0] = left;
+	node.children[1] = right;
+	node.entity = cNone;
+	return index;
+}
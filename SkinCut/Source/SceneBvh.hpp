@@ -0,0 +1,114 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+
+#include "Bvh.hpp"
+#include "Structures.hpp"
+#include "Mathematics.hpp"
+
+
+
+namespace SkinCut
+{
+	class Entity;
+
+
+	// Bounding volume hierarchy over the world-space bounds of the entities of a scene, the top
+	// level above the face hierarchies of their meshes. Ray queries visit the entities whose
+	// bounds the ray enters, nearest first, and skip those entered beyond the nearest hit so far.
+	//
+	// Rays are transformed into the object space of each entity by the inverse of its world
+	// matrix. Directions are not normalized after the transform, so distances along the object
+	// space ray are the same as along the world space ray and compare across entities.
+	//
+	// Bounds are recomputed for entities whose mesh revision or world matrix changed, after which
+	// the hierarchy is rebuilt (scenes hold dozens of entities, so this is cheap). Updating also
+	// brings the face hierarchies of the meshes up to date, so that queries only read them and can
+	// run on several threads at once.
+	class SceneBvh
+	{
+	public: // constants
+		static const uint32_t cNone;
+		static const float cPadding; // relative enlargement of world bounds (for rounding of transforms)
+
+	private:
+		struct Node
+		{
+			Math::Vector3 lower, upper;
+			uint32_t children[2]; // (cNone for leaves)
+			uint32_t entity; // index into mEntities (leaves only)
+		};
+
+		struct Item // entity with its world bounds
+		{
+			std::shared_ptr<Entity> entity;
+			uint64_t revision; // mesh revision of the bounds
+			Math::Matrix world; // world matrix of the bounds
+			Math::Matrix inverse; // object space from world space
+			Math::Vector3 lower, upper;
+			bool empty; // mesh has no faces rays can hit
+		};
+
+		uint32_t mRoot; // (cNone if no entity has bounds)
+		std::vector<Node> mNodes;
+		std::vector<Item> mEntities; // in the order of the scene
+
+
+	public:
+		SceneBvh();
+
+		void Update(const std::vector<std::shared_ptr<Entity>>& entities); // bring bounds and hierarchy up to date with the entities of a scene
+
+		// Nearest hit of a ray (in world space) on the entities; at equal distances, the entity that
+		// comes first in the scene. query(entity, ray, ix) finds the closest hit on an entity with
+		// the ray in its object space (e.g. Mesh::ClosestIntersection). Besides what the query sets,
+		// ix gets the hit, the ray in object space, the entity and the world space position.
+		template <class Query>
+		bool Closest(const Math::Ray& ray, Intersection& ix, Query query) const
+		{
+			const Math::Ray world = ray; // (ray may be ix.ray, which is replaced)
+			uint32_t nearest = cNone;
+
+			Traverse(world, [&](const std::shared_ptr<Entity>& entity, uint32_t index, Math::Ray& local, float& tmax) {
+				Intersection candidate = ix;
+				if (!query(entity, local, candidate)) return false;
+
+				if (candidate.dist < tmax || (candidate.dist == tmax && index < nearest)) {
+					ix = candidate;
+					ix.hit = true;
+					ix.ray = local; // (object space, as the other mesh data)
+					ix.model = entity;
+					tmax = ix.dist;
+					nearest = index;
+				}
+				return false;
+			});
+
+			if (nearest == cNone) return false;
+
+			ix.pos_ws = Math::Vector3::Transform(ix.pos_os, mEntities[nearest].world);
+			return true;
+		}
+
+		// Visits the entities whose bounds the ray (in world space) enters within [0, tmax),
+		// nearest first, with the ray in their object space. test(entity, index, ray, tmax) returns
+		// true to end the traversal, and may lower tmax (e.g. to the distance of a hit); index is
+		// the position of the entity in the scene (to settle hits at equal distances).
+		template <class Test>
+		void Traverse(const Math::Ray& ray, Test test) const
+		{
+			Bvh::Walk(mNodes, mRoot, ray, [&](const Node& leaf, float& tmax) {
+				const Item& item = mEntities[leaf.entity];
+				Math::Ray local(Math::Vector3::Transform(ray.origin, item.inverse), Math::Vector3::TransformNormal(ray.direction, item.inverse));
+				return test(item.entity, leaf.entity, local, tmax);
+			});
+		}
+
+
+	private:
+		void Measure(Item& item); // world bounds of an entity
+		uint32_t Build(std::vector<uint32_t>& entities, size_t begin, size_t end); // returns the root of the subtree
+	};
+}
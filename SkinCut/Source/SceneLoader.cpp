@@ -0,0 +1,119 @@
+#include "SceneLoader.hpp"
+
+#include <algorithm>
+
+#include "Mesh.hpp"
+#include "Utility.hpp"
+#include "Parallel.hpp"
+
+
+using namespace SkinCut;
+
+
+
+SceneLoader::SceneLoader(ComPtr<ID3D11Device>& device, const std::vector<EntityLoadInfo>& models)
+: mDevice(device), mInfos(models), mResources(models.size()), mModels(models.size()), mCreated(0),
+  mCancel(false), mRemaining(models.size(), RESOURCE_COUNT), mFinished(0)
+{
+	mThread = std::thread(&SceneLoader::Work, this);
+}
+
+
+SceneLoader::~SceneLoader()
+{
+	mCancel = true;
+	mThread.join();
+}
+
+
+bool SceneLoader::Update()
+{
+	std::vector<uint32_t> ready;
+	{
+		std::lock_guard<std::mutex> lock(mLock);
+		if (mError) std::rethrow_exception(mError);
+		std::swap(ready, mReady);
+	}
+
+	for (uint32_t model : ready) {
+		mModels[model] = std::make_shared<Entity>(mDevice, mInfos[model], std::move(mResources[model]));
+		mCreated++;
+	}
+
+	return mCreated == mModels.size();
+}
+
+
+float SceneLoader::Progress()
+{
+	std::lock_guard<std::mutex> lock(mLock);
+	size_t steps = mModels.size() * (RESOURCE_COUNT + 1);
+	return (steps == 0) ? 1.0f : float(mFinished + mCreated) / float(steps);
+}
+
+
+void SceneLoader::Work()
+{
+	const uint32_t jobs = static_cast<uint32_t>(mInfos.size()) * RESOURCE_COUNT;
+
+	Parallel::For(jobs, [&](uint32_t job) {
+		if (mCancel) return;
+		uint32_t model = job / RESOURCE_COUNT;
+
+		try {
+			Run(job);
+		}
+		catch (...) {
+			std::lock_guard<std::mutex> lock(mLock);
+			if (!mError) mError = std::current_exception();
+			mCancel = true; // (the scene cannot be completed)
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(mLock);
+		mFinished++;
+		if (--mRemaining[model] == 0) {
+			mReady.push_back(model);
+		}
+	});
+}
+
+
+void SceneLoader::Run(uint32_t job)
+{
+	// Jobs of the same model write different members of its resources.
+	const EntityLoadInfo& info = mInfos[job / RESOURCE_COUNT];
+	EntityResources& resources = mResources[job / RESOURCE_COUNT];
+
+	switch (job % RESOURCE_COUNT) {
+		case RESOURCE_MESH: {
+			resources.mesh = std::unique_ptr<Mesh>(new Mesh(info.meshPath));
+			break;
+		}
+
+		case RESOURCE_COLOR: {
+			resources.colorMap = Utility::LoadTexture(mDevice, info.colorPath);
+			break;
+		}
+
+		case RESOURCE_NORMAL: {
+			resources.normalMap = Utility::LoadTexture(mDevice, info.normalPath);
+			break;
+		}
+
+		case RESOURCE_SPECULAR: {
+			resources.specularMap = Utility::LoadTexture(mDevice, info.specularPath);
+			break;
+		}
+
+		case RESOURCE_DISCOLOR: {
+			resources.discolorMap = Utility::LoadTexture(mDevice, info.discolorPath);
+			break;
+		}
+
+		case RESOURCE_OCCLUSION: {
+			resources.occlusionMap = Utility::LoadTexture(mDevice, info.occlusionPath);
+			break;
+		}
+	}
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <exception>
+
+#include <d3d11.h>
+#include <wrl/client.h>
+
+#include "Entity.hpp"
+
+
+using Microsoft::WRL::ComPtr;
+
+
+
+namespace SkinCut
+{
+	// Loads the models of a scene in the background. The mesh and each texture map of a model are
+	// separate jobs, run on the worker pool of Parallel by a background thread that takes part
+	// itself (textures are created on the device, which is free-threaded). Meshes use the same
+	// pool while they load, so loading never runs more threads than Parallel::Threads() plus one.
+	// Update creates a model as soon as all of its jobs have finished; it must be called on the
+	// thread that owns the device context, which the vertex and index buffers are uploaded with.
+	// The models are handed over together, so a scene is only replaced by a complete one.
+	class SceneLoader
+	{
+	private:
+		enum Resource : uint32_t
+		{
+			RESOURCE_MESH,
+			RESOURCE_COLOR,
+			RESOURCE_NORMAL,
+			RESOURCE_SPECULAR,
+			RESOURCE_DISCOLOR,
+			RESOURCE_OCCLUSION,
+			RESOURCE_COUNT
+		};
+
+		ComPtr<ID3D11Device> mDevice;
+		std::vector<EntityLoadInfo> mInfos;
+		std::vector<EntityResources> mResources;
+		std::vector<std::shared_ptr<Entity>> mModels;
+		uint32_t mCreated; // models created by Update
+
+		std::thread mThread; // hands the jobs to the worker pool (they are numbered model by model: model * RESOURCE_COUNT + resource)
+		std::atomic<bool> mCancel;
+
+		std::mutex mLock; // guards the members below
+		std::vector<uint32_t> mRemaining; // unfinished jobs per model
+		std::vector<uint32_t> mReady; // models whose jobs have all finished
+		uint32_t mFinished; // jobs finished
+		std::exception_ptr mError; // first error of a job
+
+
+	public:
+		SceneLoader(ComPtr<ID3D11Device>& device, const std::vector<EntityLoadInfo>& models);
+		~SceneLoader(); // jobs that have not started are abandoned
+		SceneLoader(const SceneLoader&) = delete;
+		SceneLoader& operator=(const SceneLoader&) = delete;
+
+		bool Update(); // create the models that are ready; true once all exist (rethrows the error of a failed job)
+		float Progress(); // fraction of the jobs and model creations done
+		std::vector<std::shared_ptr<Entity>>& Models() { return mModels; } // in scene order (complete once Update returns true)
+
+
+	private:
+		void Work();
+		void Run(uint32_t job);
+	};
+}
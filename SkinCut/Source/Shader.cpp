@@ -13,7 +13,8 @@ using namespace SkinCut;
 
 
 Shader::Shader(ComPtr<ID3D11Device>& device, ComPtr<ID3D11DeviceContext>& context, 
-	const std::wstring vsFile, const std::wstring psFile) : mDevice(device), mContext(context)
+	const std::wstring vsFile, const std::wstring psFile, const std::vector<D3D11_INPUT_ELEMENT_DESC>& inputLayout) 
+	: mDevice(device), mContext(context)
 {
 	mStencilRef = 0;
 
@@ -36,7 +37,7 @@ Shader::Shader(ComPtr<ID3D11Device>& device, ComPtr<ID3D11DeviceContext>& contex
 		InitializeConstantBuffers(vsBlob, mVertexBuffers);
 	}
 
-	InitializeInputLayout(vsBlob);
+	InitializeInputLayout(vsBlob, inputLayout);
 	HREXCEPT(mDevice->CreateVertexShader(vsBlob->GetBufferPointer(), 
 		vsBlob->GetBufferSize(), nullptr, mVertexShader.GetAddressOf()));
 
@@ -56,8 +57,15 @@ Shader::Shader(ComPtr<ID3D11Device>& device, ComPtr<ID3D11DeviceContext>& contex
 }
 
 
-void Shader::InitializeInputLayout(ComPtr<ID3DBlob>& vsBlob)
+void Shader::InitializeInputLayout(ComPtr<ID3DBlob>& vsBlob, const std::vector<D3D11_INPUT_ELEMENT_DESC>& inputLayout)
 {
+	// Use explicit layout (e.g. packed vertex formats, which cannot be derived from the shader signature)
+	if (!inputLayout.empty()) {
+		HREXCEPT(mDevice->CreateInputLayout(&inputLayout[0], static_cast<uint32_t>(inputLayout.size()), 
+			vsBlob->GetBufferPointer(), vsBlob->GetBufferSize(), mInputLayout.GetAddressOf()));
+		return;
+	}
+
 	// Reflect shader info
 	ComPtr<ID3D11ShaderReflection> shaderReflection;
 	HREXCEPT(D3DReflect(vsBlob->GetBufferPointer(), vsBlob->GetBufferSize(), 
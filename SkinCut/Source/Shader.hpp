@@ -50,9 +50,10 @@ namespace SkinCut
 
 
 	public:
-		Shader(ComPtr<ID3D11Device>& device, ComPtr<ID3D11DeviceContext>& context, const std::wstring vsFile, const std::wstring psFile = L"");
+		Shader(ComPtr<ID3D11Device>& device, ComPtr<ID3D11DeviceContext>& context, const std::wstring vsFile, const std::wstring psFile = L"",
+			   const std::vector<D3D11_INPUT_ELEMENT_DESC>& inputLayout = {}); // input layout is reflected from the vertex shader if empty
 
-		void InitializeInputLayout(ComPtr<ID3DBlob>& vsblob);
+		void InitializeInputLayout(ComPtr<ID3DBlob>& vsblob, const std::vector<D3D11_INPUT_ELEMENT_DESC>& inputLayout);
 		void InitializeConstantBuffers(ComPtr<ID3DBlob>& blob, std::vector<ComPtr<ID3D11Buffer>>& buffers);
 
 		virtual void InitializeBlendState();
@@ -35,6 +35,14 @@ namespace SkinCut
 		Math::Vector3 bitangent;
 	};
 
+	struct PackedVertex											// Compressed render vertex (see VertexFormat.hpp)
+	{
+		Math::Vector3 position;									// R32G32B32_FLOAT
+		DirectX::PackedVector::XMHALF2 texcoord;				// R16G16_FLOAT
+		DirectX::PackedVector::XMSHORTN2 normal;				// R16G16_SNORM, octahedral encoding
+		DirectX::PackedVector::XMSHORTN4 tangent;				// R16G16B16A16_SNORM, tangent frame quaternion (w < 0: negative handedness)
+	};
+
 	struct VertexPosition
 	{
 		Math::Vector3 position;
@@ -49,11 +57,12 @@ namespace SkinCut
 
 	struct Node
 	{
-		Math::Vector3 p;
+		uint32_t id;									// Handle into mesh topology store (position lives in Mesh::mPositions)
 	};
 
 	struct Edge
 	{
+		uint32_t id;									// Handle into mesh topology store
 		std::array<Node*, 2> n;							// Incident nodes (unordered)
 		std::array<Face*, 2> f;							// Incident faces
 		std::array<std::pair<Node*, uint32_t>, 2> p;	// Endpoints <node,vertex> (directed)
@@ -61,6 +70,7 @@ namespace SkinCut
 
 	struct Face
 	{
+		uint32_t id;									// Handle into mesh topology store
 		std::array<uint32_t, 3> v;						// Vertex indexes
 		std::array<Node*, 3>  n;						// Node references
 		std::array<Edge*, 3>  e;						// Edge references
@@ -196,6 +206,7 @@ namespace SkinCut
 		bool EnableOcclusion;
 		bool EnableIrradiance;
 		bool EnableScattering;
+		bool EnableReordering; // reorder the chunks that edits changed for the vertex cache when idle
 
 		float Ambient;
 		float Fresnel;
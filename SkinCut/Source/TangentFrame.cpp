@@ -0,0 +1,248 @@
+#include "TangentFrame.hpp"
+
+#include <array>
+#include <algorithm>
+
+#include "Parallel.hpp"
+#include "ObjParser.hpp"
+#include "Structures.hpp"
+#include "Mathematics.hpp"
+
+
+using namespace DirectX;
+using namespace SkinCut;
+using namespace SkinCut::Math;
+
+
+
+namespace
+{
+	// Four 3D vectors, one per lane (structure of arrays).
+	struct Vector3x4
+	{
+		XMVECTOR x, y, z;
+	};
+
+	// Per-face values, one array per component.
+	typedef std::array<std::vector<float>, 3> Components;
+
+
+	inline Vector3x4 Gather(const std::vector<Vector3>& v, const uint32_t (&i)[4])
+	{
+		return {
+			XMVectorSet(v[i[0]].x, v[i[1]].x, v[i[2]].x, v[i[3]].x),
+			XMVectorSet(v[i[0]].y, v[i[1]].y, v[i[2]].y, v[i[3]].y),
+			XMVectorSet(v[i[0]].z, v[i[1]].z, v[i[2]].z, v[i[3]].z) };
+	}
+
+	inline void Store(Components& c, size_t i, const Vector3x4& v)
+	{
+		XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(&c[0][i]), v.x);
+		XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(&c[1][i]), v.y);
+		XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(&c[2][i]), v.z);
+	}
+
+	inline void StoreLanes(float (&c)[3][4], const Vector3x4& v)
+	{
+		XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(c[0]), v.x);
+		XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(c[1]), v.y);
+		XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(c[2]), v.z);
+	}
+
+	inline Vector3x4 Subtract(const Vector3x4& a, const Vector3x4& b)
+	{
+		return { XMVectorSubtract(a.x, b.x), XMVectorSubtract(a.y, b.y), XMVectorSubtract(a.z, b.z) };
+	}
+
+	inline Vector3x4 Scale(const Vector3x4& a, FXMVECTOR s)
+	{
+		return { XMVectorMultiply(a.x, s), XMVectorMultiply(a.y, s), XMVectorMultiply(a.z, s) };
+	}
+
+	inline XMVECTOR Dot(const Vector3x4& a, const Vector3x4& b)
+	{
+		return XMVectorAdd(XMVectorAdd(XMVectorMultiply(a.x, b.x), XMVectorMultiply(a.y, b.y)), XMVectorMultiply(a.z, b.z));
+	}
+
+	inline Vector3x4 Cross(const Vector3x4& a, const Vector3x4& b)
+	{
+		return {
+			XMVectorSubtract(XMVectorMultiply(a.y, b.z), XMVectorMultiply(a.z, b.y)),
+			XMVectorSubtract(XMVectorMultiply(a.z, b.x), XMVectorMultiply(a.x, b.z)),
+			XMVectorSubtract(XMVectorMultiply(a.x, b.y), XMVectorMultiply(a.y, b.x)) };
+	}
+
+	// (zero for zero-length vectors, as Vector3::Normalize)
+	inline Vector3x4 Normalize(const Vector3x4& a)
+	{
+		XMVECTOR length = XMVectorSqrt(Dot(a, a));
+		XMVECTOR zero = XMVectorEqual(length, XMVectorZero());
+		return {
+			XMVectorSelect(XMVectorDivide(a.x, length), XMVectorZero(), zero),
+			XMVectorSelect(XMVectorDivide(a.y, length), XMVectorZero(), zero),
+			XMVectorSelect(XMVectorDivide(a.z, length), XMVectorZero(), zero) };
+	}
+
+	// -1 if negative, 0 if 0, +1 if positive (as Math::Sign)
+	inline XMVECTOR Sign(FXMVECTOR v)
+	{
+		XMVECTOR one = XMVectorSplatOne();
+		XMVECTOR negative = XMVectorSelect(XMVectorZero(), XMVectorNegate(one), XMVectorLess(v, XMVectorZero()));
+		return XMVectorSelect(negative, one, XMVectorGreater(v, XMVectorZero()));
+	}
+}
+
+
+
+void TangentFrame::Generate(const ObjData& obj, const std::vector<uint32_t>& indexes, bool computeNormals, std::vector<Vertex>& vertexes)
+{
+	const std::vector<Vector3>& positions = obj.positions;
+	const std::vector<Vector2>& texcoords = obj.texcoords;
+	const std::vector<Indexer>& corners = obj.vertexes;
+
+	const uint32_t faceCount = static_cast<uint32_t>(indexes.size() / 3);
+	const uint32_t positionCount = static_cast<uint32_t>(positions.size());
+	const uint32_t vertexCount = static_cast<uint32_t>(corners.size());
+
+	computeNormals |= obj.normals.empty();
+
+
+	// Stage 1: face normals, tangents and bitangents (http://www.terathon.com/code/tangent.html),
+	// four faces per iteration. The arrays are padded to whole iterations.
+	const size_t paddedFaceCount = (faceCount + 3) & ~size_t(3);
+	Components faceNormals, faceTangents, faceBitangents;
+	for (uint32_t k = 0; k < 3; ++k) {
+		if (computeNormals) faceNormals[k].resize(paddedFaceCount);
+		faceTangents[k].resize(paddedFaceCount);
+		faceBitangents[k].resize(paddedFaceCount);
+	}
+
+	Parallel::For(Parallel::Tasks(faceCount, cGrain), [&](uint32_t task) {
+		uint32_t end = std::min(faceCount, (task + 1) * cGrain);
+
+		for (uint32_t f = task * cGrain; f < end; f += 4) {
+			uint32_t p[3][4], x[3][4];
+			for (uint32_t lane = 0; lane < 4; ++lane) {
+				uint32_t face = std::min(f + lane, faceCount - 1); // (unused lanes repeat the last face)
+				for (uint32_t c = 0; c < 3; ++c) {
+					const Indexer& corner = corners[indexes[face * 3 + c]];
+					p[c][lane] = corner.pi;
+					x[c][lane] = corner.xi;
+				}
+			}
+
+			Vector3x4 p1 = Gather(positions, p[0]);
+			Vector3x4 e1 = Subtract(Gather(positions, p[1]), p1);
+			Vector3x4 e2 = Subtract(Gather(positions, p[2]), p1);
+
+			if (computeNormals) {
+				Store(faceNormals, f, Cross(e1, e2));
+			}
+
+			XMVECTOR u1 = XMVectorSet(texcoords[x[0][0]].x, texcoords[x[0][1]].x, texcoords[x[0][2]].x, texcoords[x[0][3]].x);
+			XMVECTOR v1 = XMVectorSet(texcoords[x[0][0]].y, texcoords[x[0][1]].y, texcoords[x[0][2]].y, texcoords[x[0][3]].y);
+			XMVECTOR s1 = XMVectorSubtract(XMVectorSet(texcoords[x[1][0]].x, texcoords[x[1][1]].x, texcoords[x[1][2]].x, texcoords[x[1][3]].x), u1);
+			XMVECTOR t1 = XMVectorSubtract(XMVectorSet(texcoords[x[1][0]].y, texcoords[x[1][1]].y, texcoords[x[1][2]].y, texcoords[x[1][3]].y), v1);
+			XMVECTOR s2 = XMVectorSubtract(XMVectorSet(texcoords[x[2][0]].x, texcoords[x[2][1]].x, texcoords[x[2][2]].x, texcoords[x[2][3]].x), u1);
+			XMVECTOR t2 = XMVectorSubtract(XMVectorSet(texcoords[x[2][0]].y, texcoords[x[2][1]].y, texcoords[x[2][2]].y, texcoords[x[2][3]].y), v1);
+
+			// inverse of the (s,t) matrix (zero if singular)
+			XMVECTOR r = XMVectorReciprocal(XMVectorSubtract(XMVectorMultiply(s1, t2), XMVectorMultiply(s2, t1)));
+			r = XMVectorSelect(r, XMVectorZero(), XMVectorOrInt(XMVectorIsNaN(r), XMVectorIsInfinite(r)));
+
+			// tangent points in the u texture direction, bitangent in the v texture direction
+			Vector3x4 tangent = Scale(Subtract(Scale(e1, t2), Scale(e2, t1)), r);
+			Vector3x4 bitangent = Scale(Subtract(Scale(e2, s1), Scale(e1, s2)), r);
+
+			Store(faceTangents, f, tangent);
+			Store(faceBitangents, f, bitangent);
+		}
+	});
+
+
+	// Stage 2: accumulation per position. The corners of each position are listed in face order
+	// (counting sort), so every sum is formed in the same order regardless of how the positions
+	// are divided over tasks.
+	std::vector<uint32_t> first(positionCount + 1, 0), incident(faceCount * 3);
+	for (uint32_t i = 0; i < faceCount * 3; ++i) {
+		first[corners[indexes[i]].pi + 1]++;
+	}
+	for (uint32_t i = 0; i < positionCount; ++i) {
+		first[i + 1] += first[i];
+	}
+	{
+		std::vector<uint32_t> cursor(first.begin(), first.end() - 1);
+		for (uint32_t i = 0; i < faceCount * 3; ++i) {
+			incident[cursor[corners[indexes[i]].pi]++] = i;
+		}
+	}
+
+	std::vector<Vector3> normals(positionCount), tangents(positionCount), bitangents(positionCount);
+
+	Parallel::For(Parallel::Tasks(positionCount, cGrain), [&](uint32_t task) {
+		uint32_t end = std::min(positionCount, (task + 1) * cGrain);
+
+		for (uint32_t p = task * cGrain; p < end; ++p) {
+			Vector3 normal, tangent, bitangent;
+
+			for (uint32_t k = first[p]; k < first[p + 1]; ++k) {
+				uint32_t f = incident[k] / 3;
+
+				if (computeNormals) {
+					normal += Vector3(faceNormals[0][f], faceNormals[1][f], faceNormals[2][f]);
+				}
+				else { // use normals from obj file
+					normal += obj.normals[corners[indexes[incident[k]]].ni];
+				}
+				tangent += Vector3(faceTangents[0][f], faceTangents[1][f], faceTangents[2][f]);
+				bitangent += Vector3(faceBitangents[0][f], faceBitangents[1][f], faceBitangents[2][f]);
+			}
+
+			normals[p] = normal;
+			tangents[p] = tangent;
+			bitangents[p] = bitangent;
+		}
+	});
+
+
+	// Stage 3: vertexes, four per iteration. The position index can be used for the accumulated
+	// values because index order is equivalent.
+	vertexes.resize(vertexCount);
+
+	Parallel::For(Parallel::Tasks(vertexCount, cGrain), [&](uint32_t task) {
+		uint32_t end = std::min(vertexCount, (task + 1) * cGrain);
+
+		for (uint32_t v = task * cGrain; v < end; v += 4) {
+			uint32_t p[4];
+			for (uint32_t lane = 0; lane < 4; ++lane) {
+				p[lane] = corners[std::min(v + lane, vertexCount - 1)].pi;
+			}
+
+			Vector3x4 normal = Normalize(Gather(normals, p));
+			Vector3x4 tangent = Gather(tangents, p);
+			Vector3x4 bitangent = Gather(bitangents, p);
+
+			// normalize and orthogonalize tangent with Gram-Schmidt
+			Vector3x4 orthogonal = Normalize(Subtract(tangent, Scale(normal, Dot(normal, tangent))));
+
+			// handedness of bitangent = sign of determinant of TBN matrix
+			XMVECTOR handedness = Sign(Dot(Cross(normal, tangent), bitangent));
+
+			float n[3][4], t[3][4], h[4];
+			StoreLanes(n, normal);
+			StoreLanes(t, orthogonal);
+			XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(h), handedness);
+
+			for (uint32_t lane = 0; lane < 4 && v + lane < end; ++lane) {
+				const Indexer& corner = corners[v + lane];
+
+				Vertex& vertex = vertexes[v + lane];
+				vertex.position = positions[corner.pi];
+				vertex.texcoord = texcoords[corner.xi];
+				vertex.normal = Vector3(n[0][lane], n[1][lane], n[2][lane]);
+				vertex.tangent = Vector4(t[0][lane], t[1][lane], t[2][lane], h[lane]); // store bitangent handedness in alpha channel
+				vertex.bitangent = bitangents[corner.pi];
+			}
+		}
+	});
+}
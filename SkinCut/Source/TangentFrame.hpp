@@ -0,0 +1,27 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+
+
+namespace SkinCut
+{
+	struct Vertex;
+	struct ObjData;
+
+
+	// Vertex normals and tangent frames of an imported mesh. Runs in three stages: per-face
+	// normals, tangents and bitangents (four faces at a time), accumulation per position (each
+	// position sums its faces in face order) and per-vertex orthogonalization (four vertexes at
+	// a time). Tasks cover fixed ranges and every sum has a fixed order, so the result is the
+	// same for any number of threads.
+	namespace TangentFrame
+	{
+		static const uint32_t cGrain = 1 << 14; // faces, positions or vertexes per task (multiple of 4)
+
+		// Vertexes of obj.vertexes, given the triangles of indexes (into obj.vertexes). Normals are
+		// taken from the file if it has any, unless computeNormals is set.
+		void Generate(const ObjData& obj, const std::vector<uint32_t>& indexes, bool computeNormals, std::vector<Vertex>& vertexes);
+	}
+}
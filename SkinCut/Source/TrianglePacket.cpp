@@ -0,0 +1,167 @@
+#include "TrianglePacket.hpp"
+
+#include <cmath>
+#include <algorithm>
+#include <immintrin.h>
+
+
+using namespace SkinCut;
+using namespace SkinCut::Math;
+
+
+
+namespace
+{
+	// Smallest float not below cEpsilon (a double), so that comparing float determinants with it
+	// decides as the scalar test does.
+	const float cMinDeterminant = (float(cEpsilon) < cEpsilon) ? std::nextafter(float(cEpsilon), 1.0f) : float(cEpsilon);
+
+
+#if defined(__AVX2__)
+	typedef __m256 Lanes;
+
+	Lanes Load(const float* p) { return _mm256_loadu_ps(p); }
+	Lanes Broadcast(float f) { return _mm256_set1_ps(f); }
+	void Store(float* p, Lanes a) { _mm256_storeu_ps(p, a); }
+
+	Lanes Add(Lanes a, Lanes b) { return _mm256_add_ps(a, b); }
+	Lanes Sub(Lanes a, Lanes b) { return _mm256_sub_ps(a, b); }
+	Lanes Mul(Lanes a, Lanes b) { return _mm256_mul_ps(a, b); }
+	Lanes Div(Lanes a, Lanes b) { return _mm256_div_ps(a, b); }
+
+	// ordered comparisons (false for NaN, as with scalar floats)
+	Lanes Less(Lanes a, Lanes b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+	Lanes Greater(Lanes a, Lanes b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+	Lanes Or(Lanes a, Lanes b) { return _mm256_or_ps(a, b); }
+	uint32_t Bits(Lanes mask) { return static_cast<uint32_t>(_mm256_movemask_ps(mask)); }
+
+	// a * b - c * d as XMVector3Cross computes it (fused when DirectXMath uses FMA3)
+	Lanes MulSub(Lanes a, Lanes b, Lanes c, Lanes d)
+	{
+#if defined(_XM_FMA3_INTRINSICS_)
+		return _mm256_fnmadd_ps(c, d, Mul(a, b));
+#else
+		return Sub(Mul(a, b), Mul(c, d));
+#endif
+	}
+#else
+	typedef __m128 Lanes;
+
+	Lanes Load(const float* p) { return _mm_loadu_ps(p); }
+	Lanes Broadcast(float f) { return _mm_set1_ps(f); }
+	void Store(float* p, Lanes a) { _mm_storeu_ps(p, a); }
+
+	Lanes Add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+	Lanes Sub(Lanes a, Lanes b) { return _mm_sub_ps(a, b); }
+	Lanes Mul(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+	Lanes Div(Lanes a, Lanes b) { return _mm_div_ps(a, b); }
+
+	// ordered comparisons (false for NaN, as with scalar floats)
+	Lanes Less(Lanes a, Lanes b) { return _mm_cmplt_ps(a, b); }
+	Lanes Greater(Lanes a, Lanes b) { return _mm_cmpgt_ps(a, b); }
+	Lanes Or(Lanes a, Lanes b) { return _mm_or_ps(a, b); }
+	uint32_t Bits(Lanes mask) { return static_cast<uint32_t>(_mm_movemask_ps(mask)); }
+
+	// a * b - c * d as XMVector3Cross computes it
+	Lanes MulSub(Lanes a, Lanes b, Lanes c, Lanes d)
+	{
+		return Sub(Mul(a, b), Mul(c, d));
+	}
+#endif
+
+
+	struct Vector3Lanes
+	{
+		Lanes x, y, z;
+	};
+
+	Vector3Lanes Load(const float rows[3][TrianglePackets::cLanes])
+	{
+		return { Load(rows[0]), Load(rows[1]), Load(rows[2]) };
+	}
+
+	Vector3Lanes Broadcast(const Vector3& v)
+	{
+		return { Broadcast(v.x), Broadcast(v.y), Broadcast(v.z) };
+	}
+
+	Vector3Lanes Cross(const Vector3Lanes& a, const Vector3Lanes& b)
+	{
+		return { MulSub(a.y, b.z, a.z, b.y), MulSub(a.z, b.x, a.x, b.z), MulSub(a.x, b.y, a.y, b.x) };
+	}
+
+	Lanes Dot(const Vector3Lanes& a, const Vector3Lanes& b)
+	{
+		return Add(Add(Mul(a.x, b.x), Mul(a.y, b.y)), Mul(a.z, b.z));
+	}
+}
+
+
+
+void TrianglePackets::Clear(TrianglePacket& packet)
+{
+	std::fill(&packet.v0[0][0], &packet.v0[0][0] + 3 * cLanes, 0.0f);
+	std::fill(&packet.e1[0][0], &packet.e1[0][0] + 3 * cLanes, 0.0f);
+	std::fill(&packet.e2[0][0], &packet.e2[0][0] + 3 * cLanes, 0.0f);
+}
+
+
+void TrianglePackets::Set(TrianglePacket& packet, uint32_t lane, const Triangle& triangle)
+{
+	Vector3 e1 = triangle.v1 - triangle.v0;
+	Vector3 e2 = triangle.v2 - triangle.v0;
+
+	packet.v0[0][lane] = triangle.v0.x; packet.v0[1][lane] = triangle.v0.y; packet.v0[2][lane] = triangle.v0.z;
+	packet.e1[0][lane] = e1.x; packet.e1[1][lane] = e1.y; packet.e1[2][lane] = e1.z;
+	packet.e2[0][lane] = e2.x; packet.e2[1][lane] = e2.y; packet.e2[2][lane] = e2.z;
+}
+
+
+void TrianglePackets::Pack(const std::vector<Triangle>& triangles, std::vector<TrianglePacket>& packets)
+{
+	packets.resize((triangles.size() + cLanes - 1) / cLanes);
+
+	for (size_t i = 0; i < packets.size(); ++i) {
+		Clear(packets[i]);
+		for (uint32_t lane = 0; lane < cLanes && i * cLanes + lane < triangles.size(); ++lane) {
+			Set(packets[i], lane, triangles[i * cLanes + lane]);
+		}
+	}
+}
+
+
+uint32_t TrianglePackets::Intersect(const Ray& ray, const TrianglePacket& packet, float* t, float* u, float* v)
+{
+	Vector3Lanes direction = Broadcast(ray.direction);
+	Vector3Lanes E1 = Load(packet.e1);
+	Vector3Lanes E2 = Load(packet.e2);
+
+	// if determinant is near zero, ray is parallel to triangle
+	Vector3Lanes P = Cross(direction, E2);
+	Lanes det = Dot(E1, P);
+	Lanes miss = Less(det, Broadcast(cMinDeterminant));
+
+	// compute u and test bounds
+	Vector3Lanes origin = Broadcast(ray.origin);
+	Vector3Lanes v0 = Load(packet.v0);
+	Vector3Lanes T = { Sub(origin.x, v0.x), Sub(origin.y, v0.y), Sub(origin.z, v0.z) };
+	Lanes U = Dot(T, P);
+	Lanes zero = Broadcast(0.0f);
+	miss = Or(miss, Or(Less(U, zero), Greater(U, det)));
+
+	// compute v and test bounds
+	Vector3Lanes Q = Cross(T, E1);
+	Lanes V = Dot(direction, Q);
+	miss = Or(miss, Or(Less(V, zero), Greater(Add(U, V), det)));
+
+	uint32_t hits = ~Bits(miss) & ((1u << cLanes) - 1);
+	if (!hits) return 0;
+
+	// compute and scale t, u and v
+	Lanes detInv = Div(Broadcast(1.0f), det);
+	Store(t, Mul(Dot(E2, Q), detInv));
+	Store(u, Mul(U, detInv));
+	Store(v, Mul(V, detInv));
+
+	return hits;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "Mathematics.hpp"
+
+
+
+namespace SkinCut
+{
+	namespace TrianglePackets
+	{
+#if defined(__AVX2__)
+		static const uint32_t cLanes = 8; // triangles per packet (one AVX register)
+#else
+		static const uint32_t cLanes = 4; // triangles per packet (one SSE register)
+#endif
+	}
+
+
+	// Triangles in structure-of-arrays layout: rows hold the x, y and z coordinates of a corner or
+	// an edge, with a lane per triangle. Empty lanes hold degenerate triangles, which are never hit.
+	struct alignas(32) TrianglePacket
+	{
+		float v0[3][TrianglePackets::cLanes]; // first corners
+		float e1[3][TrianglePackets::cLanes]; // edges v1 - v0
+		float e2[3][TrianglePackets::cLanes]; // edges v2 - v0
+	};
+
+
+	// Ray tests against all triangles of a packet at once. The test is Möller-Trumbore as done by
+	// Math::RayTriangleIntersection, with the same operations in the same order (the edges are
+	// computed once when packing), so each lane decides hit or miss exactly as the scalar test
+	// does and returns the same t, u and v.
+	namespace TrianglePackets
+	{
+		void Clear(TrianglePacket& packet); // make all lanes empty
+		void Set(TrianglePacket& packet, uint32_t lane, const Math::Triangle& triangle);
+		void Pack(const std::vector<Math::Triangle>& triangles, std::vector<TrianglePacket>& packets); // cLanes triangles per packet (the last one padded with empty lanes)
+
+		// Returns a bit per lane that is hit; t, u and v (of cLanes entries) are set for those lanes.
+		uint32_t Intersect(const Math::Ray& ray, const TrianglePacket& packet, float* t, float* u, float* v);
+	}
+}
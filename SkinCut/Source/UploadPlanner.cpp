@@ -0,0 +1,140 @@
+#include "UploadPlanner.hpp"
+
+#include <cstring>
+#include <algorithm>
+
+#include "Utility.hpp"
+
+
+using namespace SkinCut;
+
+
+
+const uint8_t MockBuffer::cUndefined = 0xCD;
+const uint32_t UploadPlanner::cHeadroom = 50;
+const uint32_t UploadPlanner::cMergeGap = 256;
+
+
+
+/*******************************************************************************
+Device buffer
+*******************************************************************************/
+
+DeviceBuffer::DeviceBuffer(ComPtr<ID3D11Device>& device, ComPtr<ID3D11Buffer>& buffer, D3D11_USAGE usage, UINT bindFlags)
+: mDevice(device), mBuffer(buffer), mUsage(usage), mBindFlags(bindFlags)
+{
+	mDevice->GetImmediateContext(mContext.GetAddressOf());
+}
+
+
+void DeviceBuffer::Allocate(uint32_t capacity)
+{
+	D3D11_BUFFER_DESC desc{};
+	desc.Usage = mUsage;
+	desc.ByteWidth = capacity;
+	desc.BindFlags = mBindFlags;
+	desc.CPUAccessFlags = (mUsage == D3D11_USAGE_DYNAMIC) ? D3D11_CPU_ACCESS_WRITE : 0;
+	desc.MiscFlags = 0;
+	desc.StructureByteStride = 0;
+
+	mBuffer.Reset();
+	HREXCEPT(mDevice->CreateBuffer(&desc, nullptr, mBuffer.GetAddressOf()));
+}
+
+
+void DeviceBuffer::Write(uint32_t offset, const void* data, uint32_t size, bool discard)
+{
+	if (mUsage == D3D11_USAGE_DYNAMIC) {
+		D3D11_MAPPED_SUBRESOURCE mapped;
+		HREXCEPT(mContext->Map(mBuffer.Get(), 0, discard ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE, 0, &mapped));
+		std::memcpy(static_cast<uint8_t*>(mapped.pData) + offset, data, size);
+		mContext->Unmap(mBuffer.Get(), 0);
+	}
+	else {
+		D3D11_BOX box = { offset, 0, 0, offset + size, 1, 1 };
+		mContext->UpdateSubresource(mBuffer.Get(), 0, &box, data, 0, 0);
+	}
+}
+
+
+
+/*******************************************************************************
+Mock buffer
+*******************************************************************************/
+
+void MockBuffer::Allocate(uint32_t capacity)
+{
+	mContents.assign(capacity, cUndefined);
+	mCalls.push_back({ true, 0, capacity, false });
+}
+
+
+void MockBuffer::Write(uint32_t offset, const void* data, uint32_t size, bool discard)
+{
+	if (uint64_t(offset) + size > mContents.size()) {
+		throw std::exception("Buffer write out of bounds");
+	}
+
+	if (discard) std::fill(mContents.begin(), mContents.end(), cUndefined);
+	std::memcpy(mContents.data() + offset, data, size);
+	mCalls.push_back({ false, offset, size, discard });
+}
+
+
+
+/*******************************************************************************
+Upload planning
+*******************************************************************************/
+
+UploadPlanner::UploadPlanner(std::unique_ptr<UploadTarget> target)
+: mTarget(std::move(target)), mCapacity(0)
+{
+}
+
+
+void UploadPlanner::Upload(const void* data, uint32_t size)
+{
+	if (size > mCapacity) {
+		mCapacity = static_cast<uint32_t>(uint64_t(size) * (100 + cHeadroom) / 100);
+		mTarget->Allocate(mCapacity);
+		mStats.allocations++;
+	}
+
+	if (size > 0) Write(data, { 0, size }, true);
+}
+
+
+void UploadPlanner::Upload(const void* data, uint32_t size, std::vector<ByteRange> changed)
+{
+	if (size > mCapacity) { // reallocation loses the contents
+		Upload(data, size);
+		return;
+	}
+
+	std::sort(changed.begin(), changed.end(), [](const ByteRange& a, const ByteRange& b) { return a.offset < b.offset; });
+
+	// Merge overlapping and nearby ranges; a few extra bytes are cheaper than another call.
+	ByteRange write = { 0, 0 };
+	for (const ByteRange& range : changed) {
+		uint32_t begin = range.offset;
+		uint32_t end = std::min(range.offset + range.size, size);
+		if (begin >= end) continue;
+
+		if (write.size > 0 && begin <= write.offset + write.size + cMergeGap) {
+			write.size = std::max(write.offset + write.size, end) - write.offset;
+		}
+		else {
+			if (write.size > 0) Write(data, write, false);
+			write = { begin, end - begin };
+		}
+	}
+	if (write.size > 0) Write(data, write, write.offset == 0 && write.size == size);
+}
+
+
+void UploadPlanner::Write(const void* data, ByteRange range, bool discard)
+{
+	mTarget->Write(range.offset, static_cast<const uint8_t*>(data) + range.offset, range.size, discard);
+	mStats.bytes += range.size;
+	mStats.writes++;
+}
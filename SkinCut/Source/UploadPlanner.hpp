@@ -0,0 +1,117 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+
+#include <d3d11.h>
+#include <wrl/client.h>
+
+
+using Microsoft::WRL::ComPtr;
+
+
+
+namespace SkinCut
+{
+	struct ByteRange
+	{
+		uint32_t offset;
+		uint32_t size;
+	};
+
+
+	struct UploadStats // cumulative buffer activity
+	{
+		uint64_t bytes = 0;			// bytes written
+		uint64_t writes = 0;		// number of writes
+		uint64_t allocations = 0;	// number of buffer (re)allocations
+	};
+
+
+	// Destination of buffer uploads. Implemented by GPU buffers (see DeviceBuffer), and can be
+	// implemented by a CPU mock to check the uploads made by an UploadPlanner.
+	class UploadTarget
+	{
+	public:
+		virtual ~UploadTarget() {}
+
+		virtual void Allocate(uint32_t capacity) = 0; // replace the buffer (contents undefined)
+		virtual void Write(uint32_t offset, const void* data, uint32_t size, bool discard) = 0; // discard: rest of the contents are no longer needed
+	};
+
+
+	// Direct3D buffer, created in place of the given buffer binding. Dynamic buffers are written
+	// with D3D11_MAP_WRITE_NO_OVERWRITE (the caller must not overwrite data the GPU may still read),
+	// default buffers with ranged UpdateSubresource calls.
+	class DeviceBuffer : public UploadTarget
+	{
+	private:
+		ComPtr<ID3D11Device> mDevice;
+		ComPtr<ID3D11DeviceContext> mContext;
+		ComPtr<ID3D11Buffer>& mBuffer;
+		D3D11_USAGE mUsage;
+		UINT mBindFlags;
+
+	public:
+		DeviceBuffer(ComPtr<ID3D11Device>& device, ComPtr<ID3D11Buffer>& buffer, D3D11_USAGE usage, UINT bindFlags);
+
+		void Allocate(uint32_t capacity) override;
+		void Write(uint32_t offset, const void* data, uint32_t size, bool discard) override;
+	};
+
+
+	// CPU stand-in for a buffer: keeps its contents and records every call, so the uploads an
+	// UploadPlanner makes can be checked without a device (see Benchmark::UploadPlanning).
+	// Contents that become undefined (on allocation, and outside a discarding write) are filled
+	// with cUndefined, so relying on them shows up as a mismatch.
+	class MockBuffer : public UploadTarget
+	{
+	public:
+		static const uint8_t cUndefined;
+
+		struct Call
+		{
+			bool allocate; // Allocate (size is the capacity) or Write
+			uint32_t offset;
+			uint32_t size;
+			bool discard;
+
+			bool operator==(const Call& c) const { return allocate == c.allocate && offset == c.offset && size == c.size && discard == c.discard; }
+		};
+
+		std::vector<uint8_t> mContents;
+		std::vector<Call> mCalls; // in order
+
+	public:
+		void Allocate(uint32_t capacity) override;
+		void Write(uint32_t offset, const void* data, uint32_t size, bool discard) override;
+	};
+
+
+	// Keeps a growable buffer up to date with a CPU-side copy of its contents. Buffers are
+	// allocated with headroom, so edits that grow the data usually only write what changed.
+	class UploadPlanner
+	{
+	public:
+		static const uint32_t cHeadroom; // percentage of extra capacity on (re)allocation
+		static const uint32_t cMergeGap; // changed ranges at most this many bytes apart are written at once
+
+	private:
+		std::unique_ptr<UploadTarget> mTarget;
+		uint32_t mCapacity;
+		UploadStats mStats;
+
+	public:
+		UploadPlanner(std::unique_ptr<UploadTarget> target);
+
+		void Upload(const void* data, uint32_t size); // all data changed
+		void Upload(const void* data, uint32_t size, std::vector<ByteRange> changed); // only the given ranges changed
+
+		uint32_t Capacity() const { return mCapacity; }
+		const UploadStats& Stats() const { return mStats; }
+
+	private:
+		void Write(const void* data, ByteRange range, bool discard);
+	};
+}
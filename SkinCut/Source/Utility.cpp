@@ -382,6 +382,27 @@ void Utility::GetTexture3D(ComPtr<ID3D11ShaderResourceView>& srv, ComPtr<ID3D11T
 
 
 
+ComPtr<ID3D11Texture2D> Utility::CopyTextureRegion(ComPtr<ID3D11Device>& device, ComPtr<ID3D11DeviceContext>& context, 
+	ComPtr<ID3D11Texture2D>& texture, const D3D11_BOX& region)
+{
+	D3D11_TEXTURE2D_DESC desc;
+	texture->GetDesc(&desc);
+	desc.Width = region.right - region.left;
+	desc.Height = region.bottom - region.top;
+	desc.MipLevels = 1;
+	desc.ArraySize = 1;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = 0;
+	desc.CPUAccessFlags = 0;
+	desc.MiscFlags = 0;
+
+	ComPtr<ID3D11Texture2D> copy;
+	HREXCEPT(device->CreateTexture2D(&desc, nullptr, copy.GetAddressOf()));
+	context->CopySubresourceRegion(copy.Get(), 0, 0, 0, 0, texture.Get(), 0, &region);
+	return copy;
+}
+
+
 void Utility::SaveTexture(ComPtr<ID3D11Device>& device, ComPtr<ID3D11DeviceContext>& context, 
 	ComPtr<ID3D11Resource>& resource, LPCWSTR filename)
 {
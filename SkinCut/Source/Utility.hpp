@@ -170,6 +170,11 @@ namespace SkinCut
 						  ComPtr<ID3D11Texture3D>& tex,
 						  D3D11_TEXTURE3D_DESC& desc);
 
+		ComPtr<ID3D11Texture2D> CopyTextureRegion(ComPtr<ID3D11Device>& device, 
+						 ComPtr<ID3D11DeviceContext>& context, 
+						 ComPtr<ID3D11Texture2D>& texture, 
+						 const D3D11_BOX& region); // copy of texel region (top mip level)
+
 		void SaveTexture(ComPtr<ID3D11Device>& device, 
 						 ComPtr<ID3D11DeviceContext>& context, 
 						 ComPtr<ID3D11Resource>& resource, 
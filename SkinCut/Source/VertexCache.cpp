@@ -0,0 +1,210 @@
+#include "VertexCache.hpp"
+
+#include <cmath>
+#include <array>
+#include <algorithm>
+
+#include "Structures.hpp"
+
+
+using namespace SkinCut;
+
+
+
+namespace
+{
+	constexpr uint32_t cNone = 0xFFFFFFFF;
+	constexpr uint32_t cMaxValence = 32; // valences with a tabulated score
+
+	// vertex score parameters (as proposed by Forsyth)
+	constexpr float cCacheDecayPower = 1.5f;
+	constexpr float cLastTriangleScore = 0.75f;
+	constexpr float cValenceBoostScale = 2.0f;
+	constexpr float cValenceBoostPower = 0.5f;
+
+
+	struct ScoreTable
+	{
+		std::array<float, VertexCache::cCacheSize> cache; // by cache position
+		std::array<float, cMaxValence> valence; // by number of remaining triangles
+
+		ScoreTable()
+		{
+			for (uint32_t i = 0; i < VertexCache::cCacheSize; ++i) {
+				// vertexes of the last triangle score the same, so that it is not favored to draw
+				// triangles that share its last edge
+				cache[i] = (i < 3) ? cLastTriangleScore :
+					std::pow(1.0f - float(i - 3) / float(VertexCache::cCacheSize - 3), cCacheDecayPower);
+			}
+			for (uint32_t i = 0; i < cMaxValence; ++i) {
+				valence[i] = (i == 0) ? 0.0f : cValenceBoostScale * std::pow(float(i), -cValenceBoostPower);
+			}
+		}
+
+		float Score(uint32_t position, uint32_t remaining) const
+		{
+			if (remaining == 0) return -1.0f; // (no triangles left to draw)
+
+			float score = (position == cNone) ? 0.0f : cache[position];
+			score += (remaining < cMaxValence) ? valence[remaining] : cValenceBoostScale * std::pow(float(remaining), -cValenceBoostPower);
+			return score;
+		}
+	};
+}
+
+
+
+void VertexCache::Order(const std::vector<uint32_t>& indexes, size_t vertexCount, std::vector<uint32_t>& order)
+{
+	static const ScoreTable table;
+
+	const uint32_t triangleCount = static_cast<uint32_t>(indexes.size() / 3);
+	order.clear();
+	order.reserve(triangleCount);
+
+	// Triangles of each vertex; the first remaining[v] entries of its list are not drawn yet.
+	std::vector<uint32_t> first(vertexCount + 1, 0), triangles(triangleCount * 3), remaining(vertexCount, 0);
+	for (uint32_t i = 0; i < triangleCount * 3; ++i) {
+		first[indexes[i] + 1]++;
+	}
+	for (size_t v = 0; v < vertexCount; ++v) {
+		first[v + 1] += first[v];
+	}
+	for (uint32_t i = 0; i < triangleCount * 3; ++i) {
+		triangles[first[indexes[i]] + remaining[indexes[i]]++] = i / 3;
+	}
+
+	std::vector<uint32_t> position(vertexCount, cNone); // in cache
+	std::vector<float> vertexScores(vertexCount);
+	for (size_t v = 0; v < vertexCount; ++v) {
+		vertexScores[v] = table.Score(cNone, remaining[v]);
+	}
+
+	std::vector<float> triangleScores(triangleCount);
+	std::vector<bool> drawn(triangleCount, false);
+	for (uint32_t t = 0; t < triangleCount; ++t) {
+		const uint32_t* c = &indexes[t * 3];
+		triangleScores[t] = vertexScores[c[0]] + vertexScores[c[1]] + vertexScores[c[2]];
+	}
+
+	// (the cache holds cCacheSize vertexes; the three beyond are the ones just pushed out)
+	std::vector<uint32_t> cache, updated;
+	cache.reserve(cCacheSize + 3);
+	updated.reserve(cCacheSize + 3);
+
+	uint32_t best = triangleCount ? static_cast<uint32_t>(std::max_element(triangleScores.begin(), triangleScores.end()) - triangleScores.begin()) : cNone;
+	uint32_t next = 0; // first triangle that may not be drawn yet (for when the cache has no candidates)
+
+	while (order.size() < triangleCount) {
+		if (best == cNone) {
+			while (drawn[next]) next++;
+			best = next;
+		}
+
+		order.push_back(best);
+		drawn[best] = true;
+
+		// remove the triangle from the lists of its vertexes and put them in front of the cache
+		const uint32_t* c = &indexes[best * 3];
+		updated.clear();
+		for (uint32_t k = 0; k < 3; ++k) {
+			uint32_t v = c[k];
+			uint32_t* list = &triangles[first[v]];
+			uint32_t* end = list + remaining[v];
+			std::iter_swap(std::find(list, end, best), end - 1);
+			remaining[v]--;
+
+			if (std::find(updated.begin(), updated.end(), v) == updated.end()) updated.push_back(v);
+		}
+		for (uint32_t v : cache) {
+			if (std::find(updated.begin(), updated.end(), v) == updated.end()) updated.push_back(v);
+		}
+		std::swap(cache, updated);
+
+		// rescore the vertexes that moved and their remaining triangles
+		for (uint32_t i = 0; i < cache.size(); ++i) {
+			uint32_t v = cache[i];
+			position[v] = (i < cCacheSize) ? i : cNone;
+
+			float score = table.Score(position[v], remaining[v]);
+			float delta = score - vertexScores[v];
+			vertexScores[v] = score;
+
+			for (uint32_t k = first[v]; k < first[v] + remaining[v]; ++k) {
+				triangleScores[triangles[k]] += delta;
+			}
+		}
+		if (cache.size() > cCacheSize) cache.resize(cCacheSize);
+
+		// the best candidate is a remaining triangle of a vertex in the cache
+		best = cNone;
+		float bestScore = -1.0f;
+		for (uint32_t v : cache) {
+			for (uint32_t k = first[v]; k < first[v] + remaining[v]; ++k) {
+				uint32_t t = triangles[k];
+				if (triangleScores[t] > bestScore || (triangleScores[t] == bestScore && t < best)) {
+					bestScore = triangleScores[t];
+					best = t;
+				}
+			}
+		}
+	}
+}
+
+
+void VertexCache::OptimizeTriangles(std::vector<uint32_t>& indexes, size_t vertexCount)
+{
+	std::vector<uint32_t> order;
+	Order(indexes, vertexCount, order);
+
+	std::vector<uint32_t> reordered(indexes.size());
+	for (size_t i = 0; i < order.size(); ++i) {
+		std::copy_n(&indexes[order[i] * 3], 3, &reordered[i * 3]);
+	}
+	std::swap(indexes, reordered);
+}
+
+
+void VertexCache::OptimizeFetch(std::vector<uint32_t>& indexes, std::vector<Vertex>& vertexes)
+{
+	std::vector<uint32_t> remap(vertexes.size(), cNone);
+	uint32_t count = 0;
+
+	for (uint32_t i : indexes) {
+		if (remap[i] == cNone) remap[i] = count++;
+	}
+	for (uint32_t& r : remap) {
+		if (r == cNone) r = count++;
+	}
+
+	std::vector<Vertex> reordered(vertexes.size());
+	for (size_t v = 0; v < vertexes.size(); ++v) {
+		reordered[remap[v]] = vertexes[v];
+	}
+	for (uint32_t& i : indexes) {
+		i = remap[i];
+	}
+	std::swap(vertexes, reordered);
+}
+
+
+VertexCache::Statistics VertexCache::Analyze(const std::vector<uint32_t>& indexes, size_t vertexCount)
+{
+	// A vertex is in the cache if at most cFifoSize vertexes were transformed since it was.
+	std::vector<uint32_t> transformed(vertexCount, 0); // time of the last transform (0 if never)
+	uint32_t time = cFifoSize + 1;
+	uint32_t misses = 0, referenced = 0;
+
+	for (uint32_t i : indexes) {
+		if (transformed[i] == 0) referenced++;
+		if (time - transformed[i] > cFifoSize) {
+			transformed[i] = time++;
+			misses++;
+		}
+	}
+
+	Statistics stats;
+	stats.acmr = indexes.empty() ? 0.0f : float(misses) / float(indexes.size() / 3);
+	stats.atvr = referenced ? float(misses) / float(referenced) : 0.0f;
+	return stats;
+}
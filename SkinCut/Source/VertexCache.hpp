@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+
+
+namespace SkinCut
+{
+	struct Vertex;
+
+
+	// Ordering of triangle lists for the GPU. Triangles are ordered for the post-transform vertex
+	// cache with Forsyth's algorithm (Linear-Speed Vertex Cache Optimisation): the next triangle
+	// is the one with the highest score among those touching the simulated cache, where vertexes
+	// score by recency in the cache and by the number of triangles they still have. Vertexes are
+	// then renumbered in order of first use, so the vertex buffer is fetched nearly sequentially.
+	namespace VertexCache
+	{
+		static const uint32_t cCacheSize = 32; // entries of the simulated cache used for ordering (LRU)
+		static const uint32_t cFifoSize = 16; // entries of the cache used for statistics (FIFO, as hardware)
+
+		struct Statistics
+		{
+			float acmr; // average cache miss ratio: transformed vertexes per triangle (0.5 at best, 3 at worst)
+			float atvr; // average transformed vertex ratio: transformed vertexes per referenced vertex (1 at best)
+		};
+
+		// Triangle order: order[i] is the triangle (of indexes) to draw i-th.
+		void Order(const std::vector<uint32_t>& indexes, size_t vertexCount, std::vector<uint32_t>& order);
+
+		void OptimizeTriangles(std::vector<uint32_t>& indexes, size_t vertexCount); // reorder triangles (see Order)
+		void OptimizeFetch(std::vector<uint32_t>& indexes, std::vector<Vertex>& vertexes); // renumber vertexes by first use (unused ones last)
+
+		Statistics Analyze(const std::vector<uint32_t>& indexes, size_t vertexCount);
+	}
+}
@@ -0,0 +1,126 @@
+#include "VertexFormat.hpp"
+
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+
+#include "Structures.hpp"
+#include "Mathematics.hpp"
+
+
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+using namespace SkinCut;
+
+
+
+namespace
+{
+	// Octahedral encoding of a unit vector: project onto the octahedron |x|+|y|+|z| = 1
+	// and fold the lower hemisphere over the diagonals, giving a point in [-1,1]^2.
+	XMVECTOR EncodeOctahedral(FXMVECTOR n)
+	{
+		XMVECTOR one = XMVectorSplatOne();
+		XMVECTOR p = XMVectorDivide(n, XMVector3Dot(XMVectorAbs(n), one));
+
+		if (XMVectorGetZ(p) < 0.0f) {
+			XMVECTOR sign = XMVectorSelect(XMVectorNegate(one), one, XMVectorGreaterOrEqual(p, XMVectorZero()));
+			p = XMVectorMultiply(XMVectorSubtract(one, XMVectorAbs(XMVectorSwizzle<1, 0, 2, 3>(p))), sign);
+		}
+
+		return p;
+	}
+
+	XMVECTOR DecodeOctahedral(FXMVECTOR e)
+	{
+		XMVECTOR one = XMVectorSplatOne();
+		float z = 1.0f - XMVectorGetX(XMVector2Dot(XMVectorAbs(e), one));
+		XMVECTOR v = e;
+
+		if (z < 0.0f) {
+			XMVECTOR sign = XMVectorSelect(XMVectorNegate(one), one, XMVectorGreaterOrEqual(e, XMVectorZero()));
+			v = XMVectorMultiply(XMVectorSubtract(one, XMVectorAbs(XMVectorSwizzle<1, 0, 2, 3>(e))), sign);
+		}
+
+		return XMVector3Normalize(XMVectorSetZ(v, z));
+	}
+
+
+	// Tangent frame (tangent, bitangent, normal) as a unit quaternion. The frame is made
+	// orthonormal around the normal; the bitangent handedness is stored in the sign of w.
+	XMVECTOR EncodeTangentFrame(FXMVECTOR n, FXMVECTOR tangent, float handedness)
+	{
+		XMVECTOR t = XMVectorSubtract(tangent, XMVectorMultiply(n, XMVector3Dot(n, tangent))); // Gram-Schmidt
+		if (XMVectorGetX(XMVector3LengthSq(t)) < 1e-12f) { // degenerate tangent: any perpendicular will do
+			t = XMVector3Cross(n, (std::fabs(XMVectorGetX(n)) < 0.9f) ? g_XMIdentityR0 : g_XMIdentityR1);
+		}
+		t = XMVector3Normalize(t);
+
+		XMMATRIX frame(t, XMVector3Cross(n, t), n, g_XMIdentityR3);
+		XMVECTOR q = XMQuaternionNormalize(XMQuaternionRotationMatrix(frame));
+
+		// q and -q are the same rotation, so w can be made non-negative and carry the handedness
+		if (XMVectorGetW(q) < 0.0f) q = XMVectorNegate(q);
+
+		float w = XMVectorGetW(q);
+		if (w < VertexFormat::cMinQuaternionW) {
+			float b = VertexFormat::cMinQuaternionW;
+			q = XMVectorScale(q, std::sqrt((1.0f - b * b) / std::max(1.0f - w * w, 1e-12f)));
+			q = XMVectorSetW(q, b);
+		}
+
+		return (handedness < 0.0f) ? XMVectorNegate(q) : q;
+	}
+}
+
+
+
+void VertexFormat::Pack(const Vertex& in, PackedVertex& out)
+{
+	out.position = in.position;
+	XMStoreHalf2(&out.texcoord, XMLoadFloat2(&in.texcoord));
+
+	XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&in.normal));
+	XMVECTOR t = XMVectorSetW(XMLoadFloat4(&in.tangent), 0.0f);
+
+	XMStoreShortN2(&out.normal, EncodeOctahedral(n));
+	XMStoreShortN4(&out.tangent, EncodeTangentFrame(n, t, in.tangent.w));
+}
+
+
+void VertexFormat::Pack(const std::vector<Vertex>& in, std::vector<PackedVertex>& out)
+{
+	out.resize(in.size());
+	for (size_t i = 0; i < in.size(); ++i) {
+		Pack(in[i], out[i]);
+	}
+}
+
+
+void VertexFormat::Unpack(const PackedVertex& in, Vertex& out)
+{
+	out.position = in.position;
+	XMStoreFloat2(&out.texcoord, XMLoadHalf2(&in.texcoord));
+
+	XMVECTOR n = DecodeOctahedral(XMLoadShortN2(&in.normal));
+	XMVECTOR q = XMLoadShortN4(&in.tangent);
+	float handedness = (XMVectorGetW(q) < 0.0f) ? -1.0f : 1.0f;
+
+	XMVECTOR t = XMVector3Rotate(g_XMIdentityR0, XMQuaternionNormalize(q));
+	XMVECTOR b = XMVectorScale(XMVector3Cross(n, t), handedness);
+
+	XMStoreFloat3(&out.normal, n);
+	XMStoreFloat4(&out.tangent, XMVectorSetW(t, handedness));
+	XMStoreFloat3(&out.bitangent, b);
+}
+
+
+std::vector<D3D11_INPUT_ELEMENT_DESC> VertexFormat::InputLayout()
+{
+	return {
+		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT,    0, offsetof(PackedVertex, position), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT,       0, offsetof(PackedVertex, texcoord), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "NORMAL",   0, DXGI_FORMAT_R16G16_SNORM,       0, offsetof(PackedVertex, normal),   D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "TANGENT",  0, DXGI_FORMAT_R16G16B16A16_SNORM, 0, offsetof(PackedVertex, tangent),  D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	};
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include <d3d11.h>
+
+
+
+namespace SkinCut
+{
+	struct Vertex;
+	struct PackedVertex;
+
+
+	// Conversion between the full-precision vertexes edited by the mesh and the compressed
+	// render vertexes uploaded to the GPU (see PackedVertex). Packing is lossy; the mesh
+	// keeps its own vertex array, so packed data is never read back for editing.
+	namespace VertexFormat
+	{
+		static const float cMinQuaternionW = 1.0f / 32767.0f; // keeps the sign of w (handedness) after quantization
+
+		void Pack(const Vertex& in, PackedVertex& out);
+		void Pack(const std::vector<Vertex>& in, std::vector<PackedVertex>& out);
+		void Unpack(const PackedVertex& in, Vertex& out);
+
+		// input layout of PackedVertex (vertex shaders using it must decode with Packing.h.hlsl)
+		std::vector<D3D11_INPUT_ELEMENT_DESC> InputLayout();
+	}
+}
@@ -0,0 +1,107 @@
+#include "VertexIndex.hpp"
+
+#include <algorithm>
+
+#include "Hash.hpp"
+#include "Structures.hpp"
+
+
+using namespace SkinCut;
+
+
+
+VertexIndex::VertexIndex(const std::vector<Vertex>* vertexes) : mSize(0), mMask(0), mVertexes(vertexes)
+{
+}
+
+
+std::pair<uint32_t, bool> VertexIndex::Insert(const Vertex& v, uint32_t index)
+{
+	if ((mSize + 1) * 100 > mSlots.size() * cMaxLoad) {
+		Rehash(std::max(cMinCapacity, mSlots.size() * 2));
+	}
+
+	uint64_t fingerprint = hash_fingerprint(v.position, v.texcoord);
+	uint32_t tag = static_cast<uint32_t>(fingerprint >> 32);
+
+	for (size_t i = fingerprint & mMask;; i = (i + 1) & mMask) {
+		Slot& slot = mSlots[i];
+
+		if (slot.index == cEmpty) {
+			slot.tag = tag;
+			slot.index = index;
+			mSize++;
+			return std::make_pair(index, true);
+		}
+
+		if (slot.tag == tag && Equal((*mVertexes)[slot.index], v)) {
+			return std::make_pair(slot.index, false); // already exists
+		}
+	}
+}
+
+
+bool VertexIndex::Erase(const Vertex& v, uint32_t index)
+{
+	if (mSlots.empty()) return false;
+
+	size_t i = hash_fingerprint(v.position, v.texcoord) & mMask;
+	for (;; i = (i + 1) & mMask) {
+		if (mSlots[i].index == cEmpty) return false;
+		if (mSlots[i].index == index) break;
+	}
+
+	// shift following entries of the probe sequence back into the gap
+	for (size_t j = (i + 1) & mMask; mSlots[j].index != cEmpty; j = (j + 1) & mMask) {
+		const Vertex& u = (*mVertexes)[mSlots[j].index];
+		size_t home = hash_fingerprint(u.position, u.texcoord) & mMask;
+		if (((j - home) & mMask) >= ((j - i) & mMask)) {
+			mSlots[i] = mSlots[j];
+			i = j;
+		}
+	}
+
+	mSlots[i].index = cEmpty;
+	mSize--;
+	return true;
+}
+
+
+void VertexIndex::Reserve(size_t count)
+{
+	size_t capacity = cMinCapacity;
+	while (capacity * cMaxLoad < count * 100) capacity *= 2;
+	if (capacity > mSlots.size()) Rehash(capacity);
+}
+
+void VertexIndex::Clear()
+{
+	mSlots.clear();
+	mSize = 0;
+	mMask = 0;
+}
+
+
+void VertexIndex::Rehash(size_t capacity)
+{
+	std::vector<Slot> slots(capacity, Slot{ 0, cEmpty });
+	std::swap(mSlots, slots);
+	mMask = capacity - 1;
+
+	for (const Slot& slot : slots) {
+		if (slot.index == cEmpty) continue;
+
+		// home slot follows from the fingerprint of the indexed vertex
+		const Vertex& v = (*mVertexes)[slot.index];
+		size_t i = hash_fingerprint(v.position, v.texcoord) & mMask;
+		while (mSlots[i].index != cEmpty) i = (i + 1) & mMask;
+		mSlots[i] = slot;
+	}
+}
+
+
+bool VertexIndex::Equal(const Vertex& v0, const Vertex& v1) const
+{
+	return std::tie(v0.position, v0.texcoord, v0.normal, v0.tangent) == 
+	       std::tie(v1.position, v1.texcoord, v1.normal, v1.tangent);
+}
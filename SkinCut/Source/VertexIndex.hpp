@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <utility>
+
+
+
+namespace SkinCut
+{
+	struct Vertex;
+
+
+	// Deduplication index over a vertex array. Slots hold only a vertex index and a tag of
+	// the vertex fingerprint (quantized position and texture coordinate); candidates are
+	// confirmed against the vertex array itself, so vertexes are never stored twice.
+	class VertexIndex
+	{
+	public: // constants
+		static const uint32_t cEmpty = 0xFFFFFFFF;
+		static const size_t cMinCapacity = 64;
+		static const size_t cMaxLoad = 70; // percent
+
+
+	private:
+		struct Slot
+		{
+			uint32_t tag;			// upper half of fingerprint
+			uint32_t index;			// vertex index (cEmpty if slot is empty)
+		};
+
+		std::vector<Slot> mSlots;
+		size_t mSize;
+		size_t mMask;
+		const std::vector<Vertex>* mVertexes;
+
+
+	public:
+		VertexIndex(const std::vector<Vertex>* vertexes = nullptr);
+
+		// Find a vertex equal to v, or register v under the given index (which the caller
+		// must then append to the vertex array). Returns <index, inserted>.
+		std::pair<uint32_t, bool> Insert(const Vertex& v, uint32_t index);
+
+		// Unregister the vertex at the given index (v must still be its value in the vertex
+		// array, which the caller may shrink afterwards). Returns false if not registered.
+		bool Erase(const Vertex& v, uint32_t index);
+
+		void Reserve(size_t count);
+		void Clear();
+
+		size_t Size() const { return mSize; }
+		size_t Bytes() const { return mSlots.capacity() * sizeof(Slot); }
+
+
+	private:
+		void Rehash(size_t capacity);
+		bool Equal(const Vertex& v0, const Vertex& v1) const;
+	};
+}